@@ -21,15 +21,19 @@
  */
 
 #include <AmgXCSRMatrix.H>
+#include <AmgXProfiler.H>
+#include <AmgXRecorder.H>
 
 #include <cuda.h>
 #include <cub/cub.cuh>
 #include <thrust/scan.h>
 #include <thrust/sequence.h>
 #include <thrust/execution_policy.h>
+#include <algorithm>
 #include <numeric>
 
 #include <mpi.h>
+#include <sys/mman.h>
 
 #define CHECK(call)                                              \
     {                                                            \
@@ -142,12 +146,99 @@ __global__ void floatToDoubleArray(
     }
 }
 
+// Gather the CSR values from the LDU arrays on the host, using the permutation
+template<class T>
+static void gatherLDUValuesHost(
+    const int nTotalNz,
+    const int nLocalRows,
+    const int nInternalFaces,
+    const int *perm,
+    const T *diagVals,
+    const T *upperVals,
+    const T *lowerVals,
+    const T *extVals,
+    double *values)
+{
+    const int nLocalNz = nLocalRows + 2 * nInternalFaces;
+
+    // Reads the permutation and gathers the values, writes the CSR values
+    AMGX_PROFILE_TRAFFIC(Host, (4.0 + sizeof(T)) * nTotalNz, 8.0 * nTotalNz, 0.0);
+
+    for (int i = 0; i < nTotalNz; ++i)
+    {
+        const int p = perm[i];
+
+        if (p < nLocalRows)
+        {
+            values[i] = (double)diagVals[p];
+        }
+        else if (p < nLocalRows + nInternalFaces)
+        {
+            values[i] = (double)upperVals[p - nLocalRows];
+        }
+        else if (p < nLocalNz)
+        {
+            values[i] = (double)lowerVals[p - nLocalRows - nInternalFaces];
+        }
+        else
+        {
+            values[i] = (double)extVals[p - nLocalNz];
+        }
+    }
+}
+
+// Sum the LDU coefficients of each local row on the host
+template<class T>
+static void sumLDURows(
+    const int nLocalRows,
+    const int nInternalFaces,
+    const int nExtNz,
+    const int *rows,
+    const T *diagVals,
+    const T *upperVals,
+    const T *lowerVals,
+    const T *extVals,
+    std::vector<double> &sumA)
+{
+    sumA.resize(nLocalRows);
+
+    // Reads the coefficients and their rows, and updates the sum of the row of each off-diagonal
+    const double nOffDiag = 2.0 * nInternalFaces + nExtNz;
+    AMGX_PROFILE_TRAFFIC(Host, sizeof(T) * (nLocalRows + nOffDiag) + 12.0 * nOffDiag,
+                         8.0 * (nLocalRows + nOffDiag), nOffDiag);
+
+    for (int i = 0; i < nLocalRows; ++i)
+    {
+        sumA[i] = (double)diagVals[i];
+    }
+
+    for (int i = 0; i < nInternalFaces; ++i)
+    {
+        sumA[rows[i]] += (double)upperVals[i];
+        sumA[rows[nInternalFaces + i]] += (double)lowerVals[i];
+    }
+
+    for (int i = 0; i < nExtNz; ++i)
+    {
+        sumA[rows[2 * nInternalFaces + i]] += (double)extVals[i];
+    }
+}
+
 void AmgXCSRMatrix::initialiseComms(
     MPI_Comm devWorld,
-    int gpuProc)
+    int gpuProc,
+    MatrixLocation location)
 {
-    this->devWorld = devWorld;
+    // The matrix communicates on its own duplicate, so that its collectives never
+    // interleave with those of a solve run by the worker thread of a solver
+    if (this->devWorld != nullptr && this->devWorld != MPI_COMM_NULL)
+    {
+        MPI_Comm_free(&this->devWorld);
+    }
+
+    MPI_Comm_dup(devWorld, &this->devWorld);
     this->gpuProc = gpuProc;
+    this->location = location;
 
     MPI_Comm_rank(this->devWorld, &myDevWorldRank);
     MPI_Comm_size(this->devWorld, &devWorldSize);
@@ -160,8 +251,13 @@ void AmgXCSRMatrix::initialiseConsolidation(
     const int nInternalFaces,
     const int nExtNz,
     int*& rowIndicesTmp,
-    int*& colIndicesTmp)
+    int*& colIndicesTmp,
+    bool withIndices)
 {
+    // The indices are only needed by the conversion, not when the structure is loaded
+    rowIndicesTmp = nullptr;
+    colIndicesTmp = nullptr;
+
     // Consolidation has been previously used, must deallocate the structures
     if (consolidationStatus != ConsolidationStatus::Uninitialised)
     {
@@ -176,8 +272,11 @@ void AmgXCSRMatrix::initialiseConsolidation(
         consolidationStatus = ConsolidationStatus::None;
 
         // Allocate data only
-        CHECK(cudaMalloc((void **)&rowIndicesTmp, (nLocalNz + nExtNz) * sizeof(int)));
-        CHECK(cudaMalloc((void **)&colIndicesTmp, (nLocalNz + nExtNz) * sizeof(int)));
+        if (withIndices)
+        {
+            CHECK(cudaMalloc((void **)&rowIndicesTmp, (nLocalNz + nExtNz) * sizeof(int)));
+            CHECK(cudaMalloc((void **)&colIndicesTmp, (nLocalNz + nExtNz) * sizeof(int)));
+        }
         CHECK(cudaMalloc((void **)&valuesTmp, (nLocalNz + nExtNz) * sizeof(double)));
         CHECK(cudaMalloc((void **)&fvaluesTmp, (nLocalNz + nExtNz) * sizeof(float)));
         return;
@@ -224,15 +323,21 @@ void AmgXCSRMatrix::initialiseConsolidation(
         // We are consolidating data that already exists on the GPU
         CHECK(cudaMalloc((void **)&rhsCons, sizeof(double) * nConsRows));
         CHECK(cudaMalloc((void **)&pCons, sizeof(double) * nConsRows));
-        CHECK(cudaMalloc((void **)&rowIndicesTmp, sizeof(int) * (nConsNz + nConsExtNz)));
-        CHECK(cudaMalloc((void **)&colIndicesTmp, sizeof(int) * (nConsNz + nConsExtNz)));
+        if (withIndices)
+        {
+            CHECK(cudaMalloc((void **)&rowIndicesTmp, sizeof(int) * (nConsNz + nConsExtNz)));
+            CHECK(cudaMalloc((void **)&colIndicesTmp, sizeof(int) * (nConsNz + nConsExtNz)));
+        }
         CHECK(cudaMalloc((void **)&valuesTmp, sizeof(double) * (nConsNz + nConsExtNz)));
         CHECK(cudaMalloc((void **)&fvaluesTmp, sizeof(float) * (nConsNz + nConsExtNz)));
 
         CHECK(cudaIpcGetMemHandle(&handles.rhsConsHandle, rhsCons));
         CHECK(cudaIpcGetMemHandle(&handles.solConsHandle, pCons));
-        CHECK(cudaIpcGetMemHandle(&handles.rowIndicesConsHandle, rowIndicesTmp));
-        CHECK(cudaIpcGetMemHandle(&handles.colIndicesConsHandle, colIndicesTmp));
+        if (withIndices)
+        {
+            CHECK(cudaIpcGetMemHandle(&handles.rowIndicesConsHandle, rowIndicesTmp));
+            CHECK(cudaIpcGetMemHandle(&handles.colIndicesConsHandle, colIndicesTmp));
+        }
         CHECK(cudaIpcGetMemHandle(&handles.valuesConsHandle, valuesTmp));
         CHECK(cudaIpcGetMemHandle(&handles.fvaluesConsHandle, fvaluesTmp));
     }
@@ -244,8 +349,11 @@ void AmgXCSRMatrix::initialiseConsolidation(
     {
         CHECK(cudaIpcOpenMemHandle((void **)&rhsCons, handles.rhsConsHandle, cudaIpcMemLazyEnablePeerAccess));
         CHECK(cudaIpcOpenMemHandle((void **)&pCons, handles.solConsHandle, cudaIpcMemLazyEnablePeerAccess));
-        CHECK(cudaIpcOpenMemHandle((void **)&rowIndicesTmp, handles.rowIndicesConsHandle, cudaIpcMemLazyEnablePeerAccess));
-        CHECK(cudaIpcOpenMemHandle((void **)&colIndicesTmp, handles.colIndicesConsHandle, cudaIpcMemLazyEnablePeerAccess));
+        if (withIndices)
+        {
+            CHECK(cudaIpcOpenMemHandle((void **)&rowIndicesTmp, handles.rowIndicesConsHandle, cudaIpcMemLazyEnablePeerAccess));
+            CHECK(cudaIpcOpenMemHandle((void **)&colIndicesTmp, handles.colIndicesConsHandle, cudaIpcMemLazyEnablePeerAccess));
+        }
         CHECK(cudaIpcOpenMemHandle((void **)&valuesTmp, handles.valuesConsHandle, cudaIpcMemLazyEnablePeerAccess));
         CHECK(cudaIpcOpenMemHandle((void **)&fvaluesTmp, handles.fvaluesConsHandle, cudaIpcMemLazyEnablePeerAccess));
     }
@@ -273,6 +381,26 @@ void AmgXCSRMatrix::setValuesLDU
     const float *extVals
 )
 {
+    // Negligible coefficients are dropped first, see setDropTolerance
+    if (!filteringLDU)
+    {
+        lduFiltered = false;
+
+        if (dropTolerance > 0.0)
+        {
+            setValuesLDUFiltered(nLocalRows, nInternalFaces, diagIndexGlobal, lowOffGlobal, uppOffGlobal,
+                                 upperAddr, lowerAddr, nExtNz, extRow, extCol,
+                                 diagVals, upperVals, lowerVals, extVals);
+            return;
+        }
+    }
+
+    AMGX_PROFILE_SCOPE("setValuesLDU:float");
+
+    AmgXRecorder::recordSetValuesLDU(this, nLocalRows, nInternalFaces, diagIndexGlobal,
+        lowOffGlobal, uppOffGlobal, upperAddr, lowerAddr, nExtNz, extRow, extCol,
+        diagVals, upperVals, lowerVals, extVals);
+
     // Make a copy of the host vectors, converting all floats to doubles
     double* ddiagVals  = new double[nLocalRows];
     double* dupperVals = new double[nInternalFaces];
@@ -295,6 +423,9 @@ void AmgXCSRMatrix::setValuesLDU
         dextVals[i] = (double)extVals[i];
     }
 
+    // The call is recorded in single precision
+    AmgXRecordPause pause;
+
     setValuesLDU
     (
         nLocalRows,
@@ -340,13 +471,103 @@ void AmgXCSRMatrix::setValuesLDU
     const double *extVals
 )
 {
+    // Negligible coefficients are dropped first, see setDropTolerance
+    if (!filteringLDU)
+    {
+        lduFiltered = false;
+
+        if (dropTolerance > 0.0)
+        {
+            setValuesLDUFiltered(nLocalRows, nInternalFaces, diagIndexGlobal, lowOffGlobal, uppOffGlobal,
+                                 upperAddr, lowerAddr, nExtNz, extRow, extCol,
+                                 diagVals, upperVals, lowerVals, extVals);
+            return;
+        }
+    }
+
+    AMGX_PROFILE_SCOPE("setValuesLDU");
+
+    AmgXRecorder::recordSetValuesLDU(this, nLocalRows, nInternalFaces, diagIndexGlobal,
+        lowOffGlobal, uppOffGlobal, upperAddr, lowerAddr, nExtNz, extRow, extCol,
+        diagVals, upperVals, lowerVals, extVals);
+
+    // Keep the sizes of the LDU matrix, saved with snapshots
+    nLduRows = nLocalRows;
+    nLduInternalFaces = nInternalFaces;
+    nLduExtNz = nExtNz;
+    lduDiagIndexGlobal = diagIndexGlobal;
+
+    // The sizes given by the caller, before any coefficients were dropped
+    if (!filteringLDU)
+    {
+        nInputInternalFaces = nInternalFaces;
+        nInputExtNz = nExtNz;
+    }
+
+    // A structure converted before, by this run or an earlier one, is read from the cache
+    const std::string cacheFile = structureCacheFile(nLocalRows, nInternalFaces, diagIndexGlobal,
+                                                     lowOffGlobal, uppOffGlobal, upperAddr, lowerAddr,
+                                                     nExtNz, extRow, extCol);
+    bool cached = false;
+
+    if (!cacheFile.empty())
+    {
+        // Replacing the structure is part of this call
+        AmgXRecordPause pause;
+        cached = loadStructureCache(cacheFile);
+    }
+
+    AMGX_PROFILE_BEGIN(rowSumsScope, "setValuesLDU:rowSums");
+
+    // Keep the row of each coefficient for the row sums of later updates
+    sumARows.resize(2 * nInternalFaces + nExtNz);
+    AMGX_PROFILE_TRAFFIC(Host, 4.0 * sumARows.size(), 4.0 * sumARows.size(), 0.0);
+
+    std::copy(lowerAddr, lowerAddr + nInternalFaces, sumARows.begin());
+    std::copy(upperAddr, upperAddr + nInternalFaces, sumARows.begin() + nInternalFaces);
+    std::copy(extRow, extRow + nExtNz, sumARows.begin() + 2 * nInternalFaces);
+
+    // The update of a cached structure sums the rows itself
+    if (!cached)
+    {
+        sumLDURows(nLocalRows, nInternalFaces, nExtNz, sumARows.data(),
+                   diagVals, upperVals, lowerVals, extVals, sumA);
+    }
+
+    AMGX_PROFILE_END(rowSumsScope);
+
+    if (cached)
+    {
+        // Recorded as this call
+        AmgXRecordPause pause;
+        updateValues(nLocalRows, nInternalFaces, nExtNz, diagVals, upperVals, lowerVals, extVals);
+        return;
+    }
+
+    if (isOnHost())
+    {
+        AMGX_PROFILE_BEGIN(hostScope, "setValuesLDU:host");
+        setValuesLDUHost(nLocalRows, nInternalFaces, diagIndexGlobal, lowOffGlobal, uppOffGlobal,
+                         upperAddr, lowerAddr, nExtNz, extRow, extCol,
+                         diagVals, upperVals, lowerVals, extVals);
+        AMGX_PROFILE_END(hostScope);
+
+        if (!cacheFile.empty())
+        {
+            saveStructureCache(cacheFile);
+        }
+        return;
+    }
+
     // Determine the local non-zeros from the internal faces
     int nLocalNz = nLocalRows + 2 * nInternalFaces;
     int *rowIndicesTmp;
     int *permTmp;
     int *colIndicesTmp;
 
+    AMGX_PROFILE_BEGIN(consolidationScope, "setValuesLDU:consolidation");
     initialiseConsolidation(nLocalRows, nLocalNz, nInternalFaces, nExtNz, rowIndicesTmp, colIndicesTmp);
+    AMGX_PROFILE_END(consolidationScope);
 
     int nTotalNz = 0;
     int nRows = 0;
@@ -355,6 +576,8 @@ void AmgXCSRMatrix::setValuesLDU
     std::vector<int> lowOffGlobalAll(devWorldSize);
     std::vector<int> uppOffGlobalAll(devWorldSize);
 
+    AMGX_PROFILE_BEGIN(copyScope, "setValuesLDU:copy");
+
     switch (consolidationStatus)
     {
 
@@ -393,6 +616,12 @@ void AmgXCSRMatrix::setValuesLDU
         {
             CHECK(cudaMemcpy(valuesTmp + nLocalNz, extVals, nExtNz * sizeof(double), cudaMemcpyDefault));
         }
+
+        // The addresses and values are copied from the host, the sequences written and
+        // the addresses of the faces copied again into the columns on the device
+        const double transferred = 8.0 * (nInternalFaces + nExtNz) + 8.0 * nTotalNz;
+        AMGX_PROFILE_TRAFFIC(Transfer, transferred, transferred, 0.0);
+        AMGX_PROFILE_TRAFFIC(Device, 8.0 * nInternalFaces, 4.0 * nTotalNz + 8.0 * nRows + 8.0 * nInternalFaces, 0.0);
         break;
     }
     case ConsolidationStatus::Device:
@@ -416,11 +645,15 @@ void AmgXCSRMatrix::setValuesLDU
             CHECK(cudaMemcpy(valuesTmp + nConsNz + extNzDispls[myDevWorldRank], extVals, nExtNz * sizeof(double), cudaMemcpyDefault));
         }
 
+        // Each rank copies its addresses and values from the host
+        const double transferred = 8.0 * (nInternalFaces + nExtNz) + 8.0 * (nLocalNz + nExtNz);
+        AMGX_PROFILE_TRAFFIC(Transfer, transferred, transferred, 0.0);
+
         // cudaMemcpy does not block the host in the cases above, device to device copies,
         // so sychronize with device to ensure operation is complete. Barrier on all devWorld
         // ranks to ensure full arrays are populated before the root process uses the data.
         CHECK(cudaDeviceSynchronize());
-        int ierr = MPI_Barrier(devWorld);
+        AmgXProfiler::barrier(devWorld, "setValuesLDU:barrier devWorld");
 
         if (gpuProc == 0)
         {
@@ -454,6 +687,12 @@ void AmgXCSRMatrix::setValuesLDU
                     fixConsolidatedRowIndices<<<nblocks, nthreads>>>(nif, nifDisp, nenz, extDisp, nConsRows, nConsInternalFaces, rowDisp, rowIndicesTmp);
                 }
             }
+
+            // The root writes the sequences, copies the addresses of the faces into the columns
+            // and shifts the row indices of the ranks, about all of those of the off-diagonals
+            const double nOffDiag = 2.0 * nConsInternalFaces + nConsExtNz;
+            AMGX_PROFILE_TRAFFIC(Device, 8.0 * nConsInternalFaces + 4.0 * nOffDiag,
+                                 4.0 * nTotalNz + 8.0 * nConsRows + 8.0 * nConsInternalFaces + 4.0 * nOffDiag, 0.0);
         }
         else
         {
@@ -482,8 +721,12 @@ void AmgXCSRMatrix::setValuesLDU
     }
     }
 
+    AMGX_PROFILE_END(copyScope);
+
     if (gpuProc == 0)
     {
+        AMGX_PROFILE_BEGIN(sortScope, "setValuesLDU:sort");
+
         // Make space for the row indices and stored permutation
         int *rowIndices;
         CHECK(cudaMalloc(&rowIndices, sizeof(int) * nTotalNz));
@@ -511,6 +754,13 @@ void AmgXCSRMatrix::setValuesLDU
         rowIndices = d_keys.Current();
         ldu2csrPerm = d_values.Current();
 
+        // A radix sort of 32-bit keys makes a histogram pass and four passes of 8 bits,
+        // each reading and writing the keys and values
+        AMGX_PROFILE_TRAFFIC(Device, 36.0 * nTotalNz, 32.0 * nTotalNz, 0.0);
+
+        AMGX_PROFILE_END(sortScope);
+        AMGX_PROFILE_BEGIN(scanScope, "setValuesLDU:scan");
+
         // Make space for the row offsets
         CHECK(cudaMalloc(&rowOffsets, sizeof(int) * (nRows + 1)));
         CHECK(cudaMemset(rowOffsets, 0, sizeof(int) * (nRows + 1)));
@@ -522,6 +772,12 @@ void AmgXCSRMatrix::setValuesLDU
         thrust::exclusive_scan(thrust::device, rowOffsets, rowOffsets + nRows + 1, rowOffsets);
         CHECK(cudaFree(rowIndices));
 
+        // The row indices are read and counted by atomics, then the offsets are scanned
+        AMGX_PROFILE_TRAFFIC(Device, 8.0 * nTotalNz + 4.0 * (nRows + 1), 4.0 * nTotalNz + 8.0 * (nRows + 1), 0.0);
+
+        AMGX_PROFILE_END(scanScope);
+        AMGX_PROFILE_SCOPE("setValuesLDU:permutation");
+
         // Transform the local column indices to global column indices
         if (isConsolidated())
         {
@@ -551,6 +807,118 @@ void AmgXCSRMatrix::setValuesLDU
         applyPermutation<<<nblocks, nthreads>>>(nTotalNz, ldu2csrPerm, colIndicesTmp, valuesTmp, colIndicesGlobal, values, false);
 
         CHECK(cudaFree(colIndicesTmp));
+
+        // The local columns of the diagonal and faces are made global in place, then
+        // the permutation gathers the columns and values
+        const double nLduNz = isConsolidated() ? nConsNz : nLocalNz;
+        AMGX_PROFILE_TRAFFIC(Device, 4.0 * nLduNz + 16.0 * nTotalNz, 4.0 * nLduNz + 12.0 * nTotalNz, 0.0);
+    }
+
+    if (!cacheFile.empty())
+    {
+        saveStructureCache(cacheFile);
+    }
+}
+
+// Perform the conversion between an LDU matrix and a CSR matrix in host memory
+void AmgXCSRMatrix::setValuesLDUHost
+(
+    int nLocalRows,
+    int nInternalFaces,
+    int diagIndexGlobal,
+    int lowOffGlobal,
+    int uppOffGlobal,
+    const int *upperAddr,
+    const int *lowerAddr,
+    const int nExtNz,
+    const int *extRow,
+    const int *extCol,
+    const double *diagVals,
+    const double *upperVals,
+    const double *lowerVals,
+    const double *extVals
+)
+{
+    // Host modes use one rank per solver, so no consolidation is ever required
+    if (devWorldSize > 1)
+    {
+        fprintf(stderr, "Consolidation is not supported for host matrices.\n");
+        return;
+    }
+
+    // The structure has been previously set, must deallocate it
+    if (consolidationStatus != ConsolidationStatus::Uninitialised)
+    {
+        release();
+    }
+
+    // This value will be the same for all ranks within devWorld
+    consolidationStatus = ConsolidationStatus::None;
+
+    const int nLocalNz = nLocalRows + 2 * nInternalFaces;
+    const int nTotalNz = nLocalNz + nExtNz;
+
+    // Count the non-zeros per row: diagonal, upper (row lowerAddr), lower (row upperAddr), (external)
+    rowOffsets = new int[nLocalRows + 1]();
+
+    for (int i = 0; i < nLocalRows; ++i)
+    {
+        rowOffsets[i + 1] = 1;
+    }
+
+    for (int i = 0; i < nInternalFaces; ++i)
+    {
+        ++rowOffsets[lowerAddr[i] + 1];
+        ++rowOffsets[upperAddr[i] + 1];
+    }
+
+    for (int i = 0; i < nExtNz; ++i)
+    {
+        ++rowOffsets[extRow[i] + 1];
+    }
+
+    std::partial_sum(rowOffsets, rowOffsets + nLocalRows + 1, rowOffsets);
+
+    ldu2csrPerm = new int[nTotalNz];
+    colIndicesGlobal = new int[nTotalNz];
+    values = new double[nTotalNz];
+
+    // The counting reads the rows of the off-diagonals and increments the offsets, which are
+    // scanned and copied to the positions; the insertion reads the values, both addresses of
+    // the off-diagonals and the positions, and writes the positions and the CSR arrays
+    const double nOffDiag = 2.0 * nInternalFaces + nExtNz;
+    AMGX_PROFILE_TRAFFIC(Host, 16.0 * nOffDiag + 12.0 * nLocalRows + 4.0 + 12.0 * nTotalNz,
+                         4.0 * nOffDiag + 12.0 * nLocalRows + 4.0 + 20.0 * nTotalNz, 0.0);
+
+    // Stable counting sort on the rows, giving the same ordering as the device radix sort
+    std::vector<int> rowPos(rowOffsets, rowOffsets + nLocalRows);
+
+    auto insert = [&](const int row, const int ldu, const int col, const double val)
+    {
+        const int i = rowPos[row]++;
+        ldu2csrPerm[i] = ldu;
+        colIndicesGlobal[i] = col;
+        values[i] = val;
+    };
+
+    for (int i = 0; i < nLocalRows; ++i)
+    {
+        insert(i, i, i + diagIndexGlobal, diagVals[i]);
+    }
+
+    for (int i = 0; i < nInternalFaces; ++i)
+    {
+        insert(lowerAddr[i], nLocalRows + i, upperAddr[i] + uppOffGlobal, upperVals[i]);
+    }
+
+    for (int i = 0; i < nInternalFaces; ++i)
+    {
+        insert(upperAddr[i], nLocalRows + nInternalFaces + i, lowerAddr[i] + lowOffGlobal, lowerVals[i]);
+    }
+
+    for (int i = 0; i < nExtNz; ++i)
+    {
+        insert(extRow[i], nLocalNz + i, extCol[i], extVals[i]);
     }
 }
 
@@ -566,9 +934,36 @@ void AmgXCSRMatrix::updateValues
     const float *extVals
 )
 {
+    // Only the coefficients kept by the conversion are updated
+    if (lduFiltered && !filteringLDU)
+    {
+        updateValuesFiltered(nLocalRows, nInternalFaces, nExtNz, diagVals, upperVals, lowerVals, extVals);
+        return;
+    }
+
+    AMGX_PROFILE_SCOPE("updateValues");
+
+    AmgXRecorder::recordUpdateValues(this, nLocalRows, nInternalFaces, nExtNz,
+        diagVals, upperVals, lowerVals, extVals);
+
+    AMGX_PROFILE_BEGIN(rowSumsScope, "updateValues:rowSums");
+    sumLDURows(nLocalRows, nInternalFaces, nExtNz, sumARows.data(),
+               diagVals, upperVals, lowerVals, extVals, sumA);
+    AMGX_PROFILE_END(rowSumsScope);
+
+    if (isOnHost())
+    {
+        AMGX_PROFILE_SCOPE("updateValues:host");
+        gatherLDUValuesHost(nLocalRows + 2 * nInternalFaces + nExtNz, nLocalRows, nInternalFaces,
+                            ldu2csrPerm, diagVals, upperVals, lowerVals, extVals, values);
+        return;
+    }
+
 // Add external non-zeros (communicated halo entries)
     int nTotalNz;
 
+    AMGX_PROFILE_BEGIN(copyScope, "updateValues:copy");
+
     if (isConsolidated())
     {
         nTotalNz = (nConsNz + nConsExtNz);
@@ -589,9 +984,14 @@ void AmgXCSRMatrix::updateValues
         // convert all float arrays into double arrays
         floatToDoubleArray<<<nblocks, nthreads>>>(nTotalNz, fvaluesTmp, valuesTmp);
 
+        // Each rank copies its values from the host and converts all of them
+        const double transferred = sizeof(float) * (nLocalRows + 2.0 * nInternalFaces + nExtNz);
+        AMGX_PROFILE_TRAFFIC(Transfer, transferred, transferred, 0.0);
+        AMGX_PROFILE_TRAFFIC(Device, 4.0 * nTotalNz, 8.0 * nTotalNz, 0.0);
+
         // Ensure that all ranks associated with a device have completed prior to the subsequent permutation
         CHECK(cudaDeviceSynchronize());
-        MPI_Barrier(devWorld);
+        AmgXProfiler::barrier(devWorld, "updateValues:barrier devWorld");
     }
     else
     {
@@ -611,14 +1011,24 @@ void AmgXCSRMatrix::updateValues
         }
 
         floatToDoubleArray<<<nblocks, nthreads>>>(nTotalNz, fvaluesTmp, valuesTmp);
+
+        AMGX_PROFILE_TRAFFIC(Transfer, 4.0 * nTotalNz, 4.0 * nTotalNz, 0.0);
+        AMGX_PROFILE_TRAFFIC(Device, 4.0 * nTotalNz, 8.0 * nTotalNz, 0.0);
     }
 
+    AMGX_PROFILE_END(copyScope);
+
     if (gpuProc == 0)
     {
+        AMGX_PROFILE_SCOPE("updateValues:permutation");
+
         constexpr int nthreads = 128;
         int nblocks = nTotalNz / nthreads + 1;
         applyPermutation<<<nblocks, nthreads>>>(nTotalNz, ldu2csrPerm, nullptr, valuesTmp, nullptr, values, true);
 
+        // Reads the permutation and gathers the values
+        AMGX_PROFILE_TRAFFIC(Device, 12.0 * nTotalNz, 8.0 * nTotalNz, 0.0);
+
         // Sync to ensure API errors are caught within the API code and avoid any 
         // issues if users are subsequently using non-blocking streams.
         CHECK(cudaDeviceSynchronize());
@@ -639,9 +1049,36 @@ void AmgXCSRMatrix::updateValues
     const double *extVals
 )
 {
+    // Only the coefficients kept by the conversion are updated
+    if (lduFiltered && !filteringLDU)
+    {
+        updateValuesFiltered(nLocalRows, nInternalFaces, nExtNz, diagVals, upperVals, lowerVals, extVals);
+        return;
+    }
+
+    AMGX_PROFILE_SCOPE("updateValues");
+
+    AmgXRecorder::recordUpdateValues(this, nLocalRows, nInternalFaces, nExtNz,
+        diagVals, upperVals, lowerVals, extVals);
+
+    AMGX_PROFILE_BEGIN(rowSumsScope, "updateValues:rowSums");
+    sumLDURows(nLocalRows, nInternalFaces, nExtNz, sumARows.data(),
+               diagVals, upperVals, lowerVals, extVals, sumA);
+    AMGX_PROFILE_END(rowSumsScope);
+
+    if (isOnHost())
+    {
+        AMGX_PROFILE_SCOPE("updateValues:host");
+        gatherLDUValuesHost(nLocalRows + 2 * nInternalFaces + nExtNz, nLocalRows, nInternalFaces,
+                            ldu2csrPerm, diagVals, upperVals, lowerVals, extVals, values);
+        return;
+    }
+
     // Add external non-zeros (communicated halo entries)
     int nTotalNz;
 
+    AMGX_PROFILE_BEGIN(copyScope, "updateValues:copy");
+
     if (isConsolidated())
     {
         nTotalNz = (nConsNz + nConsExtNz);
@@ -656,9 +1093,12 @@ void AmgXCSRMatrix::updateValues
             CHECK(cudaMemcpy(valuesTmp + nConsNz + extNzDispls[myDevWorldRank], extVals, nExtNz * sizeof(double), cudaMemcpyDefault));
         }
 
+        const double transferred = sizeof(double) * (nLocalRows + 2.0 * nInternalFaces + nExtNz);
+        AMGX_PROFILE_TRAFFIC(Transfer, transferred, transferred, 0.0);
+
         // Ensure that all ranks associated with a device have completed prior to the subsequent permutation
         CHECK(cudaDeviceSynchronize());
-        MPI_Barrier(devWorld);
+        AmgXProfiler::barrier(devWorld, "updateValues:barrier devWorld");
     }
     else
     {
@@ -673,28 +1113,178 @@ void AmgXCSRMatrix::updateValues
         {
             CHECK(cudaMemcpy(valuesTmp + nLocalNz, extVals, sizeof(double) * nExtNz, cudaMemcpyDefault));
         }
+
+        AMGX_PROFILE_TRAFFIC(Transfer, 8.0 * nTotalNz, 8.0 * nTotalNz, 0.0);
     }
 
+    AMGX_PROFILE_END(copyScope);
+
     if (gpuProc == 0)
     {
+        AMGX_PROFILE_SCOPE("updateValues:permutation");
+
         constexpr int nthreads = 128;
         int nblocks = nTotalNz / nthreads + 1;
         applyPermutation<<<nblocks, nthreads>>>(nTotalNz, ldu2csrPerm, nullptr, valuesTmp, nullptr, values, true);
 
+        // Reads the permutation and gathers the values
+        AMGX_PROFILE_TRAFFIC(Device, 12.0 * nTotalNz, 8.0 * nTotalNz, 0.0);
+
         // Sync to ensure API errors are caught within the API code and avoid any 
         // issues if users are subsequently using non-blocking streams.
         CHECK(cudaDeviceSynchronize());
     }
 }
 
+// Create views of this rank's slice of the (consolidated) solution and RHS vectors
+void AmgXCSRMatrix::createVectorViews
+(
+    const int nLocalRows,
+    ViewLocation viewLocation
+)
+{
+    if (consolidationStatus == ConsolidationStatus::Uninitialised)
+    {
+        fprintf(stderr, "The matrix structure must be set before creating vector views.\n");
+        return;
+    }
+
+    if (viewLocation == ViewLocation::Device && isOnHost())
+    {
+        fprintf(stderr, "Device vector views are not supported for host matrices.\n");
+        return;
+    }
+
+    destroyVectorViews();
+
+    this->viewLocation = viewLocation;
+
+    const int nRows = isConsolidated() ? nConsRows : nLocalRows;
+    const int offset = isConsolidated() ? rowDispls[myDevWorldRank] : 0;
+
+    if (viewLocation == ViewLocation::Host)
+    {
+        // The root rank allocates the consolidated vectors in memory shared by all ranks
+        // of the device, and uploads them directly to AmgX
+        MPI_Aint size = (gpuProc == 0) ? 2 * nRows * sizeof(double) : 0;
+        double *base;
+        MPI_Win_allocate_shared(size, sizeof(double), MPI_INFO_NULL, devWorld, &base, &viewWin);
+
+        int dispUnit;
+        MPI_Win_shared_query(viewWin, 0, &size, &dispUnit, &base);
+
+        // A passive epoch is kept open, with MPI_Win_sync ordering the accesses
+        MPI_Win_lock_all(MPI_MODE_NOCHECK, viewWin);
+
+        solViewCons = base;
+        rhsViewCons = base + nRows;
+    }
+    else if (isConsolidated())
+    {
+        // The views are slices of the IPC buffers already used for consolidation
+        solViewCons = pCons;
+        rhsViewCons = rhsCons;
+    }
+    else
+    {
+        CHECK(cudaMalloc((void **)&solViewCons, sizeof(double) * nRows));
+        CHECK(cudaMalloc((void **)&rhsViewCons, sizeof(double) * nRows));
+    }
+
+    solView = solViewCons + offset;
+    rhsView = rhsViewCons + offset;
+    viewsCreated = true;
+}
+
+// Release the vector views
+void AmgXCSRMatrix::destroyVectorViews()
+{
+    if (!viewsCreated)
+    {
+        return;
+    }
+
+    if (viewLocation == ViewLocation::Host)
+    {
+        MPI_Win_unlock_all(viewWin);
+        MPI_Win_free(&viewWin);
+    }
+    else if (!isConsolidated())
+    {
+        CHECK(cudaFree(solViewCons));
+        CHECK(cudaFree(rhsViewCons));
+    }
+
+    solViewCons = nullptr;
+    rhsViewCons = nullptr;
+    solView = nullptr;
+    rhsView = nullptr;
+    viewsCreated = false;
+}
+
+// Make the writes of all ranks to host views visible
+void AmgXCSRMatrix::syncVectorViews()
+{
+    if (isViewOnHost())
+    {
+        MPI_Win_sync(viewWin);
+    }
+}
+
 // Deallocate remaining storage
 void AmgXCSRMatrix::finalise()
 {
+    AmgXRecorder::recordFinaliseMatrix(this);
+
+    release();
+
+    if (devWorld != nullptr && devWorld != MPI_COMM_NULL)
+    {
+        MPI_Comm_free(&devWorld);
+    }
+}
+
+// Deallocate the structure, values and views, without recording it
+void AmgXCSRMatrix::release()
+{
+    // The views depend on the consolidated buffers and layout
+    destroyVectorViews();
+
     switch (consolidationStatus)
     {
 
     case ConsolidationStatus::None:
     {
+        if (isOnHost())
+        {
+            if (snapshotMap != nullptr)
+            {
+                // The arrays are in the mapping of a loaded snapshot, but for
+                // the values of a cached structure
+                if (!snapshotValues)
+                {
+                    delete[] values;
+                }
+
+                munmap(snapshotMap, snapshotBytes);
+                snapshotMap = nullptr;
+                snapshotBytes = 0;
+            }
+            else
+            {
+                delete[] ldu2csrPerm;
+                delete[] rowOffsets;
+                delete[] colIndicesGlobal;
+                delete[] values;
+            }
+
+            ldu2csrPerm = nullptr;
+            rowOffsets = nullptr;
+            colIndicesGlobal = nullptr;
+            values = nullptr;
+            break;
+        }
+
         CHECK(cudaFree(ldu2csrPerm));
         CHECK(cudaFree(rowOffsets));
         CHECK(cudaFree(colIndicesGlobal));
@@ -0,0 +1,364 @@
+/*
+ * Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+// Coarse levels of an LDU matrix agglomerated by OpenFOAM's GAMG.
+//
+// With piecewise constant prolongation the Galerkin product only sums fine
+// coefficients: the diagonal of a fine cell into that of its coarse cell, a
+// fine face into its coarse face, or into the diagonal of the coarse cell
+// holding both its cells, and likewise for the external coefficients. The
+// coarse coefficient receiving each fine one is fixed by the agglomeration,
+// so the fine coefficients are ordered by coarse coefficient once, and the
+// values of each update are gathered and summed in that order, the coarse
+// LDU values then going through the permutation of the coarse structure.
+
+#include <AmgXCSRMatrix.H>
+#include <AmgXProfiler.H>
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+namespace
+{
+
+// Sum the fine LDU values into the coarse LDU values, in [ diagonal, upper,
+// lower, (external) ] order for both
+template<class T>
+void restrictLDUValues
+(
+    const std::vector<int> &offsets,
+    const std::vector<int> &indices,
+    const int nFineRows,
+    const int nFineInternalFaces,
+    const T *diagVals,
+    const T *upperVals,
+    const T *lowerVals,
+    const T *extVals,
+    std::vector<double> &coarseVals
+)
+{
+    const int nFineLduNz = nFineRows + 2 * nFineInternalFaces;
+
+    auto fine = [&](const int j) -> double
+    {
+        if (j < nFineRows) return diagVals[j];
+        if (j < nFineRows + nFineInternalFaces) return upperVals[j - nFineRows];
+        if (j < nFineLduNz) return lowerVals[j - nFineRows - nFineInternalFaces];
+        return extVals[j - nFineLduNz];
+    };
+
+    coarseVals.resize(offsets.size() - 1);
+
+    for (size_t c = 0; c < coarseVals.size(); ++c)
+    {
+        double sum = 0.0;
+
+        for (int i = offsets[c]; i < offsets[c + 1]; ++i)
+        {
+            sum += fine(indices[i]);
+        }
+
+        coarseVals[c] = sum;
+    }
+
+    // The indices and fine values are read, the coarse values written
+    AMGX_PROFILE_TRAFFIC(Host, (4.0 + sizeof(T)) * indices.size() + 4.0 * offsets.size(),
+                         8.0 * coarseVals.size(), (double)indices.size());
+}
+
+}
+
+// Set the coarse level of an agglomerated LDU matrix
+template<class T>
+void AmgXCSRMatrix::setAgglomeratedLDUImpl
+(
+    int nCoarseRows,
+    int nCoarseInternalFaces,
+    int diagIndexGlobal,
+    int lowOffGlobal,
+    int uppOffGlobal,
+    const int *upperAddr,
+    const int *lowerAddr,
+    const int nCoarseExtNz,
+    const int *extRow,
+    const int *extCol,
+    int nFineRows,
+    int nFineInternalFaces,
+    int nFineExtNz,
+    const int *restrictAddr,
+    const int *faceRestrictAddr,
+    const bool *faceFlipMap,
+    const int *extRestrictAddr,
+    const T *diagVals,
+    const T *upperVals,
+    const T *lowerVals,
+    const T *extVals
+)
+{
+    AMGX_PROFILE_SCOPE("setAgglomeratedLDU");
+
+    AMGX_PROFILE_BEGIN(restrictionScope, "setAgglomeratedLDU:restriction");
+
+    const int nFineLduNz = nFineRows + 2 * nFineInternalFaces;
+    const int nFineNz = nFineLduNz + nFineExtNz;
+    const int nCoarseLduNz = nCoarseRows + 2 * nCoarseInternalFaces;
+    const int nCoarseNz = nCoarseLduNz + nCoarseExtNz;
+
+    // The coarse coefficient of each fine one, faces inside a coarse cell
+    // (negative, as -1 - coarse cell) going to its diagonal
+    std::vector<int> target(nFineNz);
+
+    auto inside = [](const int i, const int n) { return i >= 0 && i < n; };
+
+    for (int i = 0; i < nFineRows; ++i)
+    {
+        target[i] = inside(restrictAddr[i], nCoarseRows) ? restrictAddr[i] : -1;
+    }
+
+    for (int i = 0; i < nFineInternalFaces; ++i)
+    {
+        const int cf = faceRestrictAddr[i];
+        const bool flip = faceFlipMap != nullptr && faceFlipMap[i];
+
+        if (cf >= 0)
+        {
+            const int upper = nCoarseRows + (flip ? nCoarseInternalFaces : 0) + cf;
+            const int lower = nCoarseRows + (flip ? 0 : nCoarseInternalFaces) + cf;
+
+            target[nFineRows + i] = inside(cf, nCoarseInternalFaces) ? upper : -1;
+            target[nFineRows + nFineInternalFaces + i] = inside(cf, nCoarseInternalFaces) ? lower : -1;
+        }
+        else
+        {
+            target[nFineRows + i] = inside(-1 - cf, nCoarseRows) ? -1 - cf : -1;
+            target[nFineRows + nFineInternalFaces + i] = target[nFineRows + i];
+        }
+    }
+
+    for (int i = 0; i < nFineExtNz; ++i)
+    {
+        const int ce = extRestrictAddr[i];
+
+        if (ce >= 0)
+        {
+            target[nFineLduNz + i] = inside(ce, nCoarseExtNz) ? nCoarseLduNz + ce : -1;
+        }
+        else
+        {
+            target[nFineLduNz + i] = inside(-1 - ce, nCoarseRows) ? -1 - ce : -1;
+        }
+    }
+
+    if (std::find(target.begin(), target.end(), -1) != target.end())
+    {
+        fprintf(stderr, "The agglomeration addresses coefficients outside the coarse matrix.\n");
+        return;
+    }
+
+    // Order the fine coefficients by coarse coefficient, a counting sort
+    restrictOffsets.assign(nCoarseNz + 1, 0);
+
+    for (int j = 0; j < nFineNz; ++j)
+    {
+        ++restrictOffsets[target[j] + 1];
+    }
+
+    std::partial_sum(restrictOffsets.begin(), restrictOffsets.end(), restrictOffsets.begin());
+
+    restrictIndices.resize(nFineNz);
+    std::vector<int> fill(restrictOffsets.begin(), restrictOffsets.end() - 1);
+
+    for (int j = 0; j < nFineNz; ++j)
+    {
+        restrictIndices[fill[target[j]]++] = j;
+    }
+
+    nAgglomeratedRows = nFineRows;
+    nAgglomeratedInternalFaces = nFineInternalFaces;
+    nAgglomeratedExtNz = nFineExtNz;
+
+    restrictLDUValues(restrictOffsets, restrictIndices, nFineRows, nFineInternalFaces,
+                      diagVals, upperVals, lowerVals, extVals, restrictedValues);
+
+    AMGX_PROFILE_END(restrictionScope);
+
+    setValuesLDU
+    (
+        nCoarseRows,
+        nCoarseInternalFaces,
+        diagIndexGlobal,
+        lowOffGlobal,
+        uppOffGlobal,
+        upperAddr,
+        lowerAddr,
+        nCoarseExtNz,
+        extRow,
+        extCol,
+        restrictedValues.data(),
+        restrictedValues.data() + nCoarseRows,
+        restrictedValues.data() + nCoarseRows + nCoarseInternalFaces,
+        restrictedValues.data() + nCoarseLduNz
+    );
+}
+
+// Update the coarse level values from the fine values of its agglomeration
+template<class T>
+void AmgXCSRMatrix::updateAgglomeratedValuesImpl
+(
+    const int nFineRows,
+    const int nFineInternalFaces,
+    const int nFineExtNz,
+    const T *diagVals,
+    const T *upperVals,
+    const T *lowerVals,
+    const T *extVals
+)
+{
+    AMGX_PROFILE_SCOPE("updateAgglomeratedValues");
+
+    if (restrictOffsets.empty()
+     || nFineRows != nAgglomeratedRows
+     || nFineInternalFaces != nAgglomeratedInternalFaces
+     || nFineExtNz != nAgglomeratedExtNz)
+    {
+        fprintf(stderr, "The values do not match the agglomeration of the matrix.\n");
+        return;
+    }
+
+    AMGX_PROFILE_BEGIN(restrictionScope, "updateAgglomeratedValues:restriction");
+    restrictLDUValues(restrictOffsets, restrictIndices, nFineRows, nFineInternalFaces,
+                      diagVals, upperVals, lowerVals, extVals, restrictedValues);
+    AMGX_PROFILE_END(restrictionScope);
+
+    // The sizes given to setValuesLDU, before any coefficients were dropped
+    const int nCoarseLduNz = nLduRows + 2 * nInputInternalFaces;
+
+    updateValues
+    (
+        nLduRows,
+        nInputInternalFaces,
+        nInputExtNz,
+        restrictedValues.data(),
+        restrictedValues.data() + nLduRows,
+        restrictedValues.data() + nLduRows + nInputInternalFaces,
+        restrictedValues.data() + nCoarseLduNz
+    );
+}
+
+// Set the coarse level of an agglomerated LDU matrix
+void AmgXCSRMatrix::setAgglomeratedLDU
+(
+    int nrows,
+    int nInternalFaces,
+    int diagIndexGlobal,
+    int lowOffGlobal,
+    int uppOffGlobal,
+    const int *upperAddr,
+    const int *lowerAddr,
+    const int extNnz,
+    const int *extRow,
+    const int *extCol,
+    int nFineRows,
+    int nFineInternalFaces,
+    int nFineExtNz,
+    const int *restrictAddr,
+    const int *faceRestrictAddr,
+    const bool *faceFlipMap,
+    const int *extRestrictAddr,
+    const float *diagVals,
+    const float *upperVals,
+    const float *lowerVals,
+    const float *extVals
+)
+{
+    setAgglomeratedLDUImpl(nrows, nInternalFaces, diagIndexGlobal, lowOffGlobal, uppOffGlobal,
+                           upperAddr, lowerAddr, extNnz, extRow, extCol,
+                           nFineRows, nFineInternalFaces, nFineExtNz,
+                           restrictAddr, faceRestrictAddr, faceFlipMap, extRestrictAddr,
+                           diagVals, upperVals, lowerVals, extVals);
+}
+
+// Set the coarse level of an agglomerated LDU matrix
+void AmgXCSRMatrix::setAgglomeratedLDU
+(
+    int nrows,
+    int nInternalFaces,
+    int diagIndexGlobal,
+    int lowOffGlobal,
+    int uppOffGlobal,
+    const int *upperAddr,
+    const int *lowerAddr,
+    const int extNnz,
+    const int *extRow,
+    const int *extCol,
+    int nFineRows,
+    int nFineInternalFaces,
+    int nFineExtNz,
+    const int *restrictAddr,
+    const int *faceRestrictAddr,
+    const bool *faceFlipMap,
+    const int *extRestrictAddr,
+    const double *diagVals,
+    const double *upperVals,
+    const double *lowerVals,
+    const double *extVals
+)
+{
+    setAgglomeratedLDUImpl(nrows, nInternalFaces, diagIndexGlobal, lowOffGlobal, uppOffGlobal,
+                           upperAddr, lowerAddr, extNnz, extRow, extCol,
+                           nFineRows, nFineInternalFaces, nFineExtNz,
+                           restrictAddr, faceRestrictAddr, faceFlipMap, extRestrictAddr,
+                           diagVals, upperVals, lowerVals, extVals);
+}
+
+// Update the coarse level values from the fine values of its agglomeration
+void AmgXCSRMatrix::updateAgglomeratedValues
+(
+    const int nFineRows,
+    const int nFineInternalFaces,
+    const int nFineExtNz,
+    const float *diagVals,
+    const float *upperVals,
+    const float *lowerVals,
+    const float *extVals
+)
+{
+    updateAgglomeratedValuesImpl(nFineRows, nFineInternalFaces, nFineExtNz,
+                                 diagVals, upperVals, lowerVals, extVals);
+}
+
+// Update the coarse level values from the fine values of its agglomeration
+void AmgXCSRMatrix::updateAgglomeratedValues
+(
+    const int nFineRows,
+    const int nFineInternalFaces,
+    const int nFineExtNz,
+    const double *diagVals,
+    const double *upperVals,
+    const double *lowerVals,
+    const double *extVals
+)
+{
+    updateAgglomeratedValuesImpl(nFineRows, nFineInternalFaces, nFineExtNz,
+                                 diagVals, upperVals, lowerVals, extVals);
+}
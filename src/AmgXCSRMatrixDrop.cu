@@ -0,0 +1,387 @@
+/*
+ * Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+// Dropping of negligible off-diagonal coefficients at conversion.
+//
+// An internal face is dropped when both of its coefficients are below the
+// tolerance times the geometric mean of the magnitudes of the diagonals of
+// its two rows, which keeps the structure symmetric. The external
+// coefficients are dropped by pairs of rows on two ranks, with the same
+// test on the summed magnitudes of the coefficients of each direction, so
+// both ranks drop or keep the pair; the diagonal and coefficients of the
+// other rank are exchanged for it. The kept faces and external coefficients are
+// compacted into the addressing given to setValuesLDU, so every layout
+// converts the smaller matrix, and updateValues gathers the kept values
+// before the permutation of the compacted structure.
+
+#include <AmgXCSRMatrix.H>
+#include <AmgXProfiler.H>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <numeric>
+#include <vector>
+
+namespace
+{
+
+// Keep the external coefficients of the pairs of rows coupling two ranks
+// where either direction is not negligible. Collective over comm
+template<class T>
+void keepExternalPairs
+(
+    double tolerance,
+    MPI_Comm comm,
+    int nLocalRows,
+    int rowBegin,
+    int nExtNz,
+    const int *extRow,
+    const int *extCol,
+    const T *diagVals,
+    const T *extVals,
+    std::vector<int> &kept
+)
+{
+    // The summed magnitude of the coefficients of each pair, in order of row and column
+    std::vector<int> order(nExtNz);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](int a, int b)
+    {
+        return extRow[a] < extRow[b] || (extRow[a] == extRow[b] && extCol[a] < extCol[b]);
+    });
+
+    std::vector<int> pairOf(nExtNz);
+    std::vector<int> pairRow;
+    std::vector<int> pairCol;
+    std::vector<double> pairMag;
+
+    for (const int k : order)
+    {
+        if (pairRow.empty() || pairRow.back() != extRow[k] || pairCol.back() != extCol[k])
+        {
+            pairRow.push_back(extRow[k]);
+            pairCol.push_back(extCol[k]);
+            pairMag.push_back(0.0);
+        }
+
+        pairMag.back() += std::fabs((double)extVals[k]);
+        pairOf[k] = pairRow.size() - 1;
+    }
+
+    const int nPairs = pairRow.size();
+
+    int nRanks;
+    MPI_Comm_size(comm, &nRanks);
+
+    // The rows of each rank, to find the owners of the external columns
+    std::vector<int> rowBegins(nRanks);
+    std::vector<int> rowCounts(nRanks);
+    MPI_Allgather(&rowBegin, 1, MPI_INT, rowBegins.data(), 1, MPI_INT, comm);
+    MPI_Allgather(&nLocalRows, 1, MPI_INT, rowCounts.data(), 1, MPI_INT, comm);
+
+    std::vector<int> ranksByRow(nRanks);
+    std::iota(ranksByRow.begin(), ranksByRow.end(), 0);
+    std::sort(ranksByRow.begin(), ranksByRow.end(),
+              [&](int a, int b) { return rowBegins[a] < rowBegins[b]; });
+
+    std::vector<int> pairOwner(nPairs);
+    std::vector<int> sendCounts(nRanks, 0);
+
+    for (int p = 0; p < nPairs; ++p)
+    {
+        auto r = std::upper_bound(ranksByRow.begin(), ranksByRow.end(), pairCol[p],
+                                  [&](int c, int rank) { return c < rowBegins[rank]; });
+
+        // A column outside the rows of all ranks has no other direction, its pair is kept
+        pairOwner[p] = -1;
+        if (r != ranksByRow.begin() && pairCol[p] < rowBegins[*(r - 1)] + rowCounts[*(r - 1)])
+        {
+            pairOwner[p] = *(r - 1);
+            ++sendCounts[pairOwner[p]];
+        }
+    }
+
+    std::vector<int> sendDispls(nRanks + 1, 0);
+    std::partial_sum(sendCounts.begin(), sendCounts.end(), sendDispls.begin() + 1);
+
+    // Ask the owner of each column for its diagonal and the opposite direction of the pair
+    std::vector<int> requestOf(nPairs, -1);
+    std::vector<int> requests(2 * sendDispls[nRanks]);
+    std::vector<int> fill(sendDispls.begin(), sendDispls.end() - 1);
+
+    for (int p = 0; p < nPairs; ++p)
+    {
+        if (pairOwner[p] < 0) continue;
+
+        requestOf[p] = fill[pairOwner[p]]++;
+        requests[2 * requestOf[p]] = pairCol[p] - rowBegins[pairOwner[p]];
+        requests[2 * requestOf[p] + 1] = rowBegin + pairRow[p];
+    }
+
+    std::vector<int> recvCounts(nRanks);
+    MPI_Alltoall(sendCounts.data(), 1, MPI_INT, recvCounts.data(), 1, MPI_INT, comm);
+
+    std::vector<int> recvDispls(nRanks + 1, 0);
+    std::partial_sum(recvCounts.begin(), recvCounts.end(), recvDispls.begin() + 1);
+
+    std::vector<int> sendInts(nRanks), sendIntDispls(nRanks), recvInts(nRanks), recvIntDispls(nRanks);
+    for (int r = 0; r < nRanks; ++r)
+    {
+        sendInts[r] = 2 * sendCounts[r];
+        sendIntDispls[r] = 2 * sendDispls[r];
+        recvInts[r] = 2 * recvCounts[r];
+        recvIntDispls[r] = 2 * recvDispls[r];
+    }
+
+    std::vector<int> requested(2 * recvDispls[nRanks]);
+    MPI_Alltoallv(requests.data(), sendInts.data(), sendIntDispls.data(), MPI_INT,
+                  requested.data(), recvInts.data(), recvIntDispls.data(), MPI_INT, comm);
+
+    std::vector<double> replies(requested.size());
+
+    for (int q = 0; q < recvDispls[nRanks]; ++q)
+    {
+        const int row = requested[2 * q];
+        const int col = requested[2 * q + 1];
+
+        auto p = std::lower_bound(pairRow.begin(), pairRow.end(), row) - pairRow.begin();
+        while (p < nPairs && pairRow[p] == row && pairCol[p] < col) ++p;
+
+        replies[2 * q] = std::fabs((double)diagVals[row]);
+        replies[2 * q + 1] = p < nPairs && pairRow[p] == row && pairCol[p] == col ? pairMag[p] : 0.0;
+    }
+
+    std::vector<double> answers(requests.size());
+    MPI_Alltoallv(replies.data(), recvInts.data(), recvIntDispls.data(), MPI_DOUBLE,
+                  answers.data(), sendInts.data(), sendIntDispls.data(), MPI_DOUBLE, comm);
+
+    std::vector<char> keep(nPairs, 1);
+
+    for (int p = 0; p < nPairs; ++p)
+    {
+        if (requestOf[p] < 0) continue;
+
+        const double scale = tolerance * std::sqrt(std::fabs((double)diagVals[pairRow[p]])
+                                                   * answers[2 * requestOf[p]]);
+
+        keep[p] = pairMag[p] >= scale || answers[2 * requestOf[p] + 1] >= scale;
+    }
+
+    for (int k = 0; k < nExtNz; ++k)
+    {
+        if (keep[pairOf[k]]) kept.push_back(k);
+    }
+}
+
+}
+
+// Convert the LDU matrix without its negligible coefficients
+template<class T>
+void AmgXCSRMatrix::setValuesLDUFiltered
+(
+    int nLocalRows,
+    int nInternalFaces,
+    int diagIndexGlobal,
+    int lowOffGlobal,
+    int uppOffGlobal,
+    const int *upperAddr,
+    const int *lowerAddr,
+    const int nExtNz,
+    const int *extRow,
+    const int *extCol,
+    const T *diagVals,
+    const T *upperVals,
+    const T *lowerVals,
+    const T *extVals
+)
+{
+    AMGX_PROFILE_SCOPE("setValuesLDU:drop");
+
+    AMGX_PROFILE_BEGIN(filterScope, "setValuesLDU:drop:filter");
+
+    keptFaces.clear();
+    keptExtNz.clear();
+
+    for (int i = 0; i < nInternalFaces; ++i)
+    {
+        const double scale = dropTolerance * std::sqrt(std::fabs((double)diagVals[lowerAddr[i]]
+                                                               * (double)diagVals[upperAddr[i]]));
+
+        if (std::fabs((double)upperVals[i]) >= scale || std::fabs((double)lowerVals[i]) >= scale)
+        {
+            keptFaces.push_back(i);
+        }
+    }
+
+    if (dropComm != MPI_COMM_NULL)
+    {
+        keepExternalPairs(dropTolerance, dropComm, nLocalRows, diagIndexGlobal, nExtNz,
+                          extRow, extCol, diagVals, extVals, keptExtNz);
+    }
+    else
+    {
+        keptExtNz.resize(nExtNz);
+        std::iota(keptExtNz.begin(), keptExtNz.end(), 0);
+    }
+
+    const int nKeptFaces = keptFaces.size();
+    const int nKeptExtNz = keptExtNz.size();
+
+    std::vector<int> keptUpperAddr(nKeptFaces);
+    std::vector<int> keptLowerAddr(nKeptFaces);
+    std::vector<int> keptExtRow(nKeptExtNz);
+    std::vector<int> keptExtCol(nKeptExtNz);
+    std::vector<T> keptValues(2 * nKeptFaces + nKeptExtNz);
+
+    for (int i = 0; i < nKeptFaces; ++i)
+    {
+        keptUpperAddr[i] = upperAddr[keptFaces[i]];
+        keptLowerAddr[i] = lowerAddr[keptFaces[i]];
+        keptValues[i] = upperVals[keptFaces[i]];
+        keptValues[nKeptFaces + i] = lowerVals[keptFaces[i]];
+    }
+
+    for (int i = 0; i < nKeptExtNz; ++i)
+    {
+        keptExtRow[i] = extRow[keptExtNz[i]];
+        keptExtCol[i] = extCol[keptExtNz[i]];
+        keptValues[2 * nKeptFaces + i] = extVals[keptExtNz[i]];
+    }
+
+    // The diagonals, addresses and values are read, the kept ones written
+    AMGX_PROFILE_TRAFFIC(Host, (8.0 + 2.0 * sizeof(T)) * nInternalFaces + (4.0 + 2.0 * sizeof(T)) * nExtNz,
+                         (8.0 + 2.0 * sizeof(T)) * nKeptFaces + (8.0 + sizeof(T)) * nKeptExtNz,
+                         3.0 * nInternalFaces + 2.0 * nExtNz);
+
+    AMGX_PROFILE_END(filterScope);
+
+    nInputInternalFaces = nInternalFaces;
+    nInputExtNz = nExtNz;
+    lduFiltered = true;
+
+    // The kept coefficients are converted, and recorded, as the matrix
+    filteringLDU = true;
+
+    setValuesLDU
+    (
+        nLocalRows,
+        nKeptFaces,
+        diagIndexGlobal,
+        lowOffGlobal,
+        uppOffGlobal,
+        keptUpperAddr.data(),
+        keptLowerAddr.data(),
+        nKeptExtNz,
+        keptExtRow.data(),
+        keptExtCol.data(),
+        diagVals,
+        keptValues.data(),
+        keptValues.data() + nKeptFaces,
+        keptValues.data() + 2 * nKeptFaces
+    );
+
+    filteringLDU = false;
+}
+
+// Update the values of the coefficients kept by the conversion
+template<class T>
+void AmgXCSRMatrix::updateValuesFiltered
+(
+    const int nLocalRows,
+    const int nInternalFaces,
+    const int nExtNz,
+    const T *diagVals,
+    const T *upperVals,
+    const T *lowerVals,
+    const T *extVals
+)
+{
+    AMGX_PROFILE_SCOPE("updateValues:drop");
+
+    if (nLocalRows != nLduRows || nInternalFaces != nInputInternalFaces || nExtNz != nInputExtNz)
+    {
+        fprintf(stderr, "The values do not match the structure of the matrix.\n");
+        return;
+    }
+
+    const int nKeptFaces = keptFaces.size();
+    const int nKeptExtNz = keptExtNz.size();
+
+    AMGX_PROFILE_BEGIN(gatherScope, "updateValues:drop:gather");
+
+    std::vector<T> keptValues(2 * nKeptFaces + nKeptExtNz);
+
+    for (int i = 0; i < nKeptFaces; ++i)
+    {
+        keptValues[i] = upperVals[keptFaces[i]];
+        keptValues[nKeptFaces + i] = lowerVals[keptFaces[i]];
+    }
+
+    for (int i = 0; i < nKeptExtNz; ++i)
+    {
+        keptValues[2 * nKeptFaces + i] = extVals[keptExtNz[i]];
+    }
+
+    // The kept indices are read and their values gathered
+    AMGX_PROFILE_TRAFFIC(Host, (4.0 + sizeof(T)) * keptValues.size() + (double)sizeof(T) * nKeptFaces,
+                         (double)sizeof(T) * keptValues.size(), 0.0);
+
+    AMGX_PROFILE_END(gatherScope);
+
+    filteringLDU = true;
+
+    updateValues
+    (
+        nLocalRows,
+        nKeptFaces,
+        nKeptExtNz,
+        diagVals,
+        keptValues.data(),
+        keptValues.data() + nKeptFaces,
+        keptValues.data() + 2 * nKeptFaces
+    );
+
+    filteringLDU = false;
+}
+
+template void AmgXCSRMatrix::setValuesLDUFiltered<float>
+(
+    int, int, int, int, int, const int *, const int *, const int, const int *, const int *,
+    const float *, const float *, const float *, const float *
+);
+
+template void AmgXCSRMatrix::setValuesLDUFiltered<double>
+(
+    int, int, int, int, int, const int *, const int *, const int, const int *, const int *,
+    const double *, const double *, const double *, const double *
+);
+
+template void AmgXCSRMatrix::updateValuesFiltered<float>
+(
+    const int, const int, const int, const float *, const float *, const float *, const float *
+);
+
+template void AmgXCSRMatrix::updateValuesFiltered<double>
+(
+    const int, const int, const int, const double *, const double *, const double *, const double *
+);
@@ -0,0 +1,528 @@
+/*
+ * Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+// Patching of a converted structure after a local topology change.
+//
+// The LDU coefficients run over [ diagonal, upper, lower, (external) ], and
+// the maps of the cells, internal faces and external coefficients give the old
+// index of each new one, -1 (or out of range) for those added. A coefficient
+// is kept if it is the image of an old one and the old row of its row held
+// that old one; every other coefficient is added. Each new row is then the
+// kept coefficients of its old row, in their old order, and the added ones of
+// the row, sorted by LDU index as by the stable sort of a full conversion.
+// So the result is that of setValuesLDU on the device, without the radix sort
+// of all coefficients or new consolidation buffers.
+
+#include <AmgXCSRMatrix.H>
+#include <AmgXCudaCheck.H>
+#include <AmgXProfiler.H>
+#include <AmgXRecorder.H>
+
+#include <thrust/scan.h>
+#include <thrust/execution_policy.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+
+// The addressing of the new matrix and its relation to the old one, in device memory
+struct LduPatch
+{
+    int nRows;
+    int nInternalFaces;
+    int nExtNz;
+    int nOldRows;
+    int nOldInternalFaces;
+    int nOldExtNz;
+    int diagIndexGlobal;
+    int lowOffGlobal;
+    int uppOffGlobal;
+
+    const int *upperAddr;
+    const int *lowerAddr;
+    const int *extRow;
+    const int *extCol;
+
+    // New to old, -1 for added
+    const int *cellMap;
+    const int *faceMap;
+    const int *extMap;
+
+    // Old to new, -1 for removed
+    int *cellInverse;
+    int *faceInverse;
+    int *extInverse;
+
+    // The row of each old coefficient in the old matrix
+    int *oldRows;
+
+    __host__ __device__ int nNz() const
+    {
+        return nRows + 2 * nInternalFaces + nExtNz;
+    }
+
+    __host__ __device__ int nOldNz() const
+    {
+        return nOldRows + 2 * nOldInternalFaces + nOldExtNz;
+    }
+
+    // The local row of a new coefficient
+    __device__ int row(int n) const
+    {
+        if (n < nRows) return n;
+        n -= nRows;
+        if (n < nInternalFaces) return lowerAddr[n];
+        n -= nInternalFaces;
+        if (n < nInternalFaces) return upperAddr[n];
+        return extRow[n - nInternalFaces];
+    }
+
+    // The global column of a new coefficient
+    __device__ int column(int n) const
+    {
+        if (n < nRows) return n + diagIndexGlobal;
+        n -= nRows;
+        if (n < nInternalFaces) return upperAddr[n] + uppOffGlobal;
+        n -= nInternalFaces;
+        if (n < nInternalFaces) return lowerAddr[n] + lowOffGlobal;
+        return extCol[n - nInternalFaces];
+    }
+
+    // The old coefficient of a new one, -1 if added
+    __device__ int oldIndex(int n) const
+    {
+        if (n < nRows) return mapped(cellMap[n], nOldRows, 0);
+        n -= nRows;
+        if (n < nInternalFaces) return mapped(faceMap[n], nOldInternalFaces, nOldRows);
+        n -= nInternalFaces;
+        if (n < nInternalFaces) return mapped(faceMap[n], nOldInternalFaces, nOldRows + nOldInternalFaces);
+        return mapped(extMap[n - nInternalFaces], nOldExtNz, nOldRows + 2 * nOldInternalFaces);
+    }
+
+    // The new coefficient of an old one, -1 if removed
+    __device__ int newIndex(int o) const
+    {
+        if (o < nOldRows) return mapped(cellInverse[o], nRows, 0);
+        o -= nOldRows;
+        if (o < nOldInternalFaces) return mapped(faceInverse[o], nInternalFaces, nRows);
+        o -= nOldInternalFaces;
+        if (o < nOldInternalFaces) return mapped(faceInverse[o], nInternalFaces, nRows + nInternalFaces);
+        return mapped(extInverse[o - nOldInternalFaces], nExtNz, nRows + 2 * nInternalFaces);
+    }
+
+    // Whether a new coefficient is not kept from the old row of its row
+    __device__ bool isAdded(int n) const
+    {
+        const int o = oldIndex(n);
+        return o < 0 || newIndex(o) != n || oldRows[o] != cellMap[row(n)];
+    }
+
+    __device__ static int mapped(int i, int n, int offset)
+    {
+        return (i >= 0 && i < n) ? offset + i : -1;
+    }
+};
+
+// Fill a row of the patched permutation and columns, from the kept
+// coefficients of its old row and its added ones
+__device__ void patchRow(
+    const LduPatch &patch,
+    const int row,
+    const int *oldRowOffsets,
+    const int *oldPerm,
+    const int *rowOffsets,
+    const int *addedOffsets,
+    const int *added,
+    int *perm,
+    int *colIndices)
+{
+    int k = rowOffsets[row];
+    const int oldRow = patch.cellMap[row];
+
+    if (oldRow >= 0 && oldRow < patch.nOldRows)
+    {
+        for (int j = oldRowOffsets[oldRow]; j < oldRowOffsets[oldRow + 1]; ++j)
+        {
+            const int n = patch.newIndex(oldPerm[j]);
+
+            if (n >= 0 && patch.row(n) == row)
+            {
+                perm[k++] = n;
+            }
+        }
+    }
+
+    for (int j = addedOffsets[row]; j < addedOffsets[row + 1]; ++j)
+    {
+        perm[k++] = added[j];
+    }
+
+    // Mostly in order already, as renumbering keeps the order of kept coefficients
+    for (int i = rowOffsets[row] + 1; i < k; ++i)
+    {
+        const int n = perm[i];
+        int j = i;
+
+        for (; j > rowOffsets[row] && perm[j - 1] > n; --j)
+        {
+            perm[j] = perm[j - 1];
+        }
+
+        perm[j] = n;
+    }
+
+    for (int i = rowOffsets[row]; i < k; ++i)
+    {
+        colIndices[i] = patch.column(perm[i]);
+    }
+}
+
+}
+
+// Invert a map of new to old indices, leaving -1 for those removed
+__global__ void invertPatchMap(
+    const int n,
+    const int *map,
+    const int nOld,
+    int *inverse)
+{
+    for (int i = threadIdx.x + blockIdx.x * blockDim.x; i < n; i += blockDim.x * gridDim.x)
+    {
+        if (map[i] >= 0 && map[i] < nOld)
+        {
+            inverse[map[i]] = i;
+        }
+    }
+}
+
+// Store the row of each old coefficient
+__global__ void findPatchOldRows(
+    LduPatch patch,
+    const int *oldRowOffsets,
+    const int *oldPerm)
+{
+    for (int r = threadIdx.x + blockIdx.x * blockDim.x; r < patch.nOldRows; r += blockDim.x * gridDim.x)
+    {
+        for (int j = oldRowOffsets[r]; j < oldRowOffsets[r + 1]; ++j)
+        {
+            patch.oldRows[oldPerm[j]] = r;
+        }
+    }
+}
+
+// Count the coefficients and added coefficients of each new row
+__global__ void countPatchRows(
+    LduPatch patch,
+    int *rowOffsets,
+    int *addedOffsets)
+{
+    for (int n = threadIdx.x + blockIdx.x * blockDim.x; n < patch.nNz(); n += blockDim.x * gridDim.x)
+    {
+        const int row = patch.row(n);
+        atomicAdd(&rowOffsets[row], 1);
+
+        if (patch.isAdded(n))
+        {
+            atomicAdd(&addedOffsets[row], 1);
+        }
+    }
+}
+
+// Gather the added coefficients by row, in any order within a row
+__global__ void gatherPatchAdded(
+    LduPatch patch,
+    const int *addedOffsets,
+    int *addedFill,
+    int *added)
+{
+    for (int n = threadIdx.x + blockIdx.x * blockDim.x; n < patch.nNz(); n += blockDim.x * gridDim.x)
+    {
+        if (patch.isAdded(n))
+        {
+            const int row = patch.row(n);
+            added[addedOffsets[row] + atomicAdd(&addedFill[row], 1)] = n;
+        }
+    }
+}
+
+// Fill the rows of the patched permutation and columns
+__global__ void patchRows(
+    LduPatch patch,
+    const int *oldRowOffsets,
+    const int *oldPerm,
+    const int *rowOffsets,
+    const int *addedOffsets,
+    const int *added,
+    int *perm,
+    int *colIndices)
+{
+    for (int r = threadIdx.x + blockIdx.x * blockDim.x; r < patch.nRows; r += blockDim.x * gridDim.x)
+    {
+        patchRow(patch, r, oldRowOffsets, oldPerm, rowOffsets, addedOffsets, added, perm, colIndices);
+    }
+}
+
+// Patch the converted structure after a local topology change
+void AmgXCSRMatrix::patchValuesLDU
+(
+    int nLocalRows,
+    int nInternalFaces,
+    int diagIndexGlobal,
+    int lowOffGlobal,
+    int uppOffGlobal,
+    const int *upperAddr,
+    const int *lowerAddr,
+    const int nExtNz,
+    const int *extRow,
+    const int *extCol,
+    const int *cellMap,
+    const int *faceMap,
+    const int *extMap,
+    const float *diagVals,
+    const float *upperVals,
+    const float *lowerVals,
+    const float *extVals
+)
+{
+    // Make a copy of the host vectors, converting all floats to doubles
+    std::vector<double> ddiagVals(diagVals, diagVals + nLocalRows);
+    std::vector<double> dupperVals(upperVals, upperVals + nInternalFaces);
+    std::vector<double> dlowerVals(lowerVals, lowerVals + nInternalFaces);
+    std::vector<double> dextVals(extVals, extVals + nExtNz);
+
+    patchValuesLDU
+    (
+        nLocalRows,
+        nInternalFaces,
+        diagIndexGlobal,
+        lowOffGlobal,
+        uppOffGlobal,
+        upperAddr,
+        lowerAddr,
+        nExtNz,
+        extRow,
+        extCol,
+        cellMap,
+        faceMap,
+        extMap,
+        ddiagVals.data(),
+        dupperVals.data(),
+        dlowerVals.data(),
+        dextVals.data()
+    );
+}
+
+// Patch the converted structure after a local topology change
+void AmgXCSRMatrix::patchValuesLDU
+(
+    int nLocalRows,
+    int nInternalFaces,
+    int diagIndexGlobal,
+    int lowOffGlobal,
+    int uppOffGlobal,
+    const int *upperAddr,
+    const int *lowerAddr,
+    const int nExtNz,
+    const int *extRow,
+    const int *extCol,
+    const int *cellMap,
+    const int *faceMap,
+    const int *extMap,
+    const double *diagVals,
+    const double *upperVals,
+    const double *lowerVals,
+    const double *extVals
+)
+{
+    AMGX_PROFILE_SCOPE("patchValuesLDU");
+
+    // The rows of a consolidated device are those of several ranks, and a host
+    // conversion is a counting sort already linear in the non-zeros, so those are
+    // converted again, as is a matrix without a structure or dropping coefficients
+    if (consolidationStatus != ConsolidationStatus::None || isOnHost() || lduFiltered || dropTolerance > 0.0)
+    {
+        setValuesLDU(nLocalRows, nInternalFaces, diagIndexGlobal, lowOffGlobal, uppOffGlobal,
+                     upperAddr, lowerAddr, nExtNz, extRow, extCol,
+                     diagVals, upperVals, lowerVals, extVals);
+        return;
+    }
+
+    // The structure is that of a conversion, which replays it
+    AmgXRecorder::recordSetValuesLDU(this, nLocalRows, nInternalFaces, diagIndexGlobal,
+        lowOffGlobal, uppOffGlobal, upperAddr, lowerAddr, nExtNz, extRow, extCol,
+        diagVals, upperVals, lowerVals, extVals);
+
+    AmgXRecordPause pause;
+
+    LduPatch patch;
+    patch.nRows = nLocalRows;
+    patch.nInternalFaces = nInternalFaces;
+    patch.nExtNz = nExtNz;
+    patch.nOldRows = nLduRows;
+    patch.nOldInternalFaces = nLduInternalFaces;
+    patch.nOldExtNz = nLduExtNz;
+    patch.diagIndexGlobal = diagIndexGlobal;
+    patch.lowOffGlobal = lowOffGlobal;
+    patch.uppOffGlobal = uppOffGlobal;
+
+    const int nTotalNz = patch.nNz();
+    const int nOldTotalNz = patch.nOldNz();
+
+    int *newRowOffsets;
+    int *newColIndices;
+    int *newPerm;
+
+    AMGX_PROFILE_BEGIN(copyScope, "patchValuesLDU:copy");
+
+    // The addressing and maps of the new matrix, on the device
+    int *addressing;
+    const size_t nAddressing = 3 * (size_t)nInternalFaces + 3 * (size_t)nExtNz + nLocalRows;
+    CHECK(cudaMalloc(&addressing, sizeof(int) * nAddressing));
+
+    int *next = addressing;
+    auto upload = [&next](const int *src, const int n)
+    {
+        int *dst = next;
+        if (n > 0)
+        {
+            CHECK(cudaMemcpy(dst, src, n * sizeof(int), cudaMemcpyDefault));
+        }
+        next += n;
+        return dst;
+    };
+
+    patch.upperAddr = upload(upperAddr, nInternalFaces);
+    patch.lowerAddr = upload(lowerAddr, nInternalFaces);
+    patch.extRow = upload(extRow, nExtNz);
+    patch.extCol = upload(extCol, nExtNz);
+    patch.cellMap = upload(cellMap, nLocalRows);
+    patch.faceMap = upload(faceMap, nInternalFaces);
+    patch.extMap = upload(extMap, nExtNz);
+
+    AMGX_PROFILE_TRAFFIC(Transfer, 4.0 * nAddressing, 4.0 * nAddressing, 0.0);
+
+    AMGX_PROFILE_END(copyScope);
+    AMGX_PROFILE_BEGIN(mapsScope, "patchValuesLDU:maps");
+
+    int *inverses;
+    const size_t nInverses = (size_t)nLduRows + nLduInternalFaces + nLduExtNz;
+    CHECK(cudaMalloc(&inverses, sizeof(int) * nInverses));
+    CHECK(cudaMemset(inverses, 0xff, sizeof(int) * nInverses));
+
+    patch.cellInverse = inverses;
+    patch.faceInverse = inverses + nLduRows;
+    patch.extInverse = inverses + nLduRows + nLduInternalFaces;
+
+    CHECK(cudaMalloc(&patch.oldRows, sizeof(int) * nOldTotalNz));
+
+    constexpr int nthreads = 128;
+    auto nblocks = [](const int n) { return n / nthreads + 1; };
+
+    invertPatchMap<<<nblocks(nLocalRows), nthreads>>>(nLocalRows, patch.cellMap, nLduRows, patch.cellInverse);
+    invertPatchMap<<<nblocks(nInternalFaces), nthreads>>>(nInternalFaces, patch.faceMap, nLduInternalFaces, patch.faceInverse);
+    invertPatchMap<<<nblocks(nExtNz), nthreads>>>(nExtNz, patch.extMap, nLduExtNz, patch.extInverse);
+    findPatchOldRows<<<nblocks(nLduRows), nthreads>>>(patch, rowOffsets, ldu2csrPerm);
+
+    AMGX_PROFILE_TRAFFIC(Device, 4.0 * (nLocalRows + nInternalFaces + nExtNz) + 8.0 * nOldTotalNz,
+                         8.0 * nInverses + 4.0 * nOldTotalNz, 0.0);
+
+    AMGX_PROFILE_END(mapsScope);
+    AMGX_PROFILE_BEGIN(offsetsScope, "patchValuesLDU:offsets");
+
+    // The counts of each row, then its offsets
+    int *addedOffsets;
+    CHECK(cudaMalloc(&newRowOffsets, sizeof(int) * (nLocalRows + 1)));
+    CHECK(cudaMalloc(&addedOffsets, sizeof(int) * (nLocalRows + 1)));
+    CHECK(cudaMemset(newRowOffsets, 0, sizeof(int) * (nLocalRows + 1)));
+    CHECK(cudaMemset(addedOffsets, 0, sizeof(int) * (nLocalRows + 1)));
+
+    countPatchRows<<<nblocks(nTotalNz), nthreads>>>(patch, newRowOffsets, addedOffsets);
+    thrust::exclusive_scan(thrust::device, newRowOffsets, newRowOffsets + nLocalRows + 1, newRowOffsets);
+    thrust::exclusive_scan(thrust::device, addedOffsets, addedOffsets + nLocalRows + 1, addedOffsets);
+
+    int nAdded;
+    CHECK(cudaMemcpy(&nAdded, addedOffsets + nLocalRows, sizeof(int), cudaMemcpyDefault));
+
+    int *added;
+    int *addedFill;
+    CHECK(cudaMalloc(&added, sizeof(int) * std::max(nAdded, 1)));
+    CHECK(cudaMalloc(&addedFill, sizeof(int) * nLocalRows));
+    CHECK(cudaMemset(addedFill, 0, sizeof(int) * nLocalRows));
+
+    gatherPatchAdded<<<nblocks(nTotalNz), nthreads>>>(patch, addedOffsets, addedFill, added);
+
+    AMGX_PROFILE_TRAFFIC(Device, 2.0 * 20.0 * nTotalNz, 16.0 * (nLocalRows + 1) + 4.0 * nAdded, 0.0);
+
+    AMGX_PROFILE_END(offsetsScope);
+    AMGX_PROFILE_BEGIN(rowsScope, "patchValuesLDU:rows");
+
+    CHECK(cudaMalloc(&newPerm, sizeof(int) * nTotalNz));
+    CHECK(cudaMalloc(&newColIndices, sizeof(int) * nTotalNz));
+
+    patchRows<<<nblocks(nLocalRows), nthreads>>>(patch, rowOffsets, ldu2csrPerm, newRowOffsets,
+                                                 addedOffsets, added, newPerm, newColIndices);
+
+    AMGX_PROFILE_TRAFFIC(Device, 12.0 * nOldTotalNz + 12.0 * nTotalNz, 8.0 * nTotalNz, 0.0);
+
+    CHECK(cudaFree(addressing));
+    CHECK(cudaFree(inverses));
+    CHECK(cudaFree(patch.oldRows));
+    CHECK(cudaFree(addedOffsets));
+    CHECK(cudaFree(added));
+    CHECK(cudaFree(addedFill));
+
+    // The value buffers of the permutation are sized by the non-zeros
+    CHECK(cudaFree(valuesTmp));
+    CHECK(cudaFree(fvaluesTmp));
+    CHECK(cudaMalloc(&valuesTmp, sizeof(double) * nTotalNz));
+    CHECK(cudaMalloc(&fvaluesTmp, sizeof(float) * nTotalNz));
+
+    AMGX_PROFILE_END(rowsScope);
+
+    // Release the old structure and views, keeping the value buffers
+    release();
+
+    consolidationStatus = ConsolidationStatus::None;
+    rowOffsets = newRowOffsets;
+    colIndicesGlobal = newColIndices;
+    ldu2csrPerm = newPerm;
+
+    CHECK(cudaMalloc(&values, sizeof(double) * nTotalNz));
+
+    nLduRows = nLocalRows;
+    nLduInternalFaces = nInternalFaces;
+    nLduExtNz = nExtNz;
+    nInputInternalFaces = nInternalFaces;
+    nInputExtNz = nExtNz;
+    lduDiagIndexGlobal = diagIndexGlobal;
+
+    // Keep the row of each coefficient for the row sums of later updates
+    sumARows.resize(2 * nInternalFaces + nExtNz);
+
+    std::copy(lowerAddr, lowerAddr + nInternalFaces, sumARows.begin());
+    std::copy(upperAddr, upperAddr + nInternalFaces, sumARows.begin() + nInternalFaces);
+    std::copy(extRow, extRow + nExtNz, sumARows.begin() + 2 * nInternalFaces);
+
+    updateValues(nLocalRows, nInternalFaces, nExtNz, diagVals, upperVals, lowerVals, extVals);
+}
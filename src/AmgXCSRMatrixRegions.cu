@@ -0,0 +1,376 @@
+/*
+ * Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+// Monolithic assembly of multi-region systems, such as conjugate heat transfer.
+//
+// The regions of this rank are concatenated into one LDU matrix: their rows
+// in turn, then their internal faces in turn, with the addresses shifted by
+// the first row of each region. The rows of the ranks follow each other in
+// rank order, as do those of each region, so a column numbered within a
+// region is renumbered from the rank owning it and the offset of the region
+// on that rank. The external coefficients of the regions and the coupling
+// coefficients all become external coefficients of the assembled matrix,
+// which is then converted by setValuesLDU and updated by updateValues.
+
+#include <AmgXCSRMatrix.H>
+#include <AmgXProfiler.H>
+
+#include <algorithm>
+#include <cstdio>
+#include <numeric>
+#include <vector>
+
+namespace
+{
+
+// Concatenate the LDU values of the regions and couplings, in [ diagonal,
+// upper, lower, external ] order, the external values of the regions then
+// those of the couplings
+template<class T>
+void gatherRegionValues
+(
+    const int nRegions,
+    const AmgXLduRegion<T> *regions,
+    const int nCouplings,
+    const AmgXRegionCoupling<T> *couplings,
+    std::vector<double> &values
+)
+{
+    values.clear();
+
+    for (int r = 0; r < nRegions; ++r)
+    {
+        values.insert(values.end(), regions[r].diagVals, regions[r].diagVals + regions[r].nRows);
+    }
+
+    for (int r = 0; r < nRegions; ++r)
+    {
+        values.insert(values.end(), regions[r].upperVals, regions[r].upperVals + regions[r].nInternalFaces);
+    }
+
+    for (int r = 0; r < nRegions; ++r)
+    {
+        values.insert(values.end(), regions[r].lowerVals, regions[r].lowerVals + regions[r].nInternalFaces);
+    }
+
+    for (int r = 0; r < nRegions; ++r)
+    {
+        values.insert(values.end(), regions[r].extVals, regions[r].extVals + regions[r].extNnz);
+    }
+
+    for (int c = 0; c < nCouplings; ++c)
+    {
+        values.insert(values.end(), couplings[c].values, couplings[c].values + couplings[c].nNz);
+    }
+
+    // The values are read and written once
+    AMGX_PROFILE_TRAFFIC(Host, (double)sizeof(T) * values.size(), 8.0 * values.size(), 0.0);
+}
+
+}
+
+// Assemble the regions and their couplings into one matrix
+template<class T>
+void AmgXCSRMatrix::setRegionsLDUImpl
+(
+    int nRegions,
+    const AmgXLduRegion<T> *regions,
+    int nCouplings,
+    const AmgXRegionCoupling<T> *couplings,
+    MPI_Comm comm
+)
+{
+    AMGX_PROFILE_SCOPE("setRegionsLDU");
+
+    AMGX_PROFILE_BEGIN(assemblyScope, "setRegionsLDU:assembly");
+
+    int nRanks, myRank;
+    MPI_Comm_size(comm, &nRanks);
+    MPI_Comm_rank(comm, &myRank);
+
+    // The first row and number of rows of each region on each rank
+    std::vector<int> layout(2 * nRegions);
+
+    for (int r = 0; r < nRegions; ++r)
+    {
+        layout[2 * r] = regions[r].diagIndexGlobal;
+        layout[2 * r + 1] = regions[r].nRows;
+    }
+
+    std::vector<int> layouts(2 * nRegions * nRanks);
+    MPI_Allgather(layout.data(), 2 * nRegions, MPI_INT, layouts.data(), 2 * nRegions, MPI_INT, comm);
+
+    auto regionBegin = [&](const int rank, const int r) { return layouts[2 * (nRegions * rank + r)]; };
+    auto regionRows = [&](const int rank, const int r) { return layouts[2 * (nRegions * rank + r) + 1]; };
+
+    // The first assembled row of each rank, and of each region within it
+    std::vector<int> rankBegins(nRanks + 1, 0);
+
+    for (int rank = 0; rank < nRanks; ++rank)
+    {
+        rankBegins[rank + 1] = rankBegins[rank];
+
+        for (int r = 0; r < nRegions; ++r)
+        {
+            rankBegins[rank + 1] += regionRows(rank, r);
+        }
+    }
+
+    auto regionOffset = [&](const int rank, const int r)
+    {
+        int offset = rankBegins[rank];
+        for (int q = 0; q < r; ++q) offset += regionRows(rank, q);
+        return offset;
+    };
+
+    // Renumber a column of a region, from the rank owning it, -1 if none does
+    auto assembledColumn = [&](const int r, const int col)
+    {
+        int lo = 0, hi = nRanks;
+
+        // The last rank whose rows of the region start at or before col
+        while (lo < hi)
+        {
+            const int mid = (lo + hi) / 2;
+            if (regionBegin(mid, r) <= col) lo = mid + 1; else hi = mid;
+        }
+
+        const int rank = lo - 1;
+
+        if (rank < 0 || col >= regionBegin(rank, r) + regionRows(rank, r))
+        {
+            return -1;
+        }
+
+        return regionOffset(rank, r) + col - regionBegin(rank, r);
+    };
+
+    regionOffsets.assign(nRegions + 1, 0);
+    regionSizes.clear();
+
+    int nInternalFaces = 0;
+    int nExtNz = 0;
+
+    for (int r = 0; r < nRegions; ++r)
+    {
+        regionOffsets[r + 1] = regionOffsets[r] + regions[r].nRows;
+        regionSizes.push_back(regions[r].nInternalFaces);
+        regionSizes.push_back(regions[r].extNnz);
+        nInternalFaces += regions[r].nInternalFaces;
+        nExtNz += regions[r].extNnz;
+    }
+
+    for (int c = 0; c < nCouplings; ++c)
+    {
+        regionSizes.push_back(couplings[c].nNz);
+        nExtNz += couplings[c].nNz;
+    }
+
+    const int nRows = regionOffsets[nRegions];
+    nGlobalRegionRows = rankBegins[nRanks];
+
+    std::vector<int> upperAddr;
+    std::vector<int> lowerAddr;
+    std::vector<int> extRow;
+    std::vector<int> extCol;
+
+    upperAddr.reserve(nInternalFaces);
+    lowerAddr.reserve(nInternalFaces);
+    extRow.reserve(nExtNz);
+    extCol.reserve(nExtNz);
+
+    int ok = 1;
+
+    for (int r = 0; r < nRegions; ++r)
+    {
+        for (int i = 0; i < regions[r].nInternalFaces; ++i)
+        {
+            upperAddr.push_back(regionOffsets[r] + regions[r].upperAddr[i]);
+            lowerAddr.push_back(regionOffsets[r] + regions[r].lowerAddr[i]);
+        }
+    }
+
+    for (int r = 0; r < nRegions; ++r)
+    {
+        for (int i = 0; i < regions[r].extNnz; ++i)
+        {
+            const int col = assembledColumn(r, regions[r].extCol[i]);
+            ok = ok && col >= 0;
+
+            extRow.push_back(regionOffsets[r] + regions[r].extRow[i]);
+            extCol.push_back(col);
+        }
+    }
+
+    for (int c = 0; c < nCouplings; ++c)
+    {
+        const AmgXRegionCoupling<T> &coupling = couplings[c];
+
+        if (coupling.rowRegion < 0 || coupling.rowRegion >= nRegions
+         || coupling.colRegion < 0 || coupling.colRegion >= nRegions)
+        {
+            ok = 0;
+            continue;
+        }
+
+        for (int i = 0; i < coupling.nNz; ++i)
+        {
+            const int col = assembledColumn(coupling.colRegion, coupling.col[i]);
+            ok = ok && col >= 0 && coupling.row[i] >= 0 && coupling.row[i] < regions[coupling.rowRegion].nRows;
+
+            extRow.push_back(regionOffsets[coupling.rowRegion] + coupling.row[i]);
+            extCol.push_back(col);
+        }
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_MIN, comm);
+
+    if (!ok)
+    {
+        fprintf(stderr, "The regions or their couplings address rows outside the regions.\n");
+        regionOffsets.clear();
+        return;
+    }
+
+    gatherRegionValues(nRegions, regions, nCouplings, couplings, regionValues);
+
+    AMGX_PROFILE_END(assemblyScope);
+
+    const int diagIndexGlobal = rankBegins[myRank];
+    const int nLduNz = nRows + 2 * nInternalFaces;
+
+    setValuesLDU
+    (
+        nRows,
+        nInternalFaces,
+        diagIndexGlobal,
+        diagIndexGlobal,
+        diagIndexGlobal,
+        upperAddr.data(),
+        lowerAddr.data(),
+        nExtNz,
+        extRow.data(),
+        extCol.data(),
+        regionValues.data(),
+        regionValues.data() + nRows,
+        regionValues.data() + nRows + nInternalFaces,
+        regionValues.data() + nLduNz
+    );
+}
+
+// Update the values of the assembled regions and couplings
+template<class T>
+void AmgXCSRMatrix::updateRegionValuesImpl
+(
+    int nRegions,
+    const AmgXLduRegion<T> *regions,
+    int nCouplings,
+    const AmgXRegionCoupling<T> *couplings
+)
+{
+    AMGX_PROFILE_SCOPE("updateRegionValues");
+
+    bool matches = (int)regionOffsets.size() == nRegions + 1
+                && (int)regionSizes.size() == 2 * nRegions + nCouplings;
+
+    for (int r = 0; matches && r < nRegions; ++r)
+    {
+        matches = regions[r].nRows == regionOffsets[r + 1] - regionOffsets[r]
+               && regions[r].nInternalFaces == regionSizes[2 * r]
+               && regions[r].extNnz == regionSizes[2 * r + 1];
+    }
+
+    for (int c = 0; matches && c < nCouplings; ++c)
+    {
+        matches = couplings[c].nNz == regionSizes[2 * nRegions + c];
+    }
+
+    if (!matches)
+    {
+        fprintf(stderr, "The values do not match the regions of the matrix.\n");
+        return;
+    }
+
+    gatherRegionValues(nRegions, regions, nCouplings, couplings, regionValues);
+
+    // The sizes given to setValuesLDU, before any coefficients were dropped
+    updateValues
+    (
+        nLduRows,
+        nInputInternalFaces,
+        nInputExtNz,
+        regionValues.data(),
+        regionValues.data() + nLduRows,
+        regionValues.data() + nLduRows + nInputInternalFaces,
+        regionValues.data() + nLduRows + 2 * nInputInternalFaces
+    );
+}
+
+// Assemble the regions and their couplings into one matrix
+void AmgXCSRMatrix::setRegionsLDU
+(
+    int nRegions,
+    const AmgXLduRegion<float> *regions,
+    int nCouplings,
+    const AmgXRegionCoupling<float> *couplings,
+    MPI_Comm comm
+)
+{
+    setRegionsLDUImpl(nRegions, regions, nCouplings, couplings, comm);
+}
+
+// Assemble the regions and their couplings into one matrix
+void AmgXCSRMatrix::setRegionsLDU
+(
+    int nRegions,
+    const AmgXLduRegion<double> *regions,
+    int nCouplings,
+    const AmgXRegionCoupling<double> *couplings,
+    MPI_Comm comm
+)
+{
+    setRegionsLDUImpl(nRegions, regions, nCouplings, couplings, comm);
+}
+
+// Update the values of the assembled regions and couplings
+void AmgXCSRMatrix::updateRegionValues
+(
+    int nRegions,
+    const AmgXLduRegion<float> *regions,
+    int nCouplings,
+    const AmgXRegionCoupling<float> *couplings
+)
+{
+    updateRegionValuesImpl(nRegions, regions, nCouplings, couplings);
+}
+
+// Update the values of the assembled regions and couplings
+void AmgXCSRMatrix::updateRegionValues
+(
+    int nRegions,
+    const AmgXLduRegion<double> *regions,
+    int nCouplings,
+    const AmgXRegionCoupling<double> *couplings
+)
+{
+    updateRegionValuesImpl(nRegions, regions, nCouplings, couplings);
+}
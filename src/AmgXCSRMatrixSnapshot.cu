@@ -0,0 +1,635 @@
+/*
+ * Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+// Snapshots of converted matrices, one file per rank:
+//
+//   header | array | array | ...
+//
+// The header gives the offset and length of each array, every array starts
+// on a multiple of snapshotAlignment bytes, and all values are stored in the
+// byte order of the writer, so a snapshot is mapped and used without parsing.
+// Ranks not owning the CSR data of their device keep only the row sums and
+// the displacement tables.
+//
+// The structure cache uses the same files without the values and row sums,
+// named by a fingerprint of the addressing and decomposition of the ranks of
+// a device, so a mesh seen before is mapped in place of its conversion.
+
+#include <AmgXCSRMatrix.H>
+#include <AmgXCudaCheck.H>
+#include <AmgXProfiler.H>
+#include <AmgXRecorder.H>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <type_traits>
+
+namespace
+{
+
+constexpr char snapshotMagic[8] = {'A', 'M', 'G', 'X', 'C', 'S', 'R', '\0'};
+constexpr int32_t snapshotVersion = 1;
+constexpr int32_t snapshotByteOrder = 0x01020304;
+constexpr size_t snapshotAlignment = 4096;
+
+// The largest device array staged through the host at once when saving
+constexpr size_t snapshotStagingBytes = 64 << 20;
+
+enum SnapshotArray
+{
+    RowOffsets,
+    ColIndices,
+    Values,
+    Permutation,
+    SumARows,
+    SumA,
+    NRowsInDevWorld,
+    NnzInDevWorld,
+    NInternalFacesInDevWorld,
+    NExtNzInDevWorld,
+    RowDispls,
+    NzDispls,
+    InternalFacesDispls,
+    ExtNzDispls,
+    nSnapshotArrays
+};
+
+struct SnapshotHeader
+{
+    char magic[8];
+    int32_t version;
+    int32_t byteOrder;
+
+    int32_t location;
+    int32_t consolidated;
+    int32_t devWorldSize;
+    int32_t devWorldRank;
+
+    int32_t nLduRows;
+    int32_t nLduInternalFaces;
+    int32_t nLduExtNz;
+    int32_t lduDiagIndexGlobal;
+    int32_t reserved;
+
+    // The rows of the CSR data in the file, 0 without it
+    int32_t nRows;
+    int64_t nNz;
+
+    // In bytes from the start of the file
+    int64_t offsets[nSnapshotArrays];
+    int64_t bytes[nSnapshotArrays];
+};
+
+static_assert(std::is_trivially_copyable<SnapshotHeader>::value,
+              "The snapshot header is written as is");
+
+// An array to write, in host or device memory
+struct SnapshotSource
+{
+    const void *data = nullptr;
+    size_t bytes = 0;
+    bool onDevice = false;
+};
+
+size_t alignSnapshot(size_t offset)
+{
+    return (offset + snapshotAlignment - 1) / snapshotAlignment * snapshotAlignment;
+}
+
+std::string snapshotFileName(const std::string &prefix)
+{
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    return prefix + "." + std::to_string(rank) + ".amgxcsr";
+}
+
+template<typename T>
+SnapshotSource hostSource(const std::vector<T> &v)
+{
+    SnapshotSource source;
+    source.data = v.data();
+    source.bytes = v.size() * sizeof(T);
+    return source;
+}
+
+template<typename T>
+const T* snapshotArray(const void *map, const SnapshotHeader &header, SnapshotArray a)
+{
+    return reinterpret_cast<const T*>(static_cast<const char*>(map) + header.offsets[a]);
+}
+
+template<typename T>
+std::vector<T> snapshotVector(const void *map, const SnapshotHeader &header, SnapshotArray a)
+{
+    const T *data = snapshotArray<T>(map, header, a);
+    return std::vector<T>(data, data + header.bytes[a] / sizeof(T));
+}
+
+// MurmurHash64A of bytes, continuing from seed
+uint64_t hashBytes(const void *data, size_t bytes, uint64_t seed)
+{
+    constexpr uint64_t m = 0xc6a4a7935bd1e995ULL;
+    constexpr int r = 47;
+
+    uint64_t h = seed ^ (bytes * m);
+
+    const unsigned char *p = static_cast<const unsigned char*>(data);
+    const unsigned char *end = p + bytes / 8 * 8;
+
+    for (; p != end; p += 8)
+    {
+        uint64_t k;
+        memcpy(&k, p, 8);
+
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+
+        h ^= k;
+        h *= m;
+    }
+
+    if (bytes % 8 != 0)
+    {
+        uint64_t tail = 0;
+        memcpy(&tail, p, bytes % 8);
+
+        h ^= tail;
+        h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+
+    return h;
+}
+
+}
+
+// Save the converted structure and values of this rank
+bool AmgXCSRMatrix::saveSnapshot(const std::string &prefix) const
+{
+    AMGX_PROFILE_SCOPE("saveSnapshot");
+
+    return writeSnapshot(snapshotFileName(prefix), true);
+}
+
+// Load a snapshot in place of setValuesLDU
+bool AmgXCSRMatrix::loadSnapshot(const std::string &prefix)
+{
+    AMGX_PROFILE_SCOPE("loadSnapshot");
+
+    const std::string fileName = snapshotFileName(prefix);
+    AmgXRecorder::recordLoadSnapshot(this, fileName);
+
+    return readSnapshot(fileName, true);
+}
+
+// Write the converted structure of this rank, and its values with withValues
+bool AmgXCSRMatrix::writeSnapshot(const std::string &fileName, bool withValues) const
+{
+    if (consolidationStatus == ConsolidationStatus::Uninitialised)
+    {
+        fprintf(stderr, "The matrix structure must be set before saving a snapshot.\n");
+        return false;
+    }
+
+    // Only the root rank of a device holds the CSR data
+    const bool hasCSR = isOnHost() || gpuProc == 0;
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, snapshotMagic, sizeof(snapshotMagic));
+    header.version = snapshotVersion;
+    header.byteOrder = snapshotByteOrder;
+    header.location = static_cast<int32_t>(location);
+    header.consolidated = isConsolidated();
+    header.devWorldSize = devWorldSize;
+    header.devWorldRank = myDevWorldRank;
+    header.nLduRows = nLduRows;
+    header.nLduInternalFaces = nLduInternalFaces;
+    header.nLduExtNz = nLduExtNz;
+    header.lduDiagIndexGlobal = lduDiagIndexGlobal;
+
+    if (hasCSR)
+    {
+        header.nRows = isConsolidated() ? nConsRows : nLduRows;
+        header.nNz = isConsolidated()
+                   ? (int64_t)nConsNz + nConsExtNz
+                   : (int64_t)nLduRows + 2 * (int64_t)nLduInternalFaces + nLduExtNz;
+    }
+
+    SnapshotSource sources[nSnapshotArrays];
+
+    if (hasCSR)
+    {
+        sources[RowOffsets] = {rowOffsets, (header.nRows + 1) * sizeof(int), !isOnHost()};
+        sources[ColIndices] = {colIndicesGlobal, header.nNz * sizeof(int), !isOnHost()};
+        sources[Permutation] = {ldu2csrPerm, header.nNz * sizeof(int), !isOnHost()};
+    }
+
+    // The values and row sums follow from the LDU values of each setValuesLDU
+    if (withValues)
+    {
+        if (hasCSR)
+        {
+            sources[Values] = {values, header.nNz * sizeof(double), !isOnHost()};
+        }
+
+        sources[SumARows] = hostSource(sumARows);
+        sources[SumA] = hostSource(sumA);
+    }
+
+    sources[NRowsInDevWorld] = hostSource(nRowsInDevWorld);
+    sources[NnzInDevWorld] = hostSource(nnzInDevWorld);
+    sources[NInternalFacesInDevWorld] = hostSource(nInternalFacesInDevWorld);
+    sources[NExtNzInDevWorld] = hostSource(nExtNzInDevWorld);
+    sources[RowDispls] = hostSource(rowDispls);
+    sources[NzDispls] = hostSource(nzDispls);
+    sources[InternalFacesDispls] = hostSource(internalFacesDispls);
+    sources[ExtNzDispls] = hostSource(extNzDispls);
+
+    size_t offset = alignSnapshot(sizeof(SnapshotHeader));
+
+    for (int a = 0; a < nSnapshotArrays; ++a)
+    {
+        header.offsets[a] = offset;
+        header.bytes[a] = sources[a].bytes;
+        offset = alignSnapshot(offset + sources[a].bytes);
+    }
+
+    FILE *file = fopen(fileName.c_str(), "wb");
+
+    if (file == nullptr)
+    {
+        fprintf(stderr, "Cannot open the snapshot file %s.\n", fileName.c_str());
+        return false;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    std::vector<char> staging;
+
+    for (int a = 0; ok && a < nSnapshotArrays; ++a)
+    {
+        ok = fseek(file, header.offsets[a], SEEK_SET) == 0;
+
+        const char *data = static_cast<const char*>(sources[a].data);
+
+        for (size_t done = 0; ok && done < sources[a].bytes; done += snapshotStagingBytes)
+        {
+            const size_t n = std::min(snapshotStagingBytes, sources[a].bytes - done);
+
+            if (sources[a].onDevice)
+            {
+                staging.resize(n);
+                CHECK(cudaMemcpy(staging.data(), data + done, n, cudaMemcpyDefault));
+                ok = fwrite(staging.data(), 1, n, file) == n;
+            }
+            else
+            {
+                ok = fwrite(data + done, 1, n, file) == n;
+            }
+        }
+    }
+
+    // Pad the file to the end of the last array, so it can be mapped whole
+    if (ok && fseek(file, offset - 1, SEEK_SET) == 0)
+    {
+        ok = fputc(0, file) != EOF;
+    }
+
+    if (fclose(file) != 0 || !ok)
+    {
+        fprintf(stderr, "Cannot write the snapshot file %s.\n", fileName.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+// Read the converted structure of this rank, and its values with withValues,
+// else the values are allocated for updateValues and the sizes of the LDU
+// matrix set by setValuesLDU must match those of the file
+bool AmgXCSRMatrix::readSnapshot(const std::string &fileName, bool withValues)
+{
+    if (devWorldSize == 0)
+    {
+        fprintf(stderr, "The matrix communicators must be initialised before loading a snapshot.\n");
+        return false;
+    }
+
+    void *map = MAP_FAILED;
+    size_t mapBytes = 0;
+    int ok = 0;
+
+    int fd = open(fileName.c_str(), O_RDONLY);
+    struct stat st;
+
+    if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(SnapshotHeader))
+    {
+        mapBytes = st.st_size;
+
+        // Private, so updates of the values of a host matrix stay in memory
+        map = mmap(nullptr, mapBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    }
+
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+
+    SnapshotHeader header;
+
+    if (map == MAP_FAILED)
+    {
+        fprintf(stderr, "Cannot map the snapshot file %s.\n", fileName.c_str());
+    }
+    else
+    {
+        memcpy(&header, map, sizeof(header));
+
+        ok = memcmp(header.magic, snapshotMagic, sizeof(snapshotMagic)) == 0
+          && header.version == snapshotVersion
+          && header.byteOrder == snapshotByteOrder;
+
+        for (int a = 0; ok && a < nSnapshotArrays; ++a)
+        {
+            ok = header.offsets[a] >= 0 && header.bytes[a] >= 0
+              && header.offsets[a] % snapshotAlignment == 0
+              && (size_t)(header.offsets[a] + header.bytes[a]) <= mapBytes;
+        }
+
+        if (!ok)
+        {
+            fprintf(stderr, "%s is not a snapshot of this version.\n", fileName.c_str());
+        }
+        else if (header.location != static_cast<int32_t>(location)
+              || header.devWorldSize != devWorldSize
+              || header.devWorldRank != myDevWorldRank)
+        {
+            fprintf(stderr, "The snapshot %s was saved with another location or number "
+                            "of ranks per device.\n", fileName.c_str());
+            ok = 0;
+        }
+        else if (header.bytes[Values] != (withValues ? header.nNz * (int64_t)sizeof(double) : 0))
+        {
+            fprintf(stderr, "The snapshot %s %s the values.\n", fileName.c_str(),
+                    withValues ? "does not hold" : "holds");
+            ok = 0;
+        }
+        else if (!withValues
+              && (header.nLduRows != nLduRows
+               || header.nLduInternalFaces != nLduInternalFaces
+               || header.nLduExtNz != nLduExtNz
+               || header.lduDiagIndexGlobal != lduDiagIndexGlobal))
+        {
+            fprintf(stderr, "The snapshot %s holds the structure of another matrix.\n",
+                    fileName.c_str());
+            ok = 0;
+        }
+    }
+
+    // All ranks of the device load, or none
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_MIN, devWorld);
+
+    if (!ok)
+    {
+        if (map != MAP_FAILED)
+        {
+            munmap(map, mapBytes);
+        }
+        return false;
+    }
+
+    // The structure has been previously set, must deallocate it
+    if (consolidationStatus != ConsolidationStatus::Uninitialised)
+    {
+        release();
+    }
+
+    if (withValues)
+    {
+        nLduRows = header.nLduRows;
+        nLduInternalFaces = header.nLduInternalFaces;
+        nLduExtNz = header.nLduExtNz;
+        lduDiagIndexGlobal = header.lduDiagIndexGlobal;
+
+        // The snapshot is updated as the matrix it holds, dropped coefficients included
+        nInputInternalFaces = nLduInternalFaces;
+        nInputExtNz = nLduExtNz;
+        lduFiltered = false;
+
+        sumARows = snapshotVector<int>(map, header, SumARows);
+        sumA = snapshotVector<double>(map, header, SumA);
+    }
+
+    const int nLduNz = nLduRows + 2 * nLduInternalFaces;
+
+    if (isOnHost())
+    {
+        // The CSR data is used in place, its pages are read on first access
+        consolidationStatus = ConsolidationStatus::None;
+
+        rowOffsets = const_cast<int*>(snapshotArray<int>(map, header, RowOffsets));
+        colIndicesGlobal = const_cast<int*>(snapshotArray<int>(map, header, ColIndices));
+        ldu2csrPerm = const_cast<int*>(snapshotArray<int>(map, header, Permutation));
+
+        if (withValues)
+        {
+            values = const_cast<double*>(snapshotArray<double>(map, header, Values));
+        }
+        else
+        {
+            values = new double[header.nNz];
+        }
+
+        snapshotMap = map;
+        snapshotBytes = mapBytes;
+        snapshotValues = withValues;
+        return true;
+    }
+
+    // Allocate the buffers of the values, shared by the ranks of a device, and
+    // recompute the displacement tables to check the snapshots go together,
+    // without the index buffers of the conversion
+    int *rowIndicesTmp;
+    int *colIndicesTmp;
+    initialiseConsolidation(nLduRows, nLduNz, nLduInternalFaces, nLduExtNz, rowIndicesTmp, colIndicesTmp, false);
+
+    ok = header.consolidated == isConsolidated()
+      && snapshotVector<int>(map, header, RowDispls) == rowDispls
+      && snapshotVector<int>(map, header, NzDispls) == nzDispls
+      && snapshotVector<int>(map, header, InternalFacesDispls) == internalFacesDispls
+      && snapshotVector<int>(map, header, ExtNzDispls) == extNzDispls;
+
+    if (ok && gpuProc == 0)
+    {
+        const int nRows = isConsolidated() ? nConsRows : nLduRows;
+        const int64_t nNz = isConsolidated() ? (int64_t)nConsNz + nConsExtNz : (int64_t)nLduNz + nLduExtNz;
+
+        ok = header.nRows == nRows && header.nNz == nNz;
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_MIN, devWorld);
+
+    if (!ok)
+    {
+        fprintf(stderr, "The snapshot %s does not match the snapshots of the other ranks "
+                        "of the device.\n", fileName.c_str());
+        munmap(map, mapBytes);
+        release();
+        return false;
+    }
+
+    if (gpuProc == 0)
+    {
+        madvise(map, mapBytes, MADV_SEQUENTIAL);
+
+        CHECK(cudaMalloc(&rowOffsets, header.bytes[RowOffsets]));
+        CHECK(cudaMalloc(&colIndicesGlobal, header.bytes[ColIndices]));
+        CHECK(cudaMalloc(&values, header.nNz * sizeof(double)));
+        CHECK(cudaMalloc(&ldu2csrPerm, header.bytes[Permutation]));
+
+        CHECK(cudaMemcpy(rowOffsets, snapshotArray<int>(map, header, RowOffsets),
+                         header.bytes[RowOffsets], cudaMemcpyDefault));
+        CHECK(cudaMemcpy(colIndicesGlobal, snapshotArray<int>(map, header, ColIndices),
+                         header.bytes[ColIndices], cudaMemcpyDefault));
+        if (withValues)
+        {
+            CHECK(cudaMemcpy(values, snapshotArray<double>(map, header, Values),
+                             header.bytes[Values], cudaMemcpyDefault));
+        }
+        CHECK(cudaMemcpy(ldu2csrPerm, snapshotArray<int>(map, header, Permutation),
+                         header.bytes[Permutation], cudaMemcpyDefault));
+    }
+
+    munmap(map, mapBytes);
+    return true;
+}
+
+// The file of the structure cache for this addressing and decomposition, empty
+// without a cache directory. Collective over devWorld
+std::string AmgXCSRMatrix::structureCacheFile
+(
+    int nLocalRows,
+    int nInternalFaces,
+    int diagIndexGlobal,
+    int lowOffGlobal,
+    int uppOffGlobal,
+    const int *upperAddr,
+    const int *lowerAddr,
+    const int nExtNz,
+    const int *extRow,
+    const int *extCol
+) const
+{
+    std::string directory = structureCache;
+
+    if (directory.empty())
+    {
+        const char *env = std::getenv("AMGX_WRAPPER_STRUCTURE_CACHE");
+        directory = env != nullptr ? env : "";
+    }
+
+    if (directory.empty())
+    {
+        return directory;
+    }
+
+    AMGX_PROFILE_SCOPE("setValuesLDU:fingerprint");
+
+    int worldSize;
+    MPI_Comm_size(MPI_COMM_WORLD, &worldSize);
+
+    const int64_t layout[] =
+    {
+        snapshotVersion, static_cast<int64_t>(location), worldSize, devWorldSize, myDevWorldRank,
+        nLocalRows, nInternalFaces, nExtNz, diagIndexGlobal, lowOffGlobal, uppOffGlobal
+    };
+
+    uint64_t fingerprint = hashBytes(layout, sizeof(layout), 0);
+    fingerprint = hashBytes(lowerAddr, nInternalFaces * sizeof(int), fingerprint);
+    fingerprint = hashBytes(upperAddr, nInternalFaces * sizeof(int), fingerprint);
+    fingerprint = hashBytes(extRow, nExtNz * sizeof(int), fingerprint);
+    fingerprint = hashBytes(extCol, nExtNz * sizeof(int), fingerprint);
+
+    AMGX_PROFILE_TRAFFIC(Host, 8.0 * (nInternalFaces + nExtNz), 0.0, 0.0);
+
+    // The structure of a consolidated device follows from those of all its ranks
+    std::vector<uint64_t> fingerprints(devWorldSize);
+    MPI_Allgather(&fingerprint, 1, MPI_UINT64_T, fingerprints.data(), 1, MPI_UINT64_T, devWorld);
+
+    fingerprint = hashBytes(fingerprints.data(), fingerprints.size() * sizeof(uint64_t), 0);
+
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(fingerprint));
+
+    return snapshotFileName(directory + "/" + name);
+}
+
+// Map the cached structure in place of the conversion, if all ranks of the
+// device have it. Collective over devWorld
+bool AmgXCSRMatrix::loadStructureCache(const std::string &fileName)
+{
+    AMGX_PROFILE_SCOPE("setValuesLDU:loadCache");
+
+    // A miss is the usual case for a new mesh, so only damaged files are reported
+    int present = access(fileName.c_str(), R_OK) == 0;
+    MPI_Allreduce(MPI_IN_PLACE, &present, 1, MPI_INT, MPI_MIN, devWorld);
+
+    return present && readSnapshot(fileName, false);
+}
+
+// Store the converted structure, under a temporary name so a reader never
+// maps a partial file
+void AmgXCSRMatrix::saveStructureCache(const std::string &fileName) const
+{
+    AMGX_PROFILE_SCOPE("setValuesLDU:saveCache");
+
+    const std::string directory = fileName.substr(0, fileName.rfind('/'));
+
+    if (mkdir(directory.c_str(), 0777) != 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "Cannot create the structure cache %s.\n", directory.c_str());
+        return;
+    }
+
+    const std::string tmpFileName = fileName + ".tmp" + std::to_string(getpid());
+
+    if (!writeSnapshot(tmpFileName, false) || rename(tmpFileName.c_str(), fileName.c_str()) != 0)
+    {
+        fprintf(stderr, "Cannot store the structure cache %s.\n", fileName.c_str());
+        unlink(tmpFileName.c_str());
+    }
+}
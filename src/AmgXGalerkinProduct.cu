@@ -0,0 +1,489 @@
+/*
+ * Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <AmgXGalerkinProduct.H>
+#include <AmgXParallel.H>
+#include <AmgXProfiler.H>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <numeric>
+#include <thread>
+
+namespace
+{
+
+// The key of an unused slot of an accumulator
+const int empty = -1;
+
+// An open addressing map of columns to sums, cleared in the time of its entries
+class ColumnAccumulator
+{
+    public:
+
+        ColumnAccumulator()
+        :
+            keys(size_t(1) << bits, empty),
+            sums(size_t(1) << bits)
+        {}
+
+        // The sum of a column, added as zero if new
+        double& operator[](const int col)
+        {
+            if (2 * (slots.size() + 1) > keys.size())
+            {
+                grow();
+            }
+
+            size_t s = find(col);
+
+            if (keys[s] == empty)
+            {
+                keys[s] = col;
+                sums[s] = 0.0;
+                slots.push_back(s);
+            }
+
+            return sums[s];
+        }
+
+        // The sum of a column present
+        double at(const int col) const
+        {
+            return sums[find(col)];
+        }
+
+        // Runs f(col, sum) over the entries, in no order
+        template<typename Function>
+        void forEach(Function f) const
+        {
+            for (const size_t s : slots)
+            {
+                f(keys[s], sums[s]);
+            }
+        }
+
+        void clear()
+        {
+            for (const size_t s : slots)
+            {
+                keys[s] = empty;
+            }
+
+            slots.clear();
+        }
+
+    private:
+
+        int bits = 6;
+
+        std::vector<int> keys;
+        std::vector<double> sums;
+
+        // The slots in use, to clear them
+        std::vector<size_t> slots;
+
+        size_t find(const int col) const
+        {
+            const size_t mask = keys.size() - 1;
+            size_t s = (uint32_t(col) * 2654435761u) >> (32 - bits);
+
+            while (keys[s] != col && keys[s] != empty)
+            {
+                s = (s + 1) & mask;
+            }
+
+            return s;
+        }
+
+        void grow()
+        {
+            std::vector<int> oldKeys;
+            std::vector<double> oldSums;
+            std::vector<size_t> oldSlots;
+
+            oldKeys.swap(keys);
+            oldSums.swap(sums);
+            oldSlots.swap(slots);
+
+            ++bits;
+            keys.assign(size_t(1) << bits, empty);
+            sums.resize(size_t(1) << bits);
+
+            for (const size_t s : oldSlots)
+            {
+                const size_t t = find(oldKeys[s]);
+                keys[t] = oldKeys[s];
+                sums[t] = oldSums[s];
+                slots.push_back(t);
+            }
+        }
+};
+
+}
+
+AmgXGalerkinProduct::AmgXGalerkinProduct(int nThreads)
+:
+    nThreads(defaultThreads(nThreads))
+{}
+
+// Find the structure of the coarse rows of this rank
+bool AmgXGalerkinProduct::symbolic
+(
+    const AmgXCSRMatrix &A,
+    const AmgXCSRRows &P,
+    long coarseBegin,
+    int nCoarseRows,
+    MPI_Comm comm
+)
+{
+    AMGX_PROFILE_SCOPE("galerkin:symbolic");
+
+    nRows = A.getNLocalRows();
+    const long rowBegin = A.getFirstRowGlobal();
+    const int *aRowOffsets = A.getRowOffsets();
+    const int *aColIndices = A.getColIndices();
+
+    int ok = A.isOnHost() && aRowOffsets != nullptr && P.nRows == nRows && P.rowBegin == rowBegin;
+
+    for (size_t k = 0; ok && k < P.colIndices.size(); ++k)
+    {
+        ok = P.colIndices[k] >= coarseBegin && P.colIndices[k] < coarseBegin + nCoarseRows;
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_MIN, comm);
+
+    if (!ok)
+    {
+        fprintf(stderr, "The Galerkin product needs a host matrix and the prolongation of its rows "
+                        "to the coarse rows of each rank.\n");
+        return false;
+    }
+
+    nNz = aRowOffsets[nRows];
+
+    int nRanks;
+    MPI_Comm_size(comm, &nRanks);
+
+    AMGX_PROFILE_BEGIN(haloScope, "galerkin:symbolic:halo");
+
+    // The rows of each rank, to find the owners of the external columns
+    std::vector<long> rowBegins(nRanks);
+    std::vector<int> rowCounts(nRanks);
+    MPI_Allgather(&rowBegin, 1, MPI_LONG, rowBegins.data(), 1, MPI_LONG, comm);
+    MPI_Allgather(&nRows, 1, MPI_INT, rowCounts.data(), 1, MPI_INT, comm);
+
+    std::vector<int> ranksByRow(nRanks);
+    std::iota(ranksByRow.begin(), ranksByRow.end(), 0);
+    std::sort(ranksByRow.begin(), ranksByRow.end(),
+              [&](int a, int b) { return rowBegins[a] < rowBegins[b]; });
+
+    auto owner = [&](const long col)
+    {
+        auto r = std::upper_bound(ranksByRow.begin(), ranksByRow.end(), col,
+                                  [&](long c, int rank) { return c < rowBegins[rank]; });
+        return r == ranksByRow.begin() ? -1 : *(r - 1);
+    };
+
+    std::vector<int> halo;
+
+    for (int k = 0; k < nNz; ++k)
+    {
+        if (aColIndices[k] < rowBegin || aColIndices[k] >= rowBegin + nRows)
+        {
+            halo.push_back(aColIndices[k]);
+        }
+    }
+
+    std::sort(halo.begin(), halo.end());
+    halo.erase(std::unique(halo.begin(), halo.end()), halo.end());
+
+    const int nHalo = halo.size();
+
+    // Request the rows of P of the external columns from their ranks, grouped by rank
+    std::vector<int> sendCounts(nRanks, 0);
+    std::vector<int> haloOwner(nHalo);
+
+    for (int h = 0; h < nHalo; ++h)
+    {
+        const int r = owner(halo[h]);
+        ok = ok && r >= 0 && halo[h] < rowBegins[r] + rowCounts[r];
+        haloOwner[h] = std::max(r, 0);
+        ++sendCounts[haloOwner[h]];
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_MIN, comm);
+
+    if (!ok)
+    {
+        fprintf(stderr, "The matrix has columns outside the rows of the ranks.\n");
+        return false;
+    }
+
+    std::vector<int> sendDispls(nRanks + 1, 0);
+    std::partial_sum(sendCounts.begin(), sendCounts.end(), sendDispls.begin() + 1);
+
+    // The position of each external column among the requests
+    std::vector<int> requestOf(nHalo);
+    std::vector<int> requests(nHalo);
+    std::vector<int> fill(sendDispls.begin(), sendDispls.end() - 1);
+
+    for (int h = 0; h < nHalo; ++h)
+    {
+        requestOf[h] = fill[haloOwner[h]]++;
+        requests[requestOf[h]] = halo[h];
+    }
+
+    std::vector<int> recvCounts(nRanks);
+    MPI_Alltoall(sendCounts.data(), 1, MPI_INT, recvCounts.data(), 1, MPI_INT, comm);
+
+    std::vector<int> recvDispls(nRanks + 1, 0);
+    std::partial_sum(recvCounts.begin(), recvCounts.end(), recvDispls.begin() + 1);
+
+    std::vector<int> requested(recvDispls[nRanks]);
+    MPI_Alltoallv(requests.data(), sendCounts.data(), sendDispls.data(), MPI_INT,
+                  requested.data(), recvCounts.data(), recvDispls.data(), MPI_INT, comm);
+
+    // Reply with the lengths of the rows, then their entries
+    std::vector<int> replyLengths(requested.size());
+
+    for (size_t q = 0; q < requested.size(); ++q)
+    {
+        const int row = requested[q] - rowBegin;
+        replyLengths[q] = P.rowOffsets[row + 1] - P.rowOffsets[row];
+    }
+
+    std::vector<int> haloLengths(nHalo);
+    MPI_Alltoallv(replyLengths.data(), recvCounts.data(), recvDispls.data(), MPI_INT,
+                  haloLengths.data(), sendCounts.data(), sendDispls.data(), MPI_INT, comm);
+
+    std::vector<int> replyCounts(nRanks, 0);
+    std::vector<int> receiveCounts(nRanks, 0);
+
+    for (int r = 0; r < nRanks; ++r)
+    {
+        for (int q = recvDispls[r]; q < recvDispls[r + 1]; ++q) replyCounts[r] += replyLengths[q];
+        for (int q = sendDispls[r]; q < sendDispls[r + 1]; ++q) receiveCounts[r] += haloLengths[q];
+    }
+
+    std::vector<int> replyDispls(nRanks + 1, 0);
+    std::vector<int> receiveDispls(nRanks + 1, 0);
+    std::partial_sum(replyCounts.begin(), replyCounts.end(), replyDispls.begin() + 1);
+    std::partial_sum(receiveCounts.begin(), receiveCounts.end(), receiveDispls.begin() + 1);
+
+    std::vector<int> replyCols;
+    std::vector<double> replyValues;
+
+    for (size_t q = 0; q < requested.size(); ++q)
+    {
+        const int row = requested[q] - rowBegin;
+        replyCols.insert(replyCols.end(), P.colIndices.begin() + P.rowOffsets[row],
+                         P.colIndices.begin() + P.rowOffsets[row + 1]);
+        replyValues.insert(replyValues.end(), P.values.begin() + P.rowOffsets[row],
+                           P.values.begin() + P.rowOffsets[row + 1]);
+    }
+
+    std::vector<int> haloCols(receiveDispls[nRanks]);
+    std::vector<double> haloValues(receiveDispls[nRanks]);
+    MPI_Alltoallv(replyCols.data(), replyCounts.data(), replyDispls.data(), MPI_INT,
+                  haloCols.data(), receiveCounts.data(), receiveDispls.data(), MPI_INT, comm);
+    MPI_Alltoallv(replyValues.data(), replyCounts.data(), replyDispls.data(), MPI_DOUBLE,
+                  haloValues.data(), receiveCounts.data(), receiveDispls.data(), MPI_DOUBLE, comm);
+
+    // The local rows of P, then those of the external columns in column order
+    std::vector<int> haloOffsets(nHalo + 1, 0);
+    std::partial_sum(haloLengths.begin(), haloLengths.end(), haloOffsets.begin() + 1);
+
+    pRowOffsets.assign(P.rowOffsets.begin(), P.rowOffsets.end());
+    pColIndices.assign(P.colIndices.begin(), P.colIndices.end());
+    pValues.assign(P.values.begin(), P.values.end());
+
+    for (int h = 0; h < nHalo; ++h)
+    {
+        const int q = requestOf[h];
+        pColIndices.insert(pColIndices.end(), haloCols.begin() + haloOffsets[q], haloCols.begin() + haloOffsets[q + 1]);
+        pValues.insert(pValues.end(), haloValues.begin() + haloOffsets[q], haloValues.begin() + haloOffsets[q + 1]);
+        pRowOffsets.push_back(pColIndices.size());
+    }
+
+    AMGX_PROFILE_END(haloScope);
+    AMGX_PROFILE_BEGIN(transposeScope, "galerkin:symbolic:transpose");
+
+    // The row of P of each column of A
+    aColPRows.resize(nNz);
+
+    for (int k = 0; k < nNz; ++k)
+    {
+        const int col = aColIndices[k];
+
+        aColPRows[k] = (col >= rowBegin && col < rowBegin + nRows)
+                     ? col - rowBegin
+                     : nRows + (std::lower_bound(halo.begin(), halo.end(), col) - halo.begin());
+    }
+
+    // The local rows of P by coarse row, a counting sort
+    ptRowOffsets.assign(nCoarseRows + 1, 0);
+
+    for (int k = 0; k < P.rowOffsets[nRows]; ++k)
+    {
+        ++ptRowOffsets[P.colIndices[k] - coarseBegin + 1];
+    }
+
+    std::partial_sum(ptRowOffsets.begin(), ptRowOffsets.end(), ptRowOffsets.begin());
+
+    ptRows.resize(ptRowOffsets[nCoarseRows]);
+    ptValues.resize(ptRowOffsets[nCoarseRows]);
+    fill.assign(ptRowOffsets.begin(), ptRowOffsets.end() - 1);
+
+    for (int i = 0; i < nRows; ++i)
+    {
+        for (int k = P.rowOffsets[i]; k < P.rowOffsets[i + 1]; ++k)
+        {
+            const int slot = fill[P.colIndices[k] - coarseBegin]++;
+            ptRows[slot] = i;
+            ptValues[slot] = P.values[k];
+        }
+    }
+
+    AMGX_PROFILE_END(transposeScope);
+    AMGX_PROFILE_SCOPE("galerkin:symbolic:rows");
+
+    // The columns of each coarse row, found by each thread for its own rows
+    std::vector<std::vector<int>> threadCols(nThreads);
+    std::vector<int> rowLengths(nCoarseRows);
+
+    parallelChunks(nThreads, nCoarseRows,
+        [&](int t, long first, long last)
+        {
+            ColumnAccumulator acc;
+            std::vector<int> &cols = threadCols[t];
+
+            for (long I = first; I < last; ++I)
+            {
+                for (int s = ptRowOffsets[I]; s < ptRowOffsets[I + 1]; ++s)
+                {
+                    const int i = ptRows[s];
+
+                    for (int k = aRowOffsets[i]; k < aRowOffsets[i + 1]; ++k)
+                    {
+                        const int j = aColPRows[k];
+
+                        for (int l = pRowOffsets[j]; l < pRowOffsets[j + 1]; ++l)
+                        {
+                            acc[pColIndices[l]];
+                        }
+                    }
+                }
+
+                const size_t begin = cols.size();
+                acc.forEach([&](int col, double) { cols.push_back(col); });
+                std::sort(cols.begin() + begin, cols.end());
+
+                rowLengths[I] = cols.size() - begin;
+                acc.clear();
+            }
+        });
+
+    int nGlobalCoarse = nCoarseRows;
+    MPI_Allreduce(MPI_IN_PLACE, &nGlobalCoarse, 1, MPI_INT, MPI_SUM, comm);
+
+    coarseRows.nGlobalRows = nGlobalCoarse;
+    coarseRows.nGlobalCols = nGlobalCoarse;
+    coarseRows.rowBegin = coarseBegin;
+    coarseRows.nRows = nCoarseRows;
+    coarseRows.rowOffsets.assign(nCoarseRows + 1, 0);
+    std::partial_sum(rowLengths.begin(), rowLengths.end(), coarseRows.rowOffsets.begin() + 1);
+
+    coarseRows.colIndices.clear();
+
+    for (const std::vector<int> &cols : threadCols)
+    {
+        coarseRows.colIndices.insert(coarseRows.colIndices.end(), cols.begin(), cols.end());
+    }
+
+    coarseRows.values.assign(coarseRows.colIndices.size(), 0.0);
+
+    return true;
+}
+
+// Compute the values of the coarse rows from the values of A
+bool AmgXGalerkinProduct::numeric(const AmgXCSRMatrix &A)
+{
+    AMGX_PROFILE_SCOPE("galerkin:numeric");
+
+    const int *aRowOffsets = A.getRowOffsets();
+    const double *aValues = A.getValues();
+
+    if (!A.isOnHost() || aRowOffsets == nullptr || A.getNLocalRows() != nRows || aRowOffsets[nRows] != nNz)
+    {
+        fprintf(stderr, "The matrix of the Galerkin product has changed structure.\n");
+        return false;
+    }
+
+    std::atomic<long> nMultiplies(0);
+
+    parallelChunks(nThreads, coarseRows.nRows,
+        [&](int t, long first, long last)
+        {
+            ColumnAccumulator acc;
+            long n = 0;
+
+            for (long I = first; I < last; ++I)
+            {
+                for (int s = ptRowOffsets[I]; s < ptRowOffsets[I + 1]; ++s)
+                {
+                    const int i = ptRows[s];
+                    const double w = ptValues[s];
+
+                    for (int k = aRowOffsets[i]; k < aRowOffsets[i + 1]; ++k)
+                    {
+                        const int j = aColPRows[k];
+                        const double wa = w * aValues[k];
+
+                        for (int l = pRowOffsets[j]; l < pRowOffsets[j + 1]; ++l)
+                        {
+                            acc[pColIndices[l]] += wa * pValues[l];
+                        }
+
+                        n += 1 + pRowOffsets[j + 1] - pRowOffsets[j];
+                    }
+                }
+
+                for (int k = coarseRows.rowOffsets[I]; k < coarseRows.rowOffsets[I + 1]; ++k)
+                {
+                    coarseRows.values[k] = acc.at(coarseRows.colIndices[k]);
+                }
+
+                acc.clear();
+            }
+
+            nMultiplies += n;
+        });
+
+    // A multiply and an add for each product, the values of A and P read once per
+    // use as most are not reused within a row, and the coarse values written
+    AMGX_PROFILE_TRAFFIC(Host, 12.0 * nMultiplies, 8.0 * coarseRows.values.size(), 2.0 * nMultiplies);
+
+    return true;
+}
@@ -13,6 +13,94 @@
 # include "AmgXSolver.H"
 
 
+// initialize AmgXSolver::layouts to none
+std::vector<std::weak_ptr<AmgXCommLayout>> AmgXSolver::layouts;
+
+
+/* \implements AmgXCommLayout::~AmgXCommLayout */
+AmgXCommLayout::~AmgXCommLayout()
+{
+    if (gpuWorld != MPI_COMM_NULL) MPI_Comm_free(&gpuWorld);
+    if (devWorld != MPI_COMM_NULL) MPI_Comm_free(&devWorld);
+    if (localCpuWorld != MPI_COMM_NULL) MPI_Comm_free(&localCpuWorld);
+    if (globalCpuWorld != MPI_COMM_NULL) MPI_Comm_free(&globalCpuWorld);
+}
+
+
+/* \implements AmgXSolver::requireComms */
+void AmgXSolver::requireComms()
+{
+    if (commsReady) return;
+
+    AMGX_PROFILE_SCOPE("initialize:comms");
+
+    // the layout of a live instance on a congruent communicator, the same on all ranks
+    // as instances are created and finalised collectively
+    if (!layout)
+    {
+        for (auto entry = layouts.begin(); entry != layouts.end();)
+        {
+            std::shared_ptr<AmgXCommLayout> candidate = entry->lock();
+            if (!candidate)
+            {
+                entry = layouts.erase(entry);
+                continue;
+            }
+
+            int result;
+            MPI_Comm_compare(userComm, candidate->globalCpuWorld, &result);
+
+            if (candidate->hostMode == isHostMode() && (result == MPI_IDENT || result == MPI_CONGRUENT))
+            {
+                layout = candidate;
+                break;
+            }
+
+            ++entry;
+        }
+    }
+
+    if (layout)
+    {
+        // only one instance may use the communicators of the layout themselves
+        ownsComms = layout->borrowed;
+        initMPIcomms(*layout, ownsComms);
+        layout->borrowed = true;
+    }
+    else
+    {
+        AMGX_PROFILE_BEGIN(splitScope, "initialize:split");
+        initMPIcomms(userComm);
+        AMGX_PROFILE_END(splitScope);
+
+        // the communicators of the first instance are those of the layout
+        layout = std::make_shared<AmgXCommLayout>();
+        layout->hostMode = isHostMode();
+        layout->borrowed = true;
+        layout->globalCpuWorld = globalCpuWorld;
+        layout->localCpuWorld = localCpuWorld;
+        layout->gpuWorld = gpuWorld;
+        layout->devWorld = devWorld;
+        layout->globalSize = globalSize;
+        layout->myGlobalRank = myGlobalRank;
+        layout->localSize = localSize;
+        layout->myLocalRank = myLocalRank;
+        layout->nDevs = nDevs;
+        layout->devID = devID;
+        layout->gpuProc = gpuProc;
+        layout->gpuWorldSize = gpuWorldSize;
+        layout->myGpuWorldRank = myGpuWorldRank;
+        layout->devWorldSize = devWorldSize;
+        layout->myDevWorldRank = myDevWorldRank;
+
+        layouts.push_back(layout);
+        ownsComms = false;
+    }
+
+    commsReady = true;
+}
+
+
 /* \implements AmgXSolver::initMPIcomms */
 void AmgXSolver::initMPIcomms(const MPI_Comm &comm)
 {
@@ -41,7 +129,6 @@ void AmgXSolver::initMPIcomms(const MPI_Comm &comm)
 
     // set up corresponding ID of the device used by each local process
     setDeviceIDs();  
-    MPI_Barrier(globalCpuWorld);  
 
 
     // split the global world into a world involved in AmgX and a null world
@@ -67,8 +154,55 @@ void AmgXSolver::initMPIcomms(const MPI_Comm &comm)
     // get size and rank for the communicator corresponding to myWorld
     MPI_Comm_size(devWorld, &devWorldSize);  
     MPI_Comm_rank(devWorld, &myDevWorldRank);  
+}
+
+
+/* \implements AmgXSolver::initMPIcomms */
+void AmgXSolver::initMPIcomms(const AmgXCommLayout &layout, bool duplicate)
+{
+    // the layout of processes and devices is that of the instances sharing the splits
+    globalSize = layout.globalSize;
+    myGlobalRank = layout.myGlobalRank;
+    localSize = layout.localSize;
+    myLocalRank = layout.myLocalRank;
+    nDevs = layout.nDevs;
+    devID = layout.devID;
+    gpuProc = layout.gpuProc;
+    gpuWorldSize = layout.gpuWorldSize;
+    myGpuWorldRank = layout.myGpuWorldRank;
+    devWorldSize = layout.devWorldSize;
+    myDevWorldRank = layout.myDevWorldRank;
+
+    if (!duplicate)
+    {
+        globalCpuWorld = layout.globalCpuWorld;
+        localCpuWorld = layout.localCpuWorld;
+        gpuWorld = layout.gpuWorld;
+        devWorld = layout.devWorld;
+        return;
+    }
 
-    MPI_Barrier(globalCpuWorld);  
+    AMGX_PROFILE_SCOPE("initialize:duplicate");
+
+    // duplicates give this instance its own communication contexts
+    MPI_Comm_dup(layout.globalCpuWorld, &globalCpuWorld);  
+    MPI_Comm_set_name(globalCpuWorld, "globalCpuWorld");  
+
+    MPI_Comm_dup(layout.localCpuWorld, &localCpuWorld);  
+    MPI_Comm_set_name(localCpuWorld, "localCpuWorld");  
+
+    if (layout.gpuWorld != MPI_COMM_NULL)
+    {
+        MPI_Comm_dup(layout.gpuWorld, &gpuWorld);  
+        MPI_Comm_set_name(gpuWorld, "gpuWorld");  
+    }
+    else
+    {
+        gpuWorld = MPI_COMM_NULL;
+    }
+
+    MPI_Comm_dup(layout.devWorld, &devWorld);  
+    MPI_Comm_set_name(devWorld, "devWorld");  
 }
 
 
@@ -136,7 +270,7 @@ void AmgXSolver::setDeviceIDs()
         }
     }
 
-    // Set the device for each rank
-    cudaSetDevice(devID);
+    // Set the device for each rank, host modes do not use a device
+    if (!isHostMode()) cudaSetDevice(devID);
 }
 
@@ -0,0 +1,542 @@
+/*
+ * Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <AmgXMatrixMarket.H>
+#include <AmgXCSRMatrix.H>
+#include <AmgXCudaCheck.H>
+#include <AmgXParallel.H>
+#include <AmgXProfiler.H>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+#include <thread>
+#include <utility>
+
+namespace
+{
+
+// The largest block written by one MPI-IO call
+constexpr size_t maxWriteBytes = 1 << 30;
+
+// Appends the entries of the rows [first, last) of a CSR matrix, with 1-based global indices
+void formatRows
+(
+    std::string &out,
+    int first,
+    int last,
+    const std::vector<long> &rowGlobal,
+    const std::vector<int> &rowOffsets,
+    const std::vector<int> &colIndices,
+    const std::vector<double> &values
+)
+{
+    char line[80];
+
+    for (int r = first; r < last; ++r)
+    {
+        for (int i = rowOffsets[r]; i < rowOffsets[r + 1]; ++i)
+        {
+            const int n = snprintf(line, sizeof(line), "%ld %d %.17g\n",
+                                   rowGlobal[r] + 1, colIndices[i] + 1, values[i]);
+            out.append(line, n);
+        }
+    }
+}
+
+// A MatrixMarket file mapped in memory, with its banner and size line parsed
+struct MatrixMarketFile
+{
+    explicit MatrixMarketFile(const std::string &fileName);
+    ~MatrixMarketFile();
+
+    MatrixMarketFile(const MatrixMarketFile&) = delete;
+    MatrixMarketFile& operator=(const MatrixMarketFile&) = delete;
+
+    void *map = MAP_FAILED;
+    size_t bytes = 0;
+
+    bool symmetric = false;
+    bool pattern = false;
+
+    long nRows = 0;
+    long nCols = 0;
+    long nEntries = 0;
+
+    // The lines of the entries
+    const char *begin = nullptr;
+    const char *end = nullptr;
+};
+
+MatrixMarketFile::MatrixMarketFile(const std::string &fileName)
+{
+    int fd = open(fileName.c_str(), O_RDONLY);
+    struct stat st;
+
+    if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        bytes = st.st_size;
+        map = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+
+    if (map == MAP_FAILED)
+    {
+        fprintf(stderr, "Cannot read the MatrixMarket file %s.\n", fileName.c_str());
+        exit(0);
+    }
+
+    madvise(map, bytes, MADV_SEQUENTIAL);
+
+    const char *p = static_cast<const char*>(map);
+    end = p + bytes;
+
+    auto nextLine = [&](const char *q)
+    {
+        q = static_cast<const char*>(memchr(q, '\n', end - q));
+        return q == nullptr ? end : q + 1;
+    };
+
+    // The banner, in any case
+    std::string banner(p, nextLine(p));
+    std::transform(banner.begin(), banner.end(), banner.begin(), ::tolower);
+
+    char object[32], format[32], field[32], symmetry[32];
+
+    if (sscanf(banner.c_str(), "%%%%matrixmarket %31s %31s %31s %31s", object, format, field, symmetry) != 4
+     || strcmp(object, "matrix") != 0 || strcmp(format, "coordinate") != 0
+     || (strcmp(field, "real") != 0 && strcmp(field, "integer") != 0 && strcmp(field, "pattern") != 0)
+     || (strcmp(symmetry, "general") != 0 && strcmp(symmetry, "symmetric") != 0))
+    {
+        fprintf(stderr, "%s is not a real, integer or pattern coordinate MatrixMarket file, "
+                        "general or symmetric.\n", fileName.c_str());
+        exit(0);
+    }
+
+    symmetric = strcmp(symmetry, "symmetric") == 0;
+    pattern = strcmp(field, "pattern") == 0;
+
+    // The comments, then the size line
+    p = nextLine(p);
+    while (p < end && *p == '%')
+    {
+        p = nextLine(p);
+    }
+
+    const std::string sizeLine(p, nextLine(p));
+
+    if (sscanf(sizeLine.c_str(), "%ld %ld %ld", &nRows, &nCols, &nEntries) != 3)
+    {
+        fprintf(stderr, "The size line of %s is missing.\n", fileName.c_str());
+        exit(0);
+    }
+
+    if (nRows > INT_MAX || nCols > INT_MAX)
+    {
+        fprintf(stderr, "The indices of %s do not fit in 32 bits.\n", fileName.c_str());
+        exit(0);
+    }
+
+    begin = nextLine(p);
+}
+
+MatrixMarketFile::~MatrixMarketFile()
+{
+    munmap(map, bytes);
+}
+
+// Parses a field of a line within [p, end), false if there is none
+bool parseField(const char *&p, const char *end, char *field, size_t size)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+    {
+        ++p;
+    }
+
+    size_t n = 0;
+    while (p < end && !isspace((unsigned char)*p) && n + 1 < size)
+    {
+        field[n++] = *p++;
+    }
+    field[n] = '\0';
+
+    return n > 0;
+}
+
+// One entry of a row of the range read
+struct MatrixMarketEntry
+{
+    int row;
+    int col;
+    double value;
+};
+
+}
+
+AmgXMatrixMarketReader::AmgXMatrixMarketReader(int nThreads)
+:
+    nThreads(defaultThreads(nThreads))
+{}
+
+AmgXCSRRows AmgXMatrixMarketReader::read(const std::string &fileName, MPI_Comm comm) const
+{
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    return read(fileName, rank, size);
+}
+
+AmgXCSRRows AmgXMatrixMarketReader::read(const std::string &fileName, int rank, int nRanks) const
+{
+    long nRows = 0;
+    {
+        MatrixMarketFile file(fileName);
+        nRows = file.nRows;
+    }
+
+    return readRows(fileName, nRows * rank / nRanks, nRows * (rank + 1) / nRanks);
+}
+
+AmgXCSRRows AmgXMatrixMarketReader::readRows(const std::string &fileName, long rowBegin, long rowEnd) const
+{
+    AMGX_PROFILE_SCOPE("readMatrixMarket");
+
+    MatrixMarketFile file(fileName);
+
+    AmgXCSRRows rows;
+    rows.nGlobalRows = file.nRows;
+    rows.nGlobalCols = file.nCols;
+    rows.rowBegin = rowBegin;
+    rows.nRows = rowEnd - rowBegin;
+
+    // Each thread parses the lines starting in its part of the file
+    const long nBytes = file.end - file.begin;
+    std::vector<std::vector<MatrixMarketEntry>> entries(nThreads);
+    std::vector<std::atomic<int>> rowCounts(rows.nRows);
+    std::atomic<bool> invalid(false);
+
+    parallelChunks(nThreads, nBytes,
+        [&](int t, long first, long last)
+        {
+            const char *p = file.begin + first;
+            const char *end = file.begin + last;
+
+            // Lines starting before the part belong to the previous thread
+            if (first > 0 && p[-1] != '\n')
+            {
+                p = static_cast<const char*>(memchr(p, '\n', file.end - p));
+                p = p == nullptr ? file.end : p + 1;
+            }
+
+            char fields[3][64];
+
+            while (p < end)
+            {
+                const char *lineEnd = static_cast<const char*>(memchr(p, '\n', file.end - p));
+                lineEnd = lineEnd == nullptr ? file.end : lineEnd;
+
+                // Comments and blank lines are skipped
+                if (*p != '%' && parseField(p, lineEnd, fields[0], sizeof(fields[0])))
+                {
+                    if (!parseField(p, lineEnd, fields[1], sizeof(fields[1]))
+                     || (!file.pattern && !parseField(p, lineEnd, fields[2], sizeof(fields[2]))))
+                    {
+                        invalid = true;
+                        break;
+                    }
+
+                    const long i = strtol(fields[0], nullptr, 10) - 1;
+                    const long j = strtol(fields[1], nullptr, 10) - 1;
+                    const double value = file.pattern ? 1.0 : strtod(fields[2], nullptr);
+
+                    if (i < 0 || i >= file.nRows || j < 0 || j >= file.nCols)
+                    {
+                        invalid = true;
+                        break;
+                    }
+
+                    if (i >= rowBegin && i < rowEnd)
+                    {
+                        entries[t].push_back({int(i - rowBegin), int(j), value});
+                        ++rowCounts[i - rowBegin];
+                    }
+
+                    // The upper triangle of a symmetric matrix is implied
+                    if (file.symmetric && i != j && j >= rowBegin && j < rowEnd)
+                    {
+                        entries[t].push_back({int(j - rowBegin), int(i), value});
+                        ++rowCounts[j - rowBegin];
+                    }
+                }
+
+                p = lineEnd < file.end ? lineEnd + 1 : file.end;
+            }
+        });
+
+    if (invalid)
+    {
+        fprintf(stderr, "%s has an invalid entry.\n", fileName.c_str());
+        exit(0);
+    }
+
+    rows.rowOffsets.resize(rows.nRows + 1, 0);
+    for (int r = 0; r < rows.nRows; ++r)
+    {
+        rows.rowOffsets[r + 1] = rows.rowOffsets[r] + rowCounts[r];
+    }
+
+    const int nNz = rows.rowOffsets[rows.nRows];
+    rows.colIndices.resize(nNz);
+    rows.values.resize(nNz);
+
+    // The next free position of each row
+    for (int r = 0; r < rows.nRows; ++r)
+    {
+        rowCounts[r] = rows.rowOffsets[r];
+    }
+
+    parallelChunks(nThreads, nThreads,
+        [&](int t, long, long)
+        {
+            for (const MatrixMarketEntry &e : entries[t])
+            {
+                const int i = rowCounts[e.row]++;
+                rows.colIndices[i] = e.col;
+                rows.values[i] = e.value;
+            }
+        });
+
+    entries.clear();
+
+    // Sort each row by column, so the result does not depend on the threads
+    parallelChunks(nThreads, rows.nRows,
+        [&](int, long first, long last)
+        {
+            std::vector<std::pair<int, double>> row;
+
+            for (long r = first; r < last; ++r)
+            {
+                const int b = rows.rowOffsets[r], e = rows.rowOffsets[r + 1];
+
+                row.clear();
+                for (int i = b; i < e; ++i)
+                {
+                    row.emplace_back(rows.colIndices[i], rows.values[i]);
+                }
+
+                std::sort(row.begin(), row.end());
+
+                for (int i = b; i < e; ++i)
+                {
+                    rows.colIndices[i] = row[i - b].first;
+                    rows.values[i] = row[i - b].second;
+                }
+            }
+        });
+
+    return rows;
+}
+
+// Write the CSR rows with global indices in MatrixMarket format
+bool AmgXCSRMatrix::writeMatrixMarket
+(
+    const std::string &prefix,
+    MPI_Comm comm,
+    bool merge
+) const
+{
+    AMGX_PROFILE_SCOPE("writeMatrixMarket");
+
+    int ok = consolidationStatus != ConsolidationStatus::Uninitialised;
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_MIN, comm);
+
+    if (!ok)
+    {
+        fprintf(stderr, "The matrix structure must be set before writing it.\n");
+        return false;
+    }
+
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    // Only the root rank of a device holds the CSR data
+    const bool hasCSR = isOnHost() || gpuProc == 0;
+
+    // The global index of the first row of each rank of the device
+    std::vector<int> diagIndexGlobalAll(devWorldSize);
+    MPI_Gather(&lduDiagIndexGlobal, 1, MPI_INT, diagIndexGlobalAll.data(), 1, MPI_INT, 0, devWorld);
+
+    const int nRows = hasCSR ? (isConsolidated() ? nConsRows : nLduRows) : 0;
+
+    std::vector<int> hostRowOffsets(nRows + 1, 0);
+    std::vector<int> hostColIndices;
+    std::vector<double> hostValues;
+    std::vector<long> rowGlobal(nRows);
+
+    if (hasCSR && isOnHost())
+    {
+        // The host modes do not initialise the CUDA runtime, so the arrays are copied directly
+        std::copy(rowOffsets, rowOffsets + nRows + 1, hostRowOffsets.begin());
+        hostColIndices.assign(colIndicesGlobal, colIndicesGlobal + hostRowOffsets[nRows]);
+        hostValues.assign(values, values + hostRowOffsets[nRows]);
+    }
+    else if (hasCSR)
+    {
+        CHECK(cudaMemcpy(hostRowOffsets.data(), rowOffsets, (nRows + 1) * sizeof(int), cudaMemcpyDefault));
+
+        hostColIndices.resize(hostRowOffsets[nRows]);
+        hostValues.resize(hostRowOffsets[nRows]);
+
+        CHECK(cudaMemcpy(hostColIndices.data(), colIndicesGlobal, hostColIndices.size() * sizeof(int), cudaMemcpyDefault));
+        CHECK(cudaMemcpy(hostValues.data(), values, hostValues.size() * sizeof(double), cudaMemcpyDefault));
+    }
+
+    if (hasCSR)
+    {
+        // The rows of each rank of the device are consecutive
+        for (int i = 0; i < devWorldSize; ++i)
+        {
+            const int first = isConsolidated() ? rowDispls[i] : 0;
+            const int last = isConsolidated() ? rowDispls[i + 1] : nRows;
+
+            for (int r = first; r < last; ++r)
+            {
+                rowGlobal[r] = diagIndexGlobalAll[i] + (r - first);
+            }
+        }
+    }
+
+    long nLocalNz = hostValues.size();
+    long nGlobalRows = nLduRows;
+    long nGlobalNz = nLocalNz;
+    MPI_Allreduce(MPI_IN_PLACE, &nGlobalRows, 1, MPI_LONG, MPI_SUM, comm);
+    MPI_Allreduce(MPI_IN_PLACE, &nGlobalNz, 1, MPI_LONG, MPI_SUM, comm);
+
+    // The entries are formatted by several threads, each on its own rows
+    const int nThreads = defaultThreads(0);
+    std::vector<std::string> parts(nThreads);
+
+    parallelChunks(nThreads, nRows,
+        [&](int t, long first, long last)
+        {
+            formatRows(parts[t], first, last, rowGlobal, hostRowOffsets, hostColIndices, hostValues);
+        });
+
+    std::string header;
+
+    if (merge ? rank == 0 : hasCSR)
+    {
+        char line[160];
+        snprintf(line, sizeof(line), "%%%%MatrixMarket matrix coordinate real general\n%ld %ld %ld\n",
+                 nGlobalRows, nGlobalRows, merge ? nGlobalNz : nLocalNz);
+        header = line;
+    }
+
+    parts.insert(parts.begin(), header);
+
+    long long nBytes = 0;
+    for (const std::string &part : parts)
+    {
+        nBytes += part.size();
+    }
+
+    if (merge)
+    {
+        const std::string fileName = prefix + ".mtx";
+
+        // The parts of the ranks follow each other in rank order
+        long long offset = 0;
+        MPI_Exscan(&nBytes, &offset, 1, MPI_LONG_LONG, MPI_SUM, comm);
+        if (rank == 0)
+        {
+            offset = 0;
+        }
+
+        MPI_File fh;
+        ok = MPI_File_open(comm, fileName.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                           MPI_INFO_NULL, &fh) == MPI_SUCCESS;
+
+        if (ok)
+        {
+            ok = MPI_File_set_size(fh, 0) == MPI_SUCCESS;
+
+            for (const std::string &part : parts)
+            {
+                for (size_t done = 0; ok && done < part.size(); done += maxWriteBytes)
+                {
+                    const int n = std::min(maxWriteBytes, part.size() - done);
+                    ok = MPI_File_write_at(fh, offset + done, part.data() + done, n, MPI_CHAR,
+                                           MPI_STATUS_IGNORE) == MPI_SUCCESS;
+                }
+                offset += part.size();
+            }
+
+            MPI_File_close(&fh);
+        }
+
+        if (!ok)
+        {
+            fprintf(stderr, "Cannot write the MatrixMarket file %s.\n", fileName.c_str());
+        }
+    }
+    else if (hasCSR)
+    {
+        const std::string fileName = prefix + "." + std::to_string(rank) + ".mtx";
+        FILE *file = fopen(fileName.c_str(), "w");
+
+        ok = file != nullptr;
+
+        for (const std::string &part : parts)
+        {
+            ok = ok && fwrite(part.data(), 1, part.size(), file) == part.size();
+        }
+
+        if (file != nullptr)
+        {
+            ok = (fclose(file) == 0) && ok;
+        }
+
+        if (!ok)
+        {
+            fprintf(stderr, "Cannot write the MatrixMarket file %s.\n", fileName.c_str());
+        }
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_MIN, comm);
+
+    return ok;
+}
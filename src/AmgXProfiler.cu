@@ -0,0 +1,709 @@
+/*
+ * Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <AmgXProfiler.H>
+
+#include <cuda_runtime.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+std::atomic<bool> AmgXProfiler::enabled(false);
+bool AmgXProfiler::synchronise = false;
+std::string AmgXProfiler::prefix;
+std::atomic<long> AmgXProfiler::nSolves(0);
+int AmgXProfiler::nReports = 0;
+
+namespace
+{
+
+// A closed or open region
+struct ProfileEvent
+{
+    const char *name;
+    double start;
+    double end;
+};
+
+// The traffic added to a region, by its index in the events of the thread
+struct ProfileTraffic
+{
+    size_t event;
+    AmgXProfiler::Memory memory;
+    double bytesRead;
+    double bytesWritten;
+    double flops;
+};
+
+// The regions recorded by one thread
+struct ThreadEvents
+{
+    int tid;
+    std::vector<ProfileEvent> events;
+    std::vector<size_t> open;
+    std::vector<ProfileTraffic> traffic;
+};
+
+// The buffers of all threads, kept alive after their thread exits
+std::mutex threadsMutex;
+std::vector<std::shared_ptr<ThreadEvents>> threads;
+
+// The accumulated wait of each barrier since the last report
+struct BarrierWait
+{
+    double total = 0.0;
+    long count = 0;
+};
+
+std::mutex waitsMutex;
+std::map<std::string, BarrierWait> waits;
+
+constexpr int nMemories = 3;
+const char *memoryNames[nMemories] = {"host", "device", "transfer"};
+
+// The peak bandwidth of each memory in bytes per microsecond, 0 until measured
+double peakBandwidth[nMemories] = {0.0, 0.0, 0.0};
+
+// The ranks sharing the host memory when its peak was measured
+int nNodeRanks = 0;
+
+// The bytes of each array of the triad, and of the copies, well beyond the caches
+constexpr size_t hostPeakBytes = size_t(128) << 20;
+constexpr size_t devicePeakBytes = size_t(256) << 20;
+constexpr size_t transferPeakBytes = size_t(64) << 20;
+constexpr int nPeakRepeats = 5;
+
+const auto epoch = std::chrono::steady_clock::now();
+
+// Microseconds since the library was loaded
+double now()
+{
+    return std::chrono::duration<double, std::micro>(
+        std::chrono::steady_clock::now() - epoch).count();
+}
+
+// The buffer of the calling thread, registered on first use
+ThreadEvents& threadEvents()
+{
+    thread_local std::shared_ptr<ThreadEvents> local;
+
+    if (!local)
+    {
+        local = std::make_shared<ThreadEvents>();
+
+        std::lock_guard<std::mutex> lock(threadsMutex);
+        local->tid = threads.size();
+        threads.push_back(local);
+    }
+
+    return *local;
+}
+
+// The triad a = b + s c of STREAM over all cores, counting 24 bytes per element
+double measureHostBandwidth()
+{
+    const int nThreads = std::max(1u, std::thread::hardware_concurrency());
+    const size_t n = hostPeakBytes / sizeof(double) / nThreads;
+
+    std::vector<double> times(nPeakRepeats * nThreads);
+    std::vector<double> checks(nThreads);
+    std::atomic<int> arrived(0);
+
+    auto triad = [&](const int t)
+    {
+        // Each thread touches its arrays first, so they are local to its socket
+        std::vector<double> a(n, 0.0), b(n, 1.0), c(n, 2.0);
+
+        for (int r = 0; r < nPeakRepeats; ++r)
+        {
+            // All threads start each repetition together
+            ++arrived;
+            while (arrived.load() < (r + 1) * nThreads) std::this_thread::yield();
+
+            const double start = now();
+            for (size_t i = 0; i < n; ++i)
+            {
+                a[i] = b[i] + 3.0 * c[i];
+            }
+            times[r * nThreads + t] = now() - start;
+        }
+
+        checks[t] = a[n / 2];
+    };
+
+    std::vector<std::thread> workers;
+    for (int t = 1; t < nThreads; ++t)
+    {
+        workers.emplace_back(triad, t);
+    }
+    triad(0);
+
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+
+    // The best repetition, each lasting as long as its slowest thread
+    double best = DBL_MAX;
+    for (int r = 0; r < nPeakRepeats; ++r)
+    {
+        best = std::min(best, *std::max_element(&times[r * nThreads], &times[(r + 1) * nThreads]));
+    }
+
+    if (checks[0] != 7.0) return 0.0;
+
+    return 3.0 * sizeof(double) * n * nThreads / best;
+}
+
+// A copy within the memory of the device, reading and writing its bytes
+double measureDeviceBandwidth()
+{
+    void *src = nullptr, *dst = nullptr;
+    if (cudaMalloc(&src, devicePeakBytes) != cudaSuccess || cudaMalloc(&dst, devicePeakBytes) != cudaSuccess)
+    {
+        cudaFree(src);
+        cudaGetLastError();
+        return 0.0;
+    }
+
+    cudaMemset(src, 0, devicePeakBytes);
+    cudaMemcpy(dst, src, devicePeakBytes, cudaMemcpyDeviceToDevice);
+    cudaDeviceSynchronize();
+
+    double best = DBL_MAX;
+    for (int r = 0; r < nPeakRepeats; ++r)
+    {
+        const double start = now();
+        cudaMemcpy(dst, src, devicePeakBytes, cudaMemcpyDeviceToDevice);
+        cudaDeviceSynchronize();
+        best = std::min(best, now() - start);
+    }
+
+    cudaFree(src);
+    cudaFree(dst);
+
+    return 2.0 * devicePeakBytes / best;
+}
+
+// A copy from pageable host memory to the device, as the wrapper copies the LDU arrays
+double measureTransferBandwidth()
+{
+    void *dst = nullptr;
+    if (cudaMalloc(&dst, transferPeakBytes) != cudaSuccess)
+    {
+        cudaGetLastError();
+        return 0.0;
+    }
+
+    std::vector<char> src(transferPeakBytes, 1);
+    cudaMemcpy(dst, src.data(), transferPeakBytes, cudaMemcpyHostToDevice);
+
+    double best = DBL_MAX;
+    for (int r = 0; r < nPeakRepeats; ++r)
+    {
+        const double start = now();
+        cudaMemcpy(dst, src.data(), transferPeakBytes, cudaMemcpyHostToDevice);
+        cudaDeviceSynchronize();
+        best = std::min(best, now() - start);
+    }
+
+    cudaFree(dst);
+
+    return 2.0 * transferPeakBytes / best;
+}
+
+// Wait for a request without keeping a core busy, so a measurement has all of them
+void waitIdle(MPI_Request &request)
+{
+    int done = 0;
+    MPI_Test(&request, &done, MPI_STATUS_IGNORE);
+
+    while (!done)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        MPI_Test(&request, &done, MPI_STATUS_IGNORE);
+    }
+}
+
+// Measure the peak bandwidths of the memories with traffic not measured yet, collective over comm
+void measurePeaks(MPI_Comm comm, const bool used[nMemories])
+{
+    int need[nMemories], needAny[nMemories];
+    for (int m = 0; m < nMemories; ++m)
+    {
+        need[m] = used[m] && peakBandwidth[m] == 0.0;
+    }
+
+    MPI_Allreduce(need, needAny, nMemories, MPI_INT, MPI_MAX, comm);
+
+    const int host = (int)AmgXProfiler::Memory::Host;
+    const int device = (int)AmgXProfiler::Memory::Device;
+    const int transfer = (int)AmgXProfiler::Memory::Transfer;
+
+    if (!needAny[host] && !needAny[device] && !needAny[transfer]) return;
+
+    MPI_Comm node;
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &node);
+
+    int nodeRank, nodeSize;
+    MPI_Comm_rank(node, &nodeRank);
+    MPI_Comm_size(node, &nodeSize);
+
+    // The host memory is shared by the ranks of the node, one measures it while the others sleep
+    if (needAny[host])
+    {
+        double peak = (nodeRank == 0) ? measureHostBandwidth() : 0.0;
+
+        MPI_Request request;
+        MPI_Ibcast(&peak, 1, MPI_DOUBLE, 0, node, &request);
+        waitIdle(request);
+
+        peakBandwidth[host] = peak;
+        nNodeRanks = nodeSize;
+    }
+
+    // Devices and links may be shared too, their ranks measure them in turn
+    if (needAny[device] || needAny[transfer])
+    {
+        for (int r = 0; r < nodeSize; ++r)
+        {
+            if (r == nodeRank)
+            {
+                if (need[device]) peakBandwidth[device] = measureDeviceBandwidth();
+                if (need[transfer]) peakBandwidth[transfer] = measureTransferBandwidth();
+            }
+
+            MPI_Request request;
+            MPI_Ibarrier(node, &request);
+            waitIdle(request);
+        }
+    }
+
+    MPI_Comm_free(&node);
+}
+
+}
+
+void AmgXProfiler::enable(const std::string &prefix, bool synchronise)
+{
+    AmgXProfiler::prefix = prefix;
+    AmgXProfiler::synchronise = synchronise;
+    enabled = true;
+}
+
+void AmgXProfiler::disable()
+{
+    enabled = false;
+}
+
+void AmgXProfiler::begin(const char *name)
+{
+    ThreadEvents &local = threadEvents();
+
+    local.open.push_back(local.events.size());
+    local.events.push_back({name, now(), -1.0});
+}
+
+void AmgXProfiler::end()
+{
+    ThreadEvents &local = threadEvents();
+
+    if (local.open.empty()) return;
+
+    // Include the kernels launched within the region
+    if (synchronise) cudaDeviceSynchronize();
+
+    local.events[local.open.back()].end = now();
+    local.open.pop_back();
+}
+
+void AmgXProfiler::traffic(Memory memory, double bytesRead, double bytesWritten, double flops)
+{
+    ThreadEvents &local = threadEvents();
+
+    if (local.open.empty()) return;
+
+    const size_t event = local.open.back();
+
+    // Repeated additions to a region, as in loops, are merged
+    if (!local.traffic.empty() && local.traffic.back().event == event && local.traffic.back().memory == memory)
+    {
+        ProfileTraffic &last = local.traffic.back();
+        last.bytesRead += bytesRead;
+        last.bytesWritten += bytesWritten;
+        last.flops += flops;
+        return;
+    }
+
+    local.traffic.push_back({event, memory, bytesRead, bytesWritten, flops});
+}
+
+void AmgXProfiler::barrier(MPI_Comm comm, const char *name)
+{
+    if (!enabled)
+    {
+        MPI_Barrier(comm);
+        return;
+    }
+
+    AmgXProfileScope scope(name);
+
+    const double start = now();
+    MPI_Barrier(comm);
+    const double wait = now() - start;
+
+    std::lock_guard<std::mutex> lock(waitsMutex);
+    BarrierWait &barrierWait = waits[name];
+    barrierWait.total += wait;
+    ++barrierWait.count;
+}
+
+void AmgXProfiler::countSolve()
+{
+    if (!isEnabled()) return;
+
+    nSolves.fetch_add(1, std::memory_order_relaxed);
+}
+
+void AmgXProfiler::reportWaits(MPI_Comm comm, bool consolidationRoot)
+{
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    std::map<std::string, BarrierWait> local;
+    {
+        std::lock_guard<std::mutex> lock(waitsMutex);
+        local.swap(waits);
+    }
+
+    // The union of the barrier names of all ranks, not all ranks call all barriers
+    std::string names;
+    for (const auto &entry : local)
+    {
+        names += entry.first + '\n';
+    }
+
+    int length = names.size();
+    std::vector<int> lengths(size), displs(size + 1, 0);
+    MPI_Allgather(&length, 1, MPI_INT, lengths.data(), 1, MPI_INT, comm);
+
+    for (int i = 0; i < size; ++i)
+    {
+        displs[i + 1] = displs[i] + lengths[i];
+    }
+
+    std::string allNames(displs[size], '\0');
+    MPI_Allgatherv(names.data(), length, MPI_CHAR, &allNames[0], lengths.data(),
+                   displs.data(), MPI_CHAR, comm);
+
+    std::set<std::string> unionNames;
+    for (size_t start = 0, stop; (stop = allNames.find('\n', start)) != std::string::npos; start = stop + 1)
+    {
+        unionNames.insert(allNames.substr(start, stop - start));
+    }
+
+    // No barrier was called by any rank since the last report
+    if (unionNames.empty()) return;
+
+    // Ranks not calling a barrier take no part in its minimum and maximum
+    struct DoubleInt
+    {
+        double value;
+        int rank;
+    };
+
+    const int nNames = unionNames.size();
+    std::vector<DoubleInt> minWait(nNames), maxWait(nNames);
+    std::vector<double> sums(3 * nNames);
+
+    int i = 0;
+    for (const std::string &name : unionNames)
+    {
+        auto found = local.find(name);
+        const bool called = found != local.end();
+        const double wait = called ? found->second.total : 0.0;
+
+        minWait[i] = {called ? wait : DBL_MAX, rank};
+        maxWait[i] = {called ? wait : -1.0, rank};
+        sums[i] = wait;
+        sums[nNames + i] = called ? found->second.count : 0;
+        sums[2 * nNames + i] = called;
+        ++i;
+    }
+
+    std::vector<DoubleInt> minAll(nNames), maxAll(nNames);
+    std::vector<double> sumsAll(3 * nNames);
+    MPI_Reduce(minWait.data(), minAll.data(), nNames, MPI_DOUBLE_INT, MPI_MINLOC, 0, comm);
+    MPI_Reduce(maxWait.data(), maxAll.data(), nNames, MPI_DOUBLE_INT, MPI_MAXLOC, 0, comm);
+    MPI_Reduce(sums.data(), sumsAll.data(), 3 * nNames, MPI_DOUBLE, MPI_SUM, 0, comm);
+
+    // The slowest rank of a barrier is a consolidation root or not
+    std::vector<int> roots(size);
+    int root = consolidationRoot;
+    MPI_Gather(&root, 1, MPI_INT, roots.data(), 1, MPI_INT, 0, comm);
+
+    long solves = nSolves.load(std::memory_order_relaxed);
+    MPI_Bcast(&solves, 1, MPI_LONG, 0, comm);
+
+    if (rank != 0) return;
+
+    const std::string base = prefix.empty() ? std::string("amgxwrapper") : prefix;
+    const std::string reportName = base + ".waits.txt";
+
+    // The first report of the run replaces the file of a previous run
+    FILE *report = fopen(reportName.c_str(), nReports == 0 ? "w" : "a");
+    if (report == nullptr)
+    {
+        fprintf(stderr, "Cannot open the barrier report %s.\n", reportName.c_str());
+        return;
+    }
+
+    ++nReports;
+
+    fprintf(report, "# report %d, after %ld solves, %d ranks\n", nReports, solves, size);
+    fprintf(report, "%-40s %8s %8s %12s %12s %12s %8s %8s\n", "barrier", "ranks", "calls",
+            "min [ms]", "mean [ms]", "max [ms]", "slowest", "root");
+
+    i = 0;
+    for (const std::string &name : unionNames)
+    {
+        // The calls and waits are those of one rank calling the barrier
+        const int nRanks = sumsAll[2 * nNames + i];
+
+        fprintf(report, "%-40s %8d %8.0f %12.3f %12.3f %12.3f %8d %8s\n", name.c_str(), nRanks,
+                sumsAll[nNames + i] / nRanks, minAll[i].value * 1e-3, sumsAll[i] / nRanks * 1e-3,
+                maxAll[i].value * 1e-3, minAll[i].rank, roots[minAll[i].rank] ? "yes" : "no");
+        ++i;
+    }
+
+    fprintf(report, "\n");
+    fclose(report);
+}
+
+void AmgXProfiler::write(MPI_Comm comm)
+{
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    // The peaks of the memories with traffic, measured before any file may fail to open
+    bool used[nMemories] = {false, false, false};
+    {
+        std::lock_guard<std::mutex> lock(threadsMutex);
+
+        for (auto &local : threads)
+        {
+            for (const ProfileTraffic &traffic : local->traffic)
+            {
+                used[(int)traffic.memory] = true;
+            }
+        }
+    }
+
+    measurePeaks(comm, used);
+
+    const std::string base = prefix.empty() ? std::string("amgxwrapper") : prefix;
+    const std::string traceName = base + "." + std::to_string(rank) + ".json";
+    const std::string summaryName = base + "." + std::to_string(rank) + ".txt";
+
+    // Total, maximum, count and traffic of each region name
+    struct Summary
+    {
+        double total = 0.0;
+        double max = 0.0;
+        long count = 0;
+        bool hasTraffic[nMemories] = {false, false, false};
+        double bytesRead[nMemories] = {0.0, 0.0, 0.0};
+        double bytesWritten[nMemories] = {0.0, 0.0, 0.0};
+        double flops[nMemories] = {0.0, 0.0, 0.0};
+    };
+
+    std::map<std::string, Summary> summaries;
+
+    FILE *trace = fopen(traceName.c_str(), "w");
+    if (trace == nullptr)
+    {
+        fprintf(stderr, "Cannot open the profile trace %s.\n", traceName.c_str());
+        return;
+    }
+
+    fprintf(trace, "{\"traceEvents\":[\n");
+
+    std::lock_guard<std::mutex> lock(threadsMutex);
+
+    const char *separator = "";
+    for (auto &local : threads)
+    {
+        // The traffic in the order of the events
+        std::vector<ProfileTraffic> traffic(local->traffic);
+        std::stable_sort(traffic.begin(), traffic.end(),
+            [](const ProfileTraffic &a, const ProfileTraffic &b)
+            {
+                return a.event < b.event;
+            });
+
+        auto next = traffic.begin();
+
+        for (size_t index = 0; index < local->events.size(); ++index)
+        {
+            const ProfileEvent &event = local->events[index];
+
+            auto first = next;
+            while (next != traffic.end() && next->event == index) ++next;
+
+            // Regions still open are not written
+            if (event.end < 0.0) continue;
+
+            const double duration = event.end - event.start;
+
+            fprintf(trace, "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d",
+                    separator, event.name, event.start, duration, rank, local->tid);
+            separator = ",\n";
+
+            Summary &summary = summaries[event.name];
+            summary.total += duration;
+            summary.max = std::max(summary.max, duration);
+            ++summary.count;
+
+            // The traffic of the region as arguments of the event
+            const char *argSeparator = ",\"args\":{";
+            for (auto t = first; t != next; ++t)
+            {
+                const int m = (int)t->memory;
+                fprintf(trace, "%s\"%s\":{\"bytesRead\":%.0f,\"bytesWritten\":%.0f,\"flops\":%.0f}",
+                        argSeparator, memoryNames[m], t->bytesRead, t->bytesWritten, t->flops);
+                argSeparator = ",";
+
+                summary.hasTraffic[m] = true;
+                summary.bytesRead[m] += t->bytesRead;
+                summary.bytesWritten[m] += t->bytesWritten;
+                summary.flops[m] += t->flops;
+            }
+
+            fprintf(trace, "%s}", first != next ? "}" : "");
+        }
+
+        // Keep the regions still open and their traffic, their indices must stay valid
+        std::vector<ProfileEvent> open;
+        std::vector<ProfileTraffic> openTraffic;
+        for (size_t &index : local->open)
+        {
+            for (ProfileTraffic t : local->traffic)
+            {
+                if (t.event != index) continue;
+
+                t.event = open.size();
+                openTraffic.push_back(t);
+            }
+
+            open.push_back(local->events[index]);
+            index = open.size() - 1;
+        }
+
+        local->events.swap(open);
+        local->traffic.swap(openTraffic);
+    }
+
+    fprintf(trace, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(trace);
+
+    // Regions sorted by total time
+    std::vector<std::pair<std::string, Summary>> sorted(summaries.begin(), summaries.end());
+    std::sort(sorted.begin(), sorted.end(),
+        [](const std::pair<std::string, Summary> &a, const std::pair<std::string, Summary> &b)
+        {
+            return a.second.total > b.second.total;
+        });
+
+    FILE *summary = fopen(summaryName.c_str(), "w");
+    if (summary == nullptr)
+    {
+        fprintf(stderr, "Cannot open the profile summary %s.\n", summaryName.c_str());
+        return;
+    }
+
+    fprintf(summary, "%-40s %10s %14s %14s %14s\n", "region", "count", "total [ms]", "mean [ms]", "max [ms]");
+    for (const auto &entry : sorted)
+    {
+        const Summary &s = entry.second;
+        fprintf(summary, "%-40s %10ld %14.3f %14.3f %14.3f\n", entry.first.c_str(), s.count,
+                s.total * 1e-3, s.total * 1e-3 / s.count, s.max * 1e-3);
+    }
+
+    if (used[0] || used[1] || used[2])
+    {
+        // Bytes per microsecond are 1e-3 GB/s
+        fprintf(summary, "\n# traffic computed from the sizes of the matrix, over the total time of each region\n");
+        fprintf(summary, "# peak bandwidth [GB/s]:");
+        for (int m = 0; m < nMemories; ++m)
+        {
+            if (!used[m]) continue;
+
+            if (peakBandwidth[m] > 0.0)
+                fprintf(summary, " %s %.2f", memoryNames[m], peakBandwidth[m] * 1e-3);
+            else
+                fprintf(summary, " %s -", memoryNames[m]);
+        }
+        if (used[(int)Memory::Host])
+        {
+            fprintf(summary, " (the host peak is shared by the %d ranks of the node)", nNodeRanks);
+        }
+        fprintf(summary, "\n");
+
+        fprintf(summary, "%-40s %-15s %12s %12s %12s %10s %10s %10s %10s\n", "region", "memory",
+                "read [MB]", "written [MB]", "MFLOP", "GB/s", "GFLOP/s", "flop/byte", "% peak");
+
+        for (const auto &entry : sorted)
+        {
+            const Summary &s = entry.second;
+
+            for (int m = 0; m < nMemories; ++m)
+            {
+                if (!s.hasTraffic[m]) continue;
+
+                const double bytes = s.bytesRead[m] + s.bytesWritten[m];
+                const double time = std::max(s.total, 1e-3);
+                const double bandwidth = bytes / time;
+
+                fprintf(summary, "%-40s %-15s %12.3f %12.3f %12.3f %10.2f %10.2f %10.3f ", entry.first.c_str(),
+                        memoryNames[m], s.bytesRead[m] * 1e-6, s.bytesWritten[m] * 1e-6, s.flops[m] * 1e-6,
+                        bandwidth * 1e-3, s.flops[m] / time * 1e-3, bytes > 0.0 ? s.flops[m] / bytes : 0.0);
+
+                if (peakBandwidth[m] > 0.0)
+                    fprintf(summary, "%10.1f\n", 100.0 * bandwidth / peakBandwidth[m]);
+                else
+                    fprintf(summary, "%10s\n", "-");
+            }
+        }
+    }
+
+    fclose(summary);
+}
@@ -0,0 +1,463 @@
+/*
+ * Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <AmgXRecorder.H>
+
+#include <cuda_runtime.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+bool AmgXRecorder::enabled = false;
+
+// File layout, all integers little-endian as written by the host:
+//   header: "AMGXREC1", int32 version, int32 nRanks
+//   event:  int32 type, int32 solver, int32 matrix,
+//           int32 n, n x int64 scalars,
+//           int32 n, n x (int64 length, chars) strings,
+//           int32 n, n x (int64 count, int32 data) index arrays,
+//           int32 n, n x (int32 element size, int64 count, data) value arrays
+namespace
+{
+
+const char magic[8] = {'A', 'M', 'G', 'X', 'R', 'E', 'C', '1'};
+const int32_t version = 1;
+
+std::mutex recordMutex;
+FILE *recordFile = nullptr;
+
+// The identifiers of the live solvers and matrices, and the next ones
+std::map<const void*, int> solverIds;
+std::map<const void*, int> matrixIds;
+int nextSolverId = 0;
+int nextMatrixId = 0;
+
+thread_local int pauseDepth = 0;
+
+// An array of the call, possibly in device memory
+struct RecordArray
+{
+    const void *data;
+    int32_t elementSize;
+    int64_t count;
+};
+
+void writeInt32(int32_t value)
+{
+    fwrite(&value, sizeof(value), 1, recordFile);
+}
+
+void writeInt64(int64_t value)
+{
+    fwrite(&value, sizeof(value), 1, recordFile);
+}
+
+// Writes an array, staging device arrays through the host
+void writeData(const void *data, size_t bytes)
+{
+    if (bytes == 0) return;
+
+    cudaPointerAttributes attributes;
+    if (cudaPointerGetAttributes(&attributes, data) == cudaSuccess
+        && attributes.type == cudaMemoryTypeDevice)
+    {
+        std::vector<char> staging(bytes);
+        cudaMemcpy(staging.data(), data, bytes, cudaMemcpyDefault);
+        fwrite(staging.data(), 1, bytes, recordFile);
+        return;
+    }
+
+    // Older runtimes fail on unregistered host memory
+    cudaGetLastError();
+    fwrite(data, 1, bytes, recordFile);
+}
+
+int idOf(std::map<const void*, int> &ids, const void *object)
+{
+    auto found = ids.find(object);
+    return (found == ids.end()) ? -1 : found->second;
+}
+
+void writeEvent(AmgXRecordType type, int solver, int matrix,
+                const std::vector<int64_t> &scalars,
+                const std::vector<std::string> &strings,
+                const std::vector<RecordArray> &indices,
+                const std::vector<RecordArray> &values)
+{
+    writeInt32((int32_t)type);
+    writeInt32(solver);
+    writeInt32(matrix);
+
+    writeInt32(scalars.size());
+    for (int64_t scalar : scalars)
+    {
+        writeInt64(scalar);
+    }
+
+    writeInt32(strings.size());
+    for (const std::string &string : strings)
+    {
+        writeInt64(string.size());
+        fwrite(string.data(), 1, string.size(), recordFile);
+    }
+
+    writeInt32(indices.size());
+    for (const RecordArray &array : indices)
+    {
+        writeInt64(array.count);
+        writeData(array.data, sizeof(int) * array.count);
+    }
+
+    writeInt32(values.size());
+    for (const RecordArray &array : values)
+    {
+        writeInt32(array.elementSize);
+        writeInt64(array.count);
+        writeData(array.data, array.elementSize * array.count);
+    }
+
+    // A crashed run keeps the calls before the crash
+    fflush(recordFile);
+}
+
+// Whether the call of the calling thread is recorded
+bool recording()
+{
+    return AmgXRecorder::isEnabled() && pauseDepth == 0 && recordFile != nullptr;
+}
+
+std::string readFile(const std::string &fileName)
+{
+    std::string contents;
+
+    FILE *file = fopen(fileName.c_str(), "rb");
+    if (file == nullptr) return contents;
+
+    char buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        contents.append(buffer, n);
+    }
+
+    fclose(file);
+    return contents;
+}
+
+}
+
+void AmgXRecorder::enable(const std::string &prefix)
+{
+    std::lock_guard<std::mutex> lock(recordMutex);
+
+    if (recordFile != nullptr) return;
+
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    const std::string fileName = prefix + "." + std::to_string(rank) + ".amgxrec";
+
+    recordFile = fopen(fileName.c_str(), "wb");
+    if (recordFile == nullptr)
+    {
+        fprintf(stderr, "Cannot open the recording %s.\n", fileName.c_str());
+        return;
+    }
+
+    fwrite(magic, 1, sizeof(magic), recordFile);
+    writeInt32(version);
+    writeInt32(size);
+
+    enabled = true;
+}
+
+void AmgXRecorder::disable()
+{
+    std::lock_guard<std::mutex> lock(recordMutex);
+
+    enabled = false;
+
+    if (recordFile != nullptr)
+    {
+        fclose(recordFile);
+        recordFile = nullptr;
+    }
+
+    solverIds.clear();
+    matrixIds.clear();
+}
+
+void AmgXRecorder::recordInitialize(const void *solver, const std::string &modeStr,
+                                    const std::string &cfgFile)
+{
+    std::lock_guard<std::mutex> lock(recordMutex);
+    if (!recording()) return;
+
+    const int id = solverIds[solver] = nextSolverId++;
+
+    writeEvent(AmgXRecordType::Initialize, id, -1, {},
+               {modeStr, cfgFile, readFile(cfgFile)}, {}, {});
+}
+
+void AmgXRecorder::recordInitialiseMatrix(const void *solver, const void *matrix)
+{
+    std::lock_guard<std::mutex> lock(recordMutex);
+    if (!recording()) return;
+
+    // A matrix initialised again keeps its identifier
+    if (matrixIds.find(matrix) == matrixIds.end())
+    {
+        matrixIds[matrix] = nextMatrixId++;
+    }
+
+    writeEvent(AmgXRecordType::InitialiseMatrix, idOf(solverIds, solver),
+               matrixIds[matrix], {}, {}, {}, {});
+}
+
+template<typename T>
+void AmgXRecorder::recordSetValuesLDU(const void *matrix, int nLocalRows, int nInternalFaces,
+                                      int diagIndexGlobal, int lowOffGlobal, int uppOffGlobal,
+                                      const int *upperAddr, const int *lowerAddr, int nExtNz,
+                                      const int *extRow, const int *extCol, const T *diagVals,
+                                      const T *upperVals, const T *lowerVals, const T *extVals)
+{
+    std::lock_guard<std::mutex> lock(recordMutex);
+    if (!recording()) return;
+
+    writeEvent(AmgXRecordType::SetValuesLDU, -1, idOf(matrixIds, matrix),
+               {nLocalRows, nInternalFaces, diagIndexGlobal, lowOffGlobal, uppOffGlobal, nExtNz},
+               {},
+               {{upperAddr, sizeof(int), nInternalFaces}, {lowerAddr, sizeof(int), nInternalFaces},
+                {extRow, sizeof(int), nExtNz}, {extCol, sizeof(int), nExtNz}},
+               {{diagVals, sizeof(T), nLocalRows}, {upperVals, sizeof(T), nInternalFaces},
+                {lowerVals, sizeof(T), nInternalFaces}, {extVals, sizeof(T), nExtNz}});
+}
+
+template<typename T>
+void AmgXRecorder::recordUpdateValues(const void *matrix, int nLocalRows, int nInternalFaces,
+                                      int nExtNz, const T *diagVals, const T *upperVals,
+                                      const T *lowerVals, const T *extVals)
+{
+    std::lock_guard<std::mutex> lock(recordMutex);
+    if (!recording()) return;
+
+    writeEvent(AmgXRecordType::UpdateValues, -1, idOf(matrixIds, matrix),
+               {nLocalRows, nInternalFaces, nExtNz}, {}, {},
+               {{diagVals, sizeof(T), nLocalRows}, {upperVals, sizeof(T), nInternalFaces},
+                {lowerVals, sizeof(T), nInternalFaces}, {extVals, sizeof(T), nExtNz}});
+}
+
+template void AmgXRecorder::recordSetValuesLDU<float>(const void*, int, int, int, int, int,
+    const int*, const int*, int, const int*, const int*, const float*, const float*,
+    const float*, const float*);
+template void AmgXRecorder::recordSetValuesLDU<double>(const void*, int, int, int, int, int,
+    const int*, const int*, int, const int*, const int*, const double*, const double*,
+    const double*, const double*);
+template void AmgXRecorder::recordUpdateValues<float>(const void*, int, int, int,
+    const float*, const float*, const float*, const float*);
+template void AmgXRecorder::recordUpdateValues<double>(const void*, int, int, int,
+    const double*, const double*, const double*, const double*);
+
+void AmgXRecorder::recordSetOperator(const void *solver, const void *matrix, int nLocalRows,
+                                     int nGlobalRows, int nLocalNz)
+{
+    std::lock_guard<std::mutex> lock(recordMutex);
+    if (!recording()) return;
+
+    writeEvent(AmgXRecordType::SetOperator, idOf(solverIds, solver), idOf(matrixIds, matrix),
+               {nLocalRows, nGlobalRows, nLocalNz}, {}, {}, {});
+}
+
+void AmgXRecorder::recordUpdateOperator(const void *solver, const void *matrix, int nLocalRows,
+                                        int nLocalNz)
+{
+    std::lock_guard<std::mutex> lock(recordMutex);
+    if (!recording()) return;
+
+    writeEvent(AmgXRecordType::UpdateOperator, idOf(solverIds, solver), idOf(matrixIds, matrix),
+               {nLocalRows, nLocalNz}, {}, {}, {});
+}
+
+void AmgXRecorder::recordSolve(const void *solver, const void *matrix, int nLocalRows,
+                               const double *pscalar, const double *bscalar)
+{
+    std::lock_guard<std::mutex> lock(recordMutex);
+    if (!recording()) return;
+
+    writeEvent(AmgXRecordType::Solve, idOf(solverIds, solver), idOf(matrixIds, matrix),
+               {nLocalRows}, {}, {},
+               {{pscalar, sizeof(double), nLocalRows}, {bscalar, sizeof(double), nLocalRows}});
+}
+
+void AmgXRecorder::recordLoadSnapshot(const void *matrix, const std::string &fileName)
+{
+    std::lock_guard<std::mutex> lock(recordMutex);
+    if (!recording()) return;
+
+    writeEvent(AmgXRecordType::LoadSnapshot, -1, idOf(matrixIds, matrix), {},
+               {fileName, readFile(fileName)}, {}, {});
+}
+
+void AmgXRecorder::recordFinaliseMatrix(const void *matrix)
+{
+    std::lock_guard<std::mutex> lock(recordMutex);
+    if (!recording()) return;
+
+    const int id = idOf(matrixIds, matrix);
+    if (id < 0) return;
+
+    writeEvent(AmgXRecordType::FinaliseMatrix, -1, id, {}, {}, {}, {});
+    matrixIds.erase(matrix);
+}
+
+void AmgXRecorder::recordFinalize(const void *solver)
+{
+    std::lock_guard<std::mutex> lock(recordMutex);
+    if (!recording()) return;
+
+    writeEvent(AmgXRecordType::Finalize, idOf(solverIds, solver), -1, {}, {}, {}, {});
+    solverIds.erase(solver);
+}
+
+AmgXRecordPause::AmgXRecordPause()
+{
+    ++pauseDepth;
+}
+
+AmgXRecordPause::~AmgXRecordPause()
+{
+    --pauseDepth;
+}
+
+bool AmgXRecordPause::isPaused()
+{
+    return pauseDepth > 0;
+}
+
+AmgXRecordReader::AmgXRecordReader(const std::string &fileName)
+{
+    file = fopen(fileName.c_str(), "rb");
+    if (file == nullptr)
+    {
+        fprintf(stderr, "Cannot open the recording %s.\n", fileName.c_str());
+        exit(0);
+    }
+
+    char header[sizeof(magic)];
+    int32_t fileVersion = 0, size = 0;
+    if (fread(header, 1, sizeof(header), file) != sizeof(header)
+        || memcmp(header, magic, sizeof(magic)) != 0
+        || fread(&fileVersion, sizeof(fileVersion), 1, file) != 1
+        || fileVersion != version
+        || fread(&size, sizeof(size), 1, file) != 1)
+    {
+        fprintf(stderr, "%s is not a recording of version %d.\n", fileName.c_str(), version);
+        exit(0);
+    }
+
+    nRanks = size;
+}
+
+AmgXRecordReader::~AmgXRecordReader()
+{
+    if (file != nullptr) fclose(file);
+}
+
+bool AmgXRecordReader::next(AmgXRecordEvent &event)
+{
+    int32_t header[3];
+    if (fread(header, sizeof(int32_t), 3, file) != 3) return false;
+
+    event = AmgXRecordEvent();
+    event.type = (AmgXRecordType)header[0];
+    event.solver = header[1];
+    event.matrix = header[2];
+
+    bool complete = true;
+    auto read = [&](void *data, size_t size, size_t count)
+    {
+        complete = complete && fread(data, size, count, file) == count;
+    };
+
+    int32_t n = 0;
+    read(&n, sizeof(n), 1);
+    event.scalars.resize(complete ? n : 0);
+    for (long &scalar : event.scalars)
+    {
+        int64_t value = 0;
+        read(&value, sizeof(value), 1);
+        scalar = value;
+    }
+
+    read(&n, sizeof(n), 1);
+    event.strings.resize(complete ? n : 0);
+    for (std::string &string : event.strings)
+    {
+        int64_t length = 0;
+        read(&length, sizeof(length), 1);
+        string.resize(complete ? length : 0);
+        if (!string.empty()) read(&string[0], 1, string.size());
+    }
+
+    read(&n, sizeof(n), 1);
+    event.indices.resize(complete ? n : 0);
+    for (std::vector<int> &array : event.indices)
+    {
+        int64_t count = 0;
+        read(&count, sizeof(count), 1);
+        array.resize(complete ? count : 0);
+        if (!array.empty()) read(array.data(), sizeof(int), array.size());
+    }
+
+    read(&n, sizeof(n), 1);
+    for (int32_t i = 0; complete && i < n; ++i)
+    {
+        int32_t elementSize = 0;
+        int64_t count = 0;
+        read(&elementSize, sizeof(elementSize), 1);
+        read(&count, sizeof(count), 1);
+        if (!complete) break;
+
+        if (elementSize == sizeof(float))
+        {
+            event.floats.emplace_back(count);
+            if (count > 0) read(event.floats.back().data(), sizeof(float), count);
+        }
+        else
+        {
+            event.doubles.emplace_back(count);
+            if (count > 0) read(event.doubles.back().data(), sizeof(double), count);
+        }
+    }
+
+    // A call cut by the end of the file, e.g. after a crash, is dropped
+    if (!complete)
+    {
+        fprintf(stderr, "The recording ends within a call, the call is ignored.\n");
+    }
+
+    return complete;
+}
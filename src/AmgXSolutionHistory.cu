@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <AmgXSolutionHistory.H>
+
+#include <algorithm>
+
+double AmgXSolutionHistory::nextTime() const
+{
+    return times.empty() ? 0.0 : times.back() + 1.0;
+}
+
+// Extrapolate the stored solutions to the given time
+bool AmgXSolutionHistory::extrapolate
+(
+    InitialGuessMode mode,
+    double time,
+    int n,
+    double *x
+) const
+{
+    const int nStored = times.size();
+
+    // Only the first solve of a new time level is extrapolated
+    if (mode == InitialGuessMode::None || nStored < 2 || time <= times.back())
+    {
+        return false;
+    }
+
+    // A change of size (e.g. a topology change) invalidates the history
+    if ((int)solutions.back().size() != n)
+    {
+        return false;
+    }
+
+    int nUsed = 0;
+
+    switch (mode)
+    {
+    case InitialGuessMode::Linear:
+        nUsed = 2;
+        break;
+    case InitialGuessMode::Quadratic:
+        nUsed = std::min(3, nStored);
+        break;
+    case InitialGuessMode::LeastSquares:
+        nUsed = nStored;
+        break;
+    default:
+        return false;
+    }
+
+    const int first = nStored - nUsed;
+
+    // The guess is a weighted sum of the stored solutions, x = sum_k w_k x_k
+    std::vector<double> weights(nUsed, 1.0);
+
+    if (mode == InitialGuessMode::LeastSquares)
+    {
+        // Linear least-squares fit in time, evaluated at the new time
+        double mean = 0.0;
+        for (int k = 0; k < nUsed; ++k)
+        {
+            mean += times[first + k];
+        }
+        mean /= nUsed;
+
+        double spread = 0.0;
+        for (int k = 0; k < nUsed; ++k)
+        {
+            spread += (times[first + k] - mean) * (times[first + k] - mean);
+        }
+
+        if (spread <= 0.0)
+        {
+            return false;
+        }
+
+        for (int k = 0; k < nUsed; ++k)
+        {
+            weights[k] = 1.0 / nUsed + (time - mean) * (times[first + k] - mean) / spread;
+        }
+    }
+    else
+    {
+        // Lagrange polynomial through the stored levels, evaluated at the new time
+        for (int k = 0; k < nUsed; ++k)
+        {
+            for (int j = 0; j < nUsed; ++j)
+            {
+                if (j == k) continue;
+
+                const double dt = times[first + k] - times[first + j];
+                if (dt == 0.0)
+                {
+                    return false;
+                }
+
+                weights[k] *= (time - times[first + j]) / dt;
+            }
+        }
+    }
+
+    const double *x0 = solutions[first].data();
+    for (int i = 0; i < n; ++i)
+    {
+        x[i] = weights[0] * x0[i];
+    }
+
+    for (int k = 1; k < nUsed; ++k)
+    {
+        const double *xk = solutions[first + k].data();
+        const double wk = weights[k];
+
+        for (int i = 0; i < n; ++i)
+        {
+            x[i] += wk * xk[i];
+        }
+    }
+
+    return true;
+}
+
+// Store the solution of the given time level
+void AmgXSolutionHistory::store
+(
+    double time,
+    int n,
+    const double *x,
+    int nLevels
+)
+{
+    // A change of size (e.g. a topology change) invalidates the history
+    if (!solutions.empty() && (int)solutions.back().size() != n)
+    {
+        clear();
+    }
+
+    // Solves within the same time level overwrite the last stored solution
+    if (times.empty() || time > times.back())
+    {
+        std::vector<double> storage;
+
+        // Recycle the storage of the oldest levels once the history is full
+        while ((int)times.size() >= std::max(nLevels, 1))
+        {
+            storage = std::move(solutions.front());
+            solutions.pop_front();
+            times.pop_front();
+        }
+
+        solutions.push_back(std::move(storage));
+        times.push_back(time);
+    }
+    else if (time < times.back())
+    {
+        // Time went backwards (e.g. a restart from an earlier time)
+        clear();
+        solutions.emplace_back();
+        times.push_back(time);
+    }
+
+    solutions.back().assign(x, x + n);
+}
+
+void AmgXSolutionHistory::clear()
+{
+    solutions.clear();
+    times.clear();
+}
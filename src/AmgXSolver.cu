@@ -11,15 +11,70 @@
 
 // AmgXWrapper
 #include "AmgXSolver.H"
+#include <algorithm>
 #include <numeric>
 #include <limits>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+
+// Read the parameters of an AmgX config file as a string for AMGX_config_create:
+// a JSON file as it is, a file of parameter lines without its comments and with
+// its lines separated by commas
+bool readConfigParameters(const std::string &cfgFile, std::string &parameters)
+{
+    std::ifstream in(cfgFile);
+    if (!in) return false;
+
+    std::stringstream contents;
+    contents << in.rdbuf();
+    parameters = contents.str();
+
+    const size_t first = parameters.find_first_not_of(" \t\r\n");
+    if (first != std::string::npos && parameters[first] == '{') return true;
+
+    std::string line;
+    std::string joined;
+    std::istringstream lines(parameters);
+
+    while (std::getline(lines, line))
+    {
+        line = line.substr(0, line.find('#'));
+
+        const size_t begin = line.find_first_not_of(" \t\r");
+        if (begin == std::string::npos) continue;
+
+        const size_t end = line.find_last_not_of(" \t\r,");
+        if (end < begin) continue;
+
+        if (!joined.empty()) joined += ", ";
+        joined += line.substr(begin, end - begin + 1);
+    }
+
+    parameters = joined;
+    return true;
+}
+
+}
 
 // initialize AmgXSolver::count to 0
 int AmgXSolver::count = 0;
 
+// initialize AmgXSolver::nInitialised to 0
+int AmgXSolver::nInitialised = 0;
+
+// initialize AmgXSolver::nAmgXInstances to 0
+int AmgXSolver::nAmgXInstances = 0;
+
 // initialize AmgXSolver::rsrc to nullptr;
 AMGX_resources_handle AmgXSolver::rsrc = nullptr;
 
+// initialize AmgXSolver::rsrcLayout to none
+std::shared_ptr<AmgXCommLayout> AmgXSolver::rsrcLayout;
+
 
 /* \implements AmgXSolver::AmgXSolver */
 AmgXSolver::AmgXSolver(const MPI_Comm &comm,
@@ -29,6 +84,13 @@ AmgXSolver::AmgXSolver(const MPI_Comm &comm,
 }
 
 
+/* \implements AmgXSolver::AmgXSolver */
+AmgXSolver::AmgXSolver(const AmgXSolver &shared, const std::string &cfgFile)
+{
+    initialize(shared, cfgFile);
+}
+
+
 /* \implements AmgXSolver::~AmgXSolver */
 AmgXSolver::~AmgXSolver()
 {
@@ -50,6 +112,23 @@ void AmgXSolver::initialize(const MPI_Comm &comm,
 
     // increase the number of AmgXSolver instances
     count += 1;
+    instanceId = nInitialised++;
+
+    // the first instance enables the profiler if requested by the environment
+    const char* profilePrefix = std::getenv("AMGX_WRAPPER_PROFILE");
+    if (count == 1 && profilePrefix != nullptr && !AmgXProfiler::isEnabled())
+    {
+        AmgXProfiler::enable(profilePrefix);
+    }
+
+    // the first instance enables the recorder if requested by the environment
+    const char* recordPrefix = std::getenv("AMGX_WRAPPER_RECORD");
+    if (count == 1 && recordPrefix != nullptr && !AmgXRecorder::isEnabled())
+    {
+        AmgXRecorder::enable(recordPrefix);
+    }
+
+    AMGX_PROFILE_SCOPE("initialize");
 
     // get the name of this node
     int     len;
@@ -60,25 +139,87 @@ void AmgXSolver::initialize(const MPI_Comm &comm,
     // get the mode of AmgX solver
     setMode(modeStr);  
 
-    // initialize communicators and corresponding information
-    initMPIcomms(comm);  
+    // the communicators and AmgX are set up on first use, so the config file
+    // is read now in case it is removed before
+    userComm = comm;
+    this->cfgFile = cfgFile;
 
-    // only processes in gpuWorld are required to initialize AmgX
-    if (gpuProc == 0)
+    if (!readConfigParameters(cfgFile, cfgParameters))
     {
-        initAmgX(cfgFile);  
+        fprintf(stderr, "The AmgX config file %s cannot be read.\n", cfgFile.c_str());
+        exit(0);
     }
 
     // a bool indicating if this instance is initialized
     isInitialised = true;
 
+    if (std::getenv("AMGX_WRAPPER_EAGER_INIT") != nullptr)
+    {
+        requireAmgX();
+    }
+
+    AmgXRecorder::recordInitialize(this, modeStr, cfgFile);
+
     return;
 }
 
+
+/* \implements AmgXSolver::initialize */
+void AmgXSolver::initialize(const AmgXSolver &shared, const std::string &cfgFile)
+{
+    // if this instance has already been initialized, skip
+    if (isInitialised) {
+        fprintf(stderr,
+                "This AmgXSolver instance has been initialized on this process.\n");
+        exit(0);
+    }
+
+    if (!shared.isInitialised) {
+        fprintf(stderr,
+                "The shared AmgXSolver instance has not been initialized.\n");
+        exit(0);
+    }
+
+    // increase the number of AmgXSolver instances
+    count += 1;
+    instanceId = nInitialised++;
+
+    nodeName = shared.nodeName;
+    mode = shared.mode;
+
+    // the communicators of the shared instance are duplicated on first use, without splitting them again
+    userComm = shared.userComm;
+    layout = shared.layout;
+    this->cfgFile = cfgFile;
+
+    if (!readConfigParameters(cfgFile, cfgParameters))
+    {
+        fprintf(stderr, "The AmgX config file %s cannot be read.\n", cfgFile.c_str());
+        exit(0);
+    }
+
+    isInitialised = true;
+
+    if (std::getenv("AMGX_WRAPPER_EAGER_INIT") != nullptr)
+    {
+        requireAmgX();
+    }
+
+    AmgXRecorder::recordInitialize(this, getModeString(), cfgFile);
+}
+
 void AmgXSolver::initialiseMatrixComms(
     AmgXCSRMatrix& matrix)
 {
-    matrix.initialiseComms(devWorld, gpuProc);
+    // the duplicate of devWorld is a collective on the communicator of the enqueued solves
+    waitAsync();
+
+    requireComms();
+
+    matrix.initialiseComms(devWorld, gpuProc,
+        isHostMode() ? MatrixLocation::Host : MatrixLocation::Device);
+
+    AmgXRecorder::recordInitialiseMatrix(this, &matrix);
 }
 
 /* \implements AmgXSolver::setMode */
@@ -90,25 +231,72 @@ void AmgXSolver::setMode(const std::string &modeStr)
         mode = AMGX_mode_dDFI;
     else if (modeStr == "dFFI")
         mode = AMGX_mode_dFFI;
-    else if (modeStr[0] == 'h') {
-        printf("CPU mode, %s, is not supported in this wrapper!",
-                modeStr.c_str());
-        exit(0);
-    }
+    else if (modeStr == "hDDI")
+        mode = AMGX_mode_hDDI;
+    else if (modeStr == "hDFI")
+        mode = AMGX_mode_hDFI;
+    else if (modeStr == "hFFI")
+        mode = AMGX_mode_hFFI;
     else {
         printf("%s is not an available mode! Available modes are: "
-                "dDDI, dDFI, dFFI.\n", modeStr.c_str());
+                "dDDI, dDFI, dFFI, hDDI, hDFI, hFFI.\n", modeStr.c_str());
         exit(0);
     }
 }
 
 
+/* \implements AmgXSolver::isHostMode */
+bool AmgXSolver::isHostMode() const
+{
+    return mode == AMGX_mode_hDDI || mode == AMGX_mode_hDFI || mode == AMGX_mode_hFFI;
+}
+
+
+/* \implements AmgXSolver::getModeString */
+std::string AmgXSolver::getModeString() const
+{
+    switch (mode)
+    {
+        case AMGX_mode_dDDI: return "dDDI";
+        case AMGX_mode_dDFI: return "dDFI";
+        case AMGX_mode_dFFI: return "dFFI";
+        case AMGX_mode_hDDI: return "hDDI";
+        case AMGX_mode_hDFI: return "hDFI";
+        case AMGX_mode_hFFI: return "hFFI";
+        default: return "";
+    }
+}
+
+
+/* \implements AmgXSolver::requireAmgX */
+void AmgXSolver::requireAmgX()
+{
+    if (amgxReady) return;
+
+    requireComms();
+
+    // only processes in gpuWorld are required to initialize AmgX
+    if (gpuProc == 0)
+    {
+        AMGX_PROFILE_SCOPE("initialize:amgx");
+        initAmgX(cfgParameters);
+    }
+
+    amgxReady = true;
+}
+
+
 /* \implements AmgXSolver::initAmgX */
- void AmgXSolver::initAmgX(const std::string &cfgFile)
+ void AmgXSolver::initAmgX(const std::string &cfgParameters)
 {
     // only the first instance (AmgX solver) is in charge of initializing AmgX
-    if (count == 1)
+    const bool first = (nAmgXInstances == 0);
+    ++nAmgXInstances;
+
+    if (first)
     {
+        AMGX_PROFILE_SCOPE("initialize:library");
+
         // initialize AmgX
         AMGX_SAFE_CALL(AMGX_initialize());
 
@@ -124,24 +312,41 @@ void AmgXSolver::setMode(const std::string &modeStr)
         AMGX_SAFE_CALL(AMGX_install_signal_handler());
     }
 
-    // create an AmgX configure object
-    AMGX_SAFE_CALL(AMGX_config_create_from_file(&cfg, cfgFile.c_str()));
+    AMGX_PROFILE_BEGIN(configScope, "initialize:config");
+
+    // create an AmgX configure object, from the parameters read by initialize
+    AMGX_SAFE_CALL(AMGX_config_create(&cfg, cfgParameters.c_str()));
 
     // let AmgX handle returned error codes internally
     AMGX_SAFE_CALL(AMGX_config_add_parameters(&cfg, "exception_handling=1"));
 
-    // create an AmgX resource object, only the first instance is in charge
-    if (count == 1) AMGX_resources_create(&rsrc, cfg, &gpuWorld, 1, &devID);
+    // keep the residual of each iteration for the solve records
+    AMGX_SAFE_CALL(AMGX_config_add_parameters(&cfg, "store_res_history=1"));
+
+    AMGX_PROFILE_END(configScope);
+
+    // create an AmgX resource object, only the first instance is in charge;
+    // the layout keeps the communicator of the resources until they are destroyed
+    if (first)
+    {
+        AMGX_PROFILE_SCOPE("initialize:resources");
+        rsrcLayout = layout;
+        AMGX_resources_create(&rsrc, cfg, &rsrcLayout->gpuWorld, 1, &devID);
+    }
+
+    AMGX_PROFILE_SCOPE("initialize:objects");
 
     // create AmgX vector object for unknowns and RHS
     AMGX_vector_create(&AmgXP, rsrc, mode);
     AMGX_vector_create(&AmgXRHS, rsrc, mode);
+    AMGX_vector_create(&AmgXAx, rsrc, mode);
 
     // create AmgX matrix object for unknowns and RHS
     AMGX_matrix_create(&AmgXA, rsrc, mode);
 
     // create an AmgX solver object
     AMGX_solver_create(&solver, rsrc, mode, cfg);
+    activeSolver = solver;
 
     // obtain the default number of rings based on current configuration
     AMGX_config_get_default_number_of_rings(cfg, &ring);
@@ -159,10 +364,16 @@ void AmgXSolver::finalize()
         exit(0);
     }
 
+    // enqueued solves must complete before the AmgX objects are destroyed
+    stopAsyncWorker();
+
+    AmgXRecorder::recordFinalize(this);
+
     // only processes using GPU are required to destroy AmgX content
-    if (gpuProc == 0)
+    if (gpuProc == 0 && amgxReady)
     {
-        // destroy solver instance
+        // destroy solver instances
+        destroyVariants();
         AMGX_solver_destroy(solver);
 
         // destroy matrix instance
@@ -171,31 +382,69 @@ void AmgXSolver::finalize()
         // destroy RHS and unknown vectors
         AMGX_vector_destroy(AmgXP);
         AMGX_vector_destroy(AmgXRHS);
+        AMGX_vector_destroy(AmgXAx);
 
         // only the last instance need to destroy resource and finalizing AmgX
-        if (count == 1)
+        if (nAmgXInstances == 1)
         {
             AMGX_resources_destroy(rsrc);
             AMGX_SAFE_CALL(AMGX_config_destroy(cfg));
 
             AMGX_SAFE_CALL(AMGX_finalize_plugins());
             AMGX_SAFE_CALL(AMGX_finalize());
+
+            rsrc = nullptr;
+            rsrcLayout.reset();
         }
         else
         {
             AMGX_config_destroy(cfg);
         }
 
-        // destroy gpuWorld
-        MPI_Comm_free(&gpuWorld);  
+        --nAmgXInstances;
+    }
+
+    // the last instance writes the profile requested by the environment,
+    // on the communicators it sets up if it was never used
+    if (count == 1 && AmgXProfiler::isEnabled() && std::getenv("AMGX_WRAPPER_PROFILE") != nullptr)
+    {
+        requireComms();
+        AmgXProfiler::reportWaits(globalCpuWorld, gpuProc == 0);
+        AmgXProfiler::write(globalCpuWorld);
+        AmgXProfiler::disable();
+    }
+
+    // the last instance closes the recording requested by the environment
+    if (count == 1 && AmgXRecorder::isEnabled() && std::getenv("AMGX_WRAPPER_RECORD") != nullptr)
+    {
+        AmgXRecorder::disable();
+    }
+
+    // free the duplicates of this instance, or give the communicators back to the layout,
+    // which frees them with its last user
+    if (commsReady)
+    {
+        if (ownsComms)
+        {
+            if (gpuWorld != MPI_COMM_NULL) MPI_Comm_free(&gpuWorld);
+            MPI_Comm_free(&globalCpuWorld);
+            MPI_Comm_free(&localCpuWorld);
+            MPI_Comm_free(&devWorld);
+        }
+        else
+        {
+            layout->borrowed = false;
+        }
     }
 
     // re-set necessary variables in case users want to reuse
     // the variable of this instance for a new instance
     gpuProc = MPI_UNDEFINED;
-    MPI_Comm_free(&globalCpuWorld);
-    MPI_Comm_free(&localCpuWorld);
-    MPI_Comm_free(&devWorld);
+    layout.reset();
+    userComm = MPI_COMM_NULL;
+    commsReady = false;
+    amgxReady = false;
+    ownsComms = false;
 
     // decrease the number of instances
     count -= 1;
@@ -213,6 +462,15 @@ void AmgXSolver::setOperator
     AmgXCSRMatrix& matrix
 )
 {
+    // Enqueued solves still use the current matrix
+    waitAsync();
+
+    AMGX_PROFILE_SCOPE("setOperator");
+
+    // the first use of this instance sets up the communicators and AmgX
+    requireAmgX();
+
+    AmgXRecorder::recordSetOperator(this, &matrix, nLocalRows, nGlobalRows, nLocalNz);
 
     // Check the matrix size is not larger than tolerated by AmgX
     if(nGlobalRows > std::numeric_limits<int>::max())
@@ -236,10 +494,16 @@ void AmgXSolver::setOperator
         exit(0);
     }
 
+    // the solvers of parameter overrides are set up again when next used
+    ++operatorVersion;
+    ++structureVersion;
+
     // upload matrix A to AmgX
     if (gpuWorld != MPI_COMM_NULL)
     {
-        MPI_Barrier(gpuWorld);  
+        AmgXProfiler::barrier(gpuWorld, "setOperator:barrier gpuWorld");
+
+        AMGX_PROFILE_BEGIN(uploadScope, "setOperator:upload");
 
         AMGX_distribution_handle dist;
         AMGX_distribution_create(&dist, cfg);
@@ -266,15 +530,34 @@ void AmgXSolver::setOperator
 
         AMGX_distribution_destroy(dist);
 
-        // bind the matrix A to the solver
-        AMGX_solver_setup(solver, AmgXA);
+        // In the host modes AmgX copies the CSR arrays in host memory
+        if (matrix.isOnHost())
+        {
+            const double bytes = 4.0 * (nRows + 1) + 12.0 * nNz;
+            AMGX_PROFILE_TRAFFIC(Host, bytes, bytes, 0.0);
+        }
+
+        AMGX_PROFILE_END(uploadScope);
+
+        // bind the matrix A to the solver, unless the solves use the solvers of overrides
+        if (overrides.empty())
+        {
+            AMGX_PROFILE_BEGIN(setupScope, "setOperator:setup");
+            setupSolver(solver, solverSetupVersion, solverStructureVersion);
+            AMGX_PROFILE_END(setupScope);
+        }
 
         // connect (bind) vectors to the matrix
         AMGX_vector_bind(AmgXP, AmgXA);
         AMGX_vector_bind(AmgXRHS, AmgXA);
+        AMGX_vector_bind(AmgXAx, AmgXA);
     }
 
-    MPI_Barrier(globalCpuWorld);  
+    // the recycled subspace belongs to the previous operator
+    recycleU.clear();
+    recycleC.clear();
+
+    AmgXProfiler::barrier(globalCpuWorld, "setOperator:barrier globalCpuWorld");
 }
 
 
@@ -286,19 +569,49 @@ void AmgXSolver::updateOperator
     AmgXCSRMatrix& matrix
 )
 {
+    // Enqueued solves still use the current coefficients
+    waitAsync();
+
+    AMGX_PROFILE_SCOPE("updateOperator");
+
+    requireAmgX();
+
+    AmgXRecorder::recordUpdateOperator(this, &matrix, nLocalRows, nLocalNz);
+
     const int nRows = (matrix.isConsolidated()) ? matrix.getNConsRows() : nLocalRows;
     const int nNz = (matrix.isConsolidated()) ? matrix.getNConsNz() : nLocalNz;
 
+    // the solvers of parameter overrides are set up again when next used
+    ++operatorVersion;
+
     // Replace the coefficients for the CSR matrix A within AmgX
     if (gpuWorld != MPI_COMM_NULL)
     {
+        AMGX_PROFILE_BEGIN(replaceScope, "updateOperator:replace");
         AMGX_matrix_replace_coefficients(AmgXA, nRows, nNz, matrix.getValues(), nullptr);
+        if (matrix.isOnHost())
+        {
+            AMGX_PROFILE_TRAFFIC(Host, 8.0 * nNz, 8.0 * nNz, 0.0);
+        }
+        AMGX_PROFILE_END(replaceScope);
+
+        // Re-setup the solver (a reduced overhead setup that accounts for consistent matrix structure),
+        // unless the solves use the solvers of overrides
+        if (overrides.empty())
+        {
+            AMGX_PROFILE_BEGIN(setupScope, "updateOperator:setup");
+            setupSolver(solver, solverSetupVersion, solverStructureVersion);
+            AMGX_PROFILE_END(setupScope);
+        }
+    }
 
-        // Re-setup the solver (a reduced overhead setup that accounts for consistent matrix structure)
-        AMGX_solver_resetup(solver, AmgXA);
+    // the images of the recycled vectors must follow the new coefficients
+    if (recycleMax > 0)
+    {
+        refreshRecycled(nLocalRows, matrix);
     }
 
-    MPI_Barrier(globalCpuWorld);
+    AmgXProfiler::barrier(globalCpuWorld, "updateOperator:barrier globalCpuWorld");
 }
 
 /* \implements AmgXSolver::solve */
@@ -323,11 +636,130 @@ void AmgXSolver::updateOperator
 void AmgXSolver::solve(
     int nLocalRows, double* pscalar, const double* bscalar, AmgXCSRMatrix& matrix)
 {
+    // Solves must run in the order they were requested
+    waitAsync();
+    requireAmgX();
+
+    AmgXRecorder::recordSolve(this, &matrix, nLocalRows, pscalar, bscalar);
+
+    solveNow(nLocalRows, pscalar, bscalar, matrix);
+}
+
+
+/* \implements AmgXSolver::solveViews */
+void AmgXSolver::solveViews(int nLocalRows, AmgXCSRMatrix& matrix)
+{
+    // Solves must run in the order they were requested
+    waitAsync();
+    requireAmgX();
+
+    if (!matrix.hasVectorViews())
+    {
+        fprintf(stderr, "The vector views of the matrix have not been created.\n");
+        return;
+    }
+
+    // replayed as a solve with the contents of the views
+    AmgXRecorder::recordSolve(this, &matrix, nLocalRows,
+        matrix.getSolutionView(), matrix.getRHSView());
+
+    solveNow(nLocalRows, matrix.getSolutionView(), matrix.getRHSView(), matrix);
+}
+
+
+/* \implements AmgXSolver::solveRegions */
+void AmgXSolver::solveRegions(
+    int nRegions, double* const* pscalars, const double* const* bscalars, AmgXCSRMatrix& matrix)
+{
+    const std::vector<int>& offsets = matrix.getRegionOffsets();
+
+    if ((int)offsets.size() != nRegions + 1)
+    {
+        fprintf(stderr, "The matrix has not been assembled from %d regions.\n", nRegions);
+        return;
+    }
+
+    const int nLocalRows = offsets[nRegions];
+    std::vector<double> p(nLocalRows);
+    std::vector<double> b(nLocalRows);
+
+    for (int r = 0; r < nRegions; ++r)
+    {
+        std::copy(pscalars[r], pscalars[r] + offsets[r + 1] - offsets[r], p.begin() + offsets[r]);
+        std::copy(bscalars[r], bscalars[r] + offsets[r + 1] - offsets[r], b.begin() + offsets[r]);
+    }
+
+    solve(nLocalRows, p.data(), b.data(), matrix);
+
+    for (int r = 0; r < nRegions; ++r)
+    {
+        std::copy(p.begin() + offsets[r], p.begin() + offsets[r + 1], pscalars[r]);
+    }
+}
+
+
+/* \implements AmgXSolver::solveNow */
+void AmgXSolver::solveNow(
+    int nLocalRows, double* pscalar, const double* bscalar, AmgXCSRMatrix& matrix)
+{
+    AMGX_PROFILE_SCOPE("solve");
+
     double* p;
     const double* b;
     int nRows;
 
-    if (matrix.isConsolidated())
+    // The vectors are the views of the matrix, already in place
+    const bool inPlace = matrix.hasVectorViews() && pscalar == matrix.getSolutionView();
+
+    // Device views cannot be used by the features working on host arrays
+    const bool hostArrays = !inPlace || matrix.isViewOnHost();
+
+    // Extrapolate the initial guess from the solutions of previous time levels
+    AmgXSolutionHistory& history = matrix.getSolutionHistory(instanceId, solutionField);
+    const double time = hasSolutionTime ? solutionTime : history.nextTime();
+
+    if (hostArrays && guessMode != InitialGuessMode::None)
+    {
+        history.extrapolate(guessMode, time, nLocalRows, pscalar);
+    }
+
+    // Deflate the recycled subspace from the initial guess
+    if (hostArrays && recycleMax > 0)
+    {
+        projectRecycled(nLocalRows, pscalar, bscalar, matrix);
+    }
+
+    // the solver of the current overrides, set up first if needed
+    if (gpuProc == 0)
+    {
+        activeSolver = selectSolver();
+    }
+
+    startSolveRecord();
+    double tStart = MPI_Wtime();
+
+    AMGX_PROFILE_BEGIN(gatherScope, "solve:gather");
+
+    if (inPlace)
+    {
+        p = matrix.getSolutionViewCons();
+        b = matrix.getRHSViewCons();
+        nRows = matrix.isConsolidated() ? matrix.getNConsRows() : nLocalRows;
+
+        if (matrix.isConsolidated())
+        {
+            // All ranks must have completed their writes to the views before the upload
+            if (!matrix.isViewOnHost())
+            {
+                CHECK(cudaDeviceSynchronize());
+            }
+
+            matrix.syncVectorViews();
+            AmgXProfiler::barrier(devWorld, "solve:barrier devWorld");
+            matrix.syncVectorViews();
+        }
+    }
+    else if (matrix.isConsolidated())
     {
         p = matrix.getPCons();
         b = matrix.getRHSCons();
@@ -335,6 +767,8 @@ void AmgXSolver::solve(
         const int* rowDispls = matrix.getRowDispls();
         CHECK(cudaMemcpy((void **)&p[rowDispls[myDevWorldRank]], pscalar, sizeof(double) * nLocalRows, cudaMemcpyDefault));
         CHECK(cudaMemcpy((void **)&b[rowDispls[myDevWorldRank]], bscalar, sizeof(double) * nLocalRows, cudaMemcpyDefault));
+        solveRecord.transferBytes += 2 * sizeof(double) * nLocalRows;
+        AMGX_PROFILE_TRAFFIC(Transfer, 16.0 * nLocalRows, 16.0 * nLocalRows, 0.0);
 
         // Override the number of rows as the consolidated number of rows
         nRows = matrix.getNConsRows();
@@ -342,7 +776,7 @@ void AmgXSolver::solve(
         // Sync as cudaMemcpy to IPC buffers so device to device copies, which are non-blocking w.r.t host
         // All ranks in devWorld have the same value for isConsolidated
         CHECK(cudaDeviceSynchronize());
-        MPI_Barrier(devWorld);  
+        AmgXProfiler::barrier(devWorld, "solve:barrier devWorld");
     }
     else
     {
@@ -351,20 +785,54 @@ void AmgXSolver::solve(
         nRows = nLocalRows;
     }
 
+    AMGX_PROFILE_END(gatherScope);
+
     if (gpuWorld != MPI_COMM_NULL)
     {
+        AMGX_PROFILE_SCOPE("solve:upload");
+
         // Upload potentially consolidated vectors to AmgX
         AMGX_vector_upload(AmgXP, nRows, 1, p);
         AMGX_vector_upload(AmgXRHS, nRows, 1, b);
+        solveRecord.transferBytes += 2 * sizeof(double) * nRows;
+
+        if (matrix.isOnHost())
+        {
+            AMGX_PROFILE_TRAFFIC(Host, 16.0 * nRows, 16.0 * nRows, 0.0);
+        }
+
+        AmgXProfiler::barrier(gpuWorld, "solve:barrier gpuWorld");
+    }
+
+    solveRecord.transferTime += MPI_Wtime() - tStart;
+
+    // Skip the solve if the initial guess already satisfies the tolerance,
+    // the result is the same on all ranks
+    lastSolveSkipped = false;
+    if (hostArrays && (skipTolerance > 0 || normaliseResiduals))
+    {
+        AMGX_PROFILE_SCOPE("solve:residual");
+        lastInitialResidual = computeInitialResidual(nLocalRows, pscalar, bscalar, matrix);
+        lastSolveSkipped = skipTolerance > 0 && lastInitialResidual < skipTolerance;
 
-        MPI_Barrier(gpuWorld);  
+        // reduced over all ranks, so the record needs no broadcast of it
+        solveRecord.normalisedInitialResidual = lastInitialResidual;
+        if (lastSolveSkipped) solveRecord.normalisedFinalResidual = lastInitialResidual;
+    }
 
+    if (gpuWorld != MPI_COMM_NULL && !lastSolveSkipped)
+    {
         // Solve
-        AMGX_solver_solve(solver, AmgXRHS, AmgXP);
+        AMGX_PROFILE_BEGIN(solveScope, "solve:solve");
+        tStart = MPI_Wtime();
+        AMGX_solver_solve(activeSolver, AmgXRHS, AmgXP);
 
         // Get the status of the solver
         AMGX_SOLVE_STATUS status;
-        AMGX_solver_get_status(solver, &status);
+        AMGX_solver_get_status(activeSolver, &status);
+        solveRecord.solveTime = MPI_Wtime() - tStart;
+        AMGX_PROFILE_END(solveScope);
+        solveRecord.status = status;
 
         // Check whether the solver successfully solved the problem
         if (status != AMGX_SOLVE_SUCCESS)
@@ -375,7 +843,15 @@ void AmgXSolver::solve(
         }
 
         // Download data from device
+        AMGX_PROFILE_SCOPE("solve:download");
+        tStart = MPI_Wtime();
         AMGX_vector_download(AmgXP, p);
+        solveRecord.transferBytes += sizeof(double) * nRows;
+
+        if (matrix.isOnHost())
+        {
+            AMGX_PROFILE_TRAFFIC(Host, 8.0 * nRows, 8.0 * nRows, 0.0);
+        }
 
         if(matrix.isConsolidated())
         {
@@ -383,42 +859,138 @@ void AmgXSolver::solve(
             // the root rank blocks the host before other ranks copy from the consolidated solution
             CHECK(cudaDeviceSynchronize());
         }
+
+        solveRecord.transferTime += MPI_Wtime() - tStart;
     }
 
     // If the matrix is consolidated, scatter the solution
-    if (matrix.isConsolidated())
+    if (matrix.isConsolidated() && !lastSolveSkipped)
     {
         // Must synchronise before each rank attempts to read from the consolidated solution
-        MPI_Barrier(devWorld);  
+        matrix.syncVectorViews();
+        AmgXProfiler::barrier(devWorld, "solve:barrier devWorld");
 
-        const int* rowDispls = matrix.getRowDispls();
+        AMGX_PROFILE_SCOPE("solve:scatter");
+        tStart = MPI_Wtime();
 
-        // Ranks copy the portion of the solution they own into their rank-local buffers
-        CHECK(cudaMemcpy((void **)pscalar, &p[rowDispls[myDevWorldRank]], sizeof(double) * nLocalRows, cudaMemcpyDefault));
+        if (inPlace)
+        {
+            // Ranks read the solution from their views
+            matrix.syncVectorViews();
+        }
+        else
+        {
+            const int* rowDispls = matrix.getRowDispls();
 
-        // Sync as cudaMemcpy to IPC buffers so device to device copies, which are non-blocking w.r.t host
-        // All ranks in devWorld have the same value for isConsolidated
-        CHECK(cudaDeviceSynchronize());
+            // Ranks copy the portion of the solution they own into their rank-local buffers
+            CHECK(cudaMemcpy((void **)pscalar, &p[rowDispls[myDevWorldRank]], sizeof(double) * nLocalRows, cudaMemcpyDefault));
+
+            // Sync as cudaMemcpy to IPC buffers so device to device copies, which are non-blocking w.r.t host
+            // All ranks in devWorld have the same value for isConsolidated
+            CHECK(cudaDeviceSynchronize());
+            solveRecord.transferBytes += sizeof(double) * nLocalRows;
+            AMGX_PROFILE_TRAFFIC(Transfer, 8.0 * nLocalRows, 8.0 * nLocalRows, 0.0);
+        }
+
+        solveRecord.transferTime += MPI_Wtime() - tStart;
+    }
+
+    // The solution is still held by AmgX, before the recycling uses its vectors
+    if (hostArrays && normaliseResiduals)
+    {
+        AMGX_PROFILE_SCOPE("solve:residual");
+        lastFinalResidual = lastSolveSkipped ? lastInitialResidual
+            : computeFinalResidual(nLocalRows, bscalar, matrix);
+        solveRecord.normalisedFinalResidual = lastFinalResidual;
+    }
+
+    finishSolveRecord();
+
+    if (hostArrays && recycleMax > 0 && !lastSolveSkipped)
+    {
+        updateRecycled(nLocalRows, pscalar, matrix);
+    }
+
+    if (hostArrays && guessMode != InitialGuessMode::None)
+    {
+        history.store(time, nLocalRows, pscalar, guessLevels);
     }
 
-    MPI_Barrier(globalCpuWorld);  
+    AmgXProfiler::barrier(globalCpuWorld, "solve:barrier globalCpuWorld");
+
+    AmgXProfiler::countSolve();
+}
+
+
+/* \implements AmgXSolver::setInitialGuess */
+void AmgXSolver::setInitialGuess(InitialGuessMode guessMode, int nLevels)
+{
+    // enqueued solves still read the current settings
+    waitAsync();
+
+    this->guessMode = guessMode;
+    guessLevels = nLevels;
+}
+
+
+/* \implements AmgXSolver::setSolutionTime */
+void AmgXSolver::setSolutionTime(double time)
+{
+    // enqueued solves still read the current settings
+    waitAsync();
+
+    solutionTime = time;
+    hasSolutionTime = true;
+}
+
+
+/* \implements AmgXSolver::setSolutionField */
+void AmgXSolver::setSolutionField(int field)
+{
+    // enqueued solves still read the current settings
+    waitAsync();
+
+    solutionField = field;
 }
 
 
 /* \implements AmgXSolver::getIters */
 void AmgXSolver::getIters(int &iter)
 {
-    // only processes using AmgX will try to get # of iterations
-    if (gpuProc == 0)
-        AMGX_solver_get_iterations_number(solver, &iter);
+    // the last solve may still be enqueued
+    waitAsync();
+
+    // the record of the last solve is available on all ranks
+    iter = solveRecord.iterations;
 }
 
 
 /* \implements AmgXSolver::getResidual */
 void AmgXSolver::getResidual(const int &iter, double &res)
 {
-    // only processes using AmgX will try to get residual
-    if (gpuProc == 0)
-        AMGX_solver_get_iteration_residual(solver, iter, 0, &res);
+    // the last solve may still be enqueued
+    waitAsync();
+
+    // the record of the last solve is available on all ranks
+    const std::vector<double>& history = solveRecord.residualHistory;
+
+    if (lastSolveSkipped)
+        res = solveRecord.initialResidual;
+    else if (iter >= 0 && iter < (int)history.size())
+        res = history[iter];
+    else if (gpuProc == 0 && amgxReady)
+        AMGX_solver_get_iteration_residual(activeSolver, iter, 0, &res);
 }
 
+
+/* \implements AmgXSolver::reportWaits */
+void AmgXSolver::reportWaits()
+{
+    if (!AmgXProfiler::isEnabled()) return;
+
+    // the enqueued solves call the barriers reported
+    waitAsync();
+    requireComms();
+
+    AmgXProfiler::reportWaits(globalCpuWorld, gpuProc == 0);
+}
@@ -0,0 +1,152 @@
+/**
+ * \file AmgXSolverAsync.cu
+ * \brief Definition of the asynchronous solve of the class AmgXSolver.
+ * \author Pi-Yueh Chuang (pychuang@gwu.edu)
+ * \author Matt Martineau (mmartineau@nvidia.com)
+ * \date 2015-09-01
+ * \copyright Copyright (c) 2015-2019 Pi-Yueh Chuang, Lorena A. Barba.
+ * \copyright Copyright (c) 2019-2021, NVIDIA CORPORATION. All rights reserved.
+ *            This project is released under MIT License.
+ */
+
+// AmgXWrapper
+# include "AmgXSolver.H"
+
+
+/* \implements AmgXSolveHandle::AmgXSolveHandle */
+AmgXSolveHandle::AmgXSolveHandle(std::shared_future<void> done)
+:
+    done(std::move(done))
+{}
+
+
+/* \implements AmgXSolveHandle::wait */
+void AmgXSolveHandle::wait() const
+{
+    if (done.valid()) done.wait();
+}
+
+
+/* \implements AmgXSolveHandle::test */
+bool AmgXSolveHandle::test() const
+{
+    return !done.valid() ||
+        done.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+
+/* \implements AmgXSolveHandle::valid */
+bool AmgXSolveHandle::valid() const
+{
+    return done.valid();
+}
+
+
+/* \implements AmgXSolver::solveAsync */
+AmgXSolveHandle AmgXSolver::solveAsync(
+    int nLocalRows, double* pscalar, const double* bscalar, AmgXCSRMatrix& matrix)
+{
+    // the first use sets up AmgX from the calling thread, no solve can be enqueued before
+    if (!amgxReady)
+    {
+        waitAsync();
+        requireAmgX();
+    }
+
+    // recorded in the order of the calls, as a solve
+    AmgXRecorder::recordSolve(this, &matrix, nLocalRows, pscalar, bscalar);
+
+    std::packaged_task<void()> task(
+        [this, nLocalRows, pscalar, bscalar, &matrix]()
+        {
+            solveNow(nLocalRows, pscalar, bscalar, matrix);
+        });
+
+    std::shared_future<void> done = task.get_future().share();
+
+    // the worker thread communicates concurrently with the caller
+    int provided;
+    MPI_Query_thread(&provided);
+
+    if (provided < MPI_THREAD_MULTIPLE)
+    {
+        waitAsync();
+        task();
+        return AmgXSolveHandle(done);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(asyncMutex);
+
+        // start the worker thread on first use
+        if (!asyncWorker.joinable())
+        {
+            stopAsync = false;
+            asyncWorker = std::thread(&AmgXSolver::asyncWorkerLoop, this);
+        }
+
+        asyncQueue.push_back(std::move(task));
+        lastAsync = done;
+    }
+
+    asyncCond.notify_one();
+
+    return AmgXSolveHandle(done);
+}
+
+
+/* \implements AmgXSolver::waitAsync */
+void AmgXSolver::waitAsync()
+{
+    std::shared_future<void> last;
+    {
+        std::lock_guard<std::mutex> lock(asyncMutex);
+        last = lastAsync;
+    }
+
+    // solves run in order, so the last one completes after all others
+    if (last.valid()) last.wait();
+}
+
+
+/* \implements AmgXSolver::asyncWorkerLoop */
+void AmgXSolver::asyncWorkerLoop()
+{
+    // the current device is a per-thread setting of the CUDA runtime
+    if (!isHostMode()) CHECK(cudaSetDevice(devID));
+
+    for (;;)
+    {
+        std::packaged_task<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(asyncMutex);
+            asyncCond.wait(lock, [this]{ return stopAsync || !asyncQueue.empty(); });
+
+            // only exit once the queue has been drained
+            if (asyncQueue.empty()) return;
+
+            task = std::move(asyncQueue.front());
+            asyncQueue.pop_front();
+        }
+
+        task();
+    }
+}
+
+
+/* \implements AmgXSolver::stopAsyncWorker */
+void AmgXSolver::stopAsyncWorker()
+{
+    {
+        std::lock_guard<std::mutex> lock(asyncMutex);
+        stopAsync = true;
+    }
+
+    asyncCond.notify_one();
+
+    if (asyncWorker.joinable()) asyncWorker.join();
+
+    std::lock_guard<std::mutex> lock(asyncMutex);
+    stopAsync = false;
+    lastAsync = std::shared_future<void>();
+}
@@ -0,0 +1,243 @@
+/**
+ * \file AmgXSolverOverrides.cu
+ * \brief Definition of the parameter overrides of the class AmgXSolver.
+ * \author Pi-Yueh Chuang (pychuang@gwu.edu)
+ * \author Matt Martineau (mmartineau@nvidia.com)
+ * \date 2015-09-01
+ * \copyright Copyright (c) 2015-2019 Pi-Yueh Chuang, Lorena A. Barba.
+ * \copyright Copyright (c) 2019-2021, NVIDIA CORPORATION. All rights reserved.
+ *            This project is released under MIT License.
+ */
+
+// AmgXWrapper
+# include "AmgXSolver.H"
+
+# include <set>
+# include <sstream>
+
+namespace
+{
+
+// The scopes declared by AmgX config parameters, and the scope of their top-level
+// solver: "main" for "solver(main)=PCG", or for a JSON solver of "scope": "main";
+// empty if the top-level solver is in the default scope
+void readConfigScopes(const std::string &parameters, std::string &topScope,
+        std::set<std::string> &scopes)
+{
+    const size_t first = parameters.find_first_not_of(" \t\r\n");
+
+    if (first == std::string::npos || parameters[first] != '{')
+    {
+        std::istringstream entries(parameters);
+        std::string entry;
+
+        while (std::getline(entries, entry, ','))
+        {
+            const std::string name = entry.substr(0, entry.find('='));
+
+            const size_t open = name.find('(');
+            const size_t close = name.find(')', open);
+            if (open == std::string::npos || close == std::string::npos) continue;
+
+            const std::string scope = name.substr(open + 1, close - open - 1);
+            scopes.insert(scope);
+
+            // the solver declared in the default scope is the top-level one
+            const size_t begin = name.find_first_not_of(" \t\r\n");
+            const std::string parameter = name.substr(begin, open - begin);
+            if (topScope.empty() && (parameter == "solver" || parameter == "default:solver"))
+            {
+                topScope = scope;
+            }
+        }
+
+        return;
+    }
+
+    // the keys of the enclosing JSON objects, and the last key read
+    std::vector<std::string> objects;
+    std::string key;
+
+    for (size_t i = first; i < parameters.size(); ++i)
+    {
+        const char c = parameters[i];
+
+        if (c == '{')
+        {
+            objects.push_back(key);
+            key.clear();
+        }
+        else if (c == '}')
+        {
+            if (!objects.empty()) objects.pop_back();
+            key.clear();
+        }
+        else if (c == '"')
+        {
+            std::string value;
+            for (++i; i < parameters.size() && parameters[i] != '"'; ++i)
+            {
+                if (parameters[i] == '\\') ++i;
+                if (i < parameters.size()) value += parameters[i];
+            }
+
+            const size_t next = parameters.find_first_not_of(" \t\r\n", i + 1);
+            if (next != std::string::npos && parameters[next] == ':')
+            {
+                key = value;
+                continue;
+            }
+
+            if (key == "scope")
+            {
+                scopes.insert(value);
+
+                // the scope of the "solver" object of the outermost object
+                if (objects.size() == 2 && objects[1] == "solver") topScope = value;
+            }
+
+            key.clear();
+        }
+        else if (c == ',')
+        {
+            key.clear();
+        }
+    }
+}
+
+}
+
+
+/* \implements AmgXSolver::setParameterOverrides */
+void AmgXSolver::setParameterOverrides(const std::string &parameters)
+{
+    // enqueued solves still use the current overrides
+    waitAsync();
+
+    overrides = parameters;
+    overrideMaxIters = -1;
+}
+
+
+/* \implements AmgXSolver::setParameterOverrides */
+void AmgXSolver::setParameterOverrides(double tolerance, int maxIters,
+        const std::string &convergence, const std::string &scope)
+{
+    std::string topScope;
+    std::set<std::string> scopes;
+    readConfigScopes(cfgParameters, topScope, scopes);
+
+    // the scoped parameters of the config file take precedence over unscoped ones,
+    // so the overrides are those of the top-level solver by default
+    const std::string solverScope = scope.empty() ? topScope : scope;
+
+    if (!solverScope.empty() && solverScope != "default" && scopes.count(solverScope) == 0)
+    {
+        fprintf(stderr,
+                "The scope %s of the parameter overrides is not declared by the config file %s.\n",
+                solverScope.c_str(), cfgFile.c_str());
+        return;
+    }
+
+    const std::string prefix = solverScope.empty() ? "" : solverScope + ":";
+
+    std::ostringstream parameters;
+    parameters.precision(17);
+
+    const char* separator = "";
+    if (tolerance >= 0)
+    {
+        parameters << separator << prefix << "tolerance=" << tolerance;
+        separator = ", ";
+    }
+
+    if (maxIters >= 0)
+    {
+        parameters << separator << prefix << "max_iters=" << maxIters;
+        separator = ", ";
+    }
+
+    if (!convergence.empty())
+    {
+        parameters << separator << prefix << "convergence=" << convergence;
+    }
+
+    setParameterOverrides(parameters.str());
+
+    overrideMaxIters = maxIters;
+}
+
+
+/* \implements AmgXSolver::getParameterOverrides */
+const std::string& AmgXSolver::getParameterOverrides() const
+{
+    return overrides;
+}
+
+
+/* \implements AmgXSolver::selectSolver */
+AMGX_solver_handle AmgXSolver::selectSolver()
+{
+    // the solver of the config file is not set up while overrides are used
+    if (overrides.empty())
+    {
+        setupSolver(solver, solverSetupVersion, solverStructureVersion);
+        return solver;
+    }
+
+    SolverVariant& variant = variants[overrides];
+
+    // the config of the main solver, with the overrides
+    if (variant.solver == nullptr)
+    {
+        AMGX_SAFE_CALL(AMGX_config_create(&variant.cfg, cfgParameters.c_str()));
+        AMGX_SAFE_CALL(AMGX_config_add_parameters(&variant.cfg, overrides.c_str()));
+        AMGX_SAFE_CALL(AMGX_config_add_parameters(&variant.cfg, "exception_handling=1"));
+        AMGX_SAFE_CALL(AMGX_config_add_parameters(&variant.cfg, "store_res_history=1"));
+
+        AMGX_solver_create(&variant.solver, rsrc, mode, variant.cfg);
+    }
+
+    setupSolver(variant.solver, variant.setupVersion, variant.structureVersion);
+
+    return variant.solver;
+}
+
+
+/* \implements AmgXSolver::setupSolver */
+void AmgXSolver::setupSolver(
+    AMGX_solver_handle solver, int &setupVersion, int &structureVersion)
+{
+    if (setupVersion == operatorVersion) return;
+
+    // set up with the current operator, reusing the structure where possible
+    const double tStart = MPI_Wtime();
+
+    if (structureVersion == this->structureVersion)
+    {
+        AMGX_solver_resetup(solver, AmgXA);
+    }
+    else
+    {
+        AMGX_solver_setup(solver, AmgXA);
+    }
+
+    pendingSetupTime += MPI_Wtime() - tStart;
+
+    setupVersion = operatorVersion;
+    structureVersion = this->structureVersion;
+}
+
+
+/* \implements AmgXSolver::destroyVariants */
+void AmgXSolver::destroyVariants()
+{
+    for (auto& entry : variants)
+    {
+        AMGX_solver_destroy(entry.second.solver);
+        AMGX_SAFE_CALL(AMGX_config_destroy(entry.second.cfg));
+    }
+
+    variants.clear();
+    activeSolver = solver;
+}
@@ -0,0 +1,105 @@
+/**
+ * \file AmgXSolverRecord.cu
+ * \brief Definition of the solve records of the class AmgXSolver.
+ * \author Pi-Yueh Chuang (pychuang@gwu.edu)
+ * \author Matt Martineau (mmartineau@nvidia.com)
+ * \date 2015-09-01
+ * \copyright Copyright (c) 2015-2019 Pi-Yueh Chuang, Lorena A. Barba.
+ * \copyright Copyright (c) 2019-2021, NVIDIA CORPORATION. All rights reserved.
+ *            This project is released under MIT License.
+ */
+
+// AmgXWrapper
+# include "AmgXSolver.H"
+
+
+/* \implements AmgXSolver::getSolveRecord */
+const AmgXSolveRecord& AmgXSolver::getSolveRecord()
+{
+    // the last solve may still be enqueued
+    waitAsync();
+
+    return solveRecord;
+}
+
+
+/* \implements AmgXSolver::startSolveRecord */
+void AmgXSolver::startSolveRecord()
+{
+    // the history keeps its storage from one solve to the next
+    solveRecord.iterations = 0;
+    solveRecord.status = AMGX_SOLVE_SUCCESS;
+    solveRecord.skipped = false;
+    solveRecord.initialResidual = 0.0;
+    solveRecord.finalResidual = 0.0;
+    solveRecord.normalisedInitialResidual = -1.0;
+    solveRecord.normalisedFinalResidual = -1.0;
+    solveRecord.residualHistory.clear();
+    solveRecord.setupTime = pendingSetupTime;
+    solveRecord.solveTime = 0.0;
+    solveRecord.transferTime = 0.0;
+    solveRecord.transferBytes = 0;
+
+    pendingSetupTime = 0.0;
+}
+
+
+/* \implements AmgXSolver::finishSolveRecord */
+void AmgXSolver::finishSolveRecord()
+{
+    std::vector<double>& history = solveRecord.residualHistory;
+
+    solveRecord.skipped = lastSolveSkipped;
+
+    // AmgX is not called for a skipped solve, its L2 norm stands in for the one of AmgX
+    if (lastSolveSkipped)
+    {
+        solveRecord.initialResidual = lastInitialNorm;
+        solveRecord.finalResidual = lastInitialNorm;
+    }
+    else if (gpuProc == 0)
+    {
+        AMGX_solver_get_iterations_number(activeSolver, &solveRecord.iterations);
+
+        // the initial residual is stored first, then one per iteration
+        history.resize(solveRecord.iterations + 1);
+        for (int i = 0; i <= solveRecord.iterations; ++i)
+        {
+            AMGX_solver_get_iteration_residual(activeSolver, i, 0, &history[i]);
+        }
+
+        solveRecord.initialResidual = history.front();
+        solveRecord.finalResidual = history.back();
+
+        // a max_iters override that AmgX did not apply, as one shadowed by the config file
+        if (overrideMaxIters >= 0 && solveRecord.iterations > overrideMaxIters && myGpuWorldRank == 0)
+        {
+            fprintf(stderr,
+                    "The solver ran %d iterations, more than the overridden max_iters=%d.\n",
+                    solveRecord.iterations, overrideMaxIters);
+        }
+    }
+
+    if (devWorldSize == 1) return;
+
+    // one broadcast of the values reported by AmgX, one of the history
+    double values[7] = {
+        (double)solveRecord.iterations, (double)solveRecord.status,
+        solveRecord.initialResidual, solveRecord.finalResidual,
+        solveRecord.setupTime, solveRecord.solveTime, (double)history.size()};
+
+    MPI_Bcast(values, 7, MPI_DOUBLE, 0, devWorld);
+
+    solveRecord.iterations = (int)values[0];
+    solveRecord.status = (int)values[1];
+    solveRecord.initialResidual = values[2];
+    solveRecord.finalResidual = values[3];
+    solveRecord.setupTime = values[4];
+    solveRecord.solveTime = values[5];
+    history.resize((size_t)values[6]);
+
+    if (!history.empty())
+    {
+        MPI_Bcast(history.data(), history.size(), MPI_DOUBLE, 0, devWorld);
+    }
+}
@@ -0,0 +1,236 @@
+/**
+ * \file AmgXSolverRecycling.cu
+ * \brief Definition of the subspace recycling of the class AmgXSolver.
+ * \author Pi-Yueh Chuang (pychuang@gwu.edu)
+ * \author Matt Martineau (mmartineau@nvidia.com)
+ * \date 2015-09-01
+ * \copyright Copyright (c) 2015-2019 Pi-Yueh Chuang, Lorena A. Barba.
+ * \copyright Copyright (c) 2019-2021, NVIDIA CORPORATION. All rights reserved.
+ *            This project is released under MIT License.
+ */
+
+// AmgXWrapper
+# include "AmgXSolver.H"
+
+# include <cmath>
+
+
+/* \implements AmgXSolver::setRecycling */
+void AmgXSolver::setRecycling(int nVectors)
+{
+    // enqueued solves still use the current subspace
+    waitAsync();
+
+    recycleMax = nVectors;
+
+    // drop the oldest vectors; the remaining ones stay orthonormal
+    while ((int)recycleU.size() > recycleMax)
+    {
+        recycleU.erase(recycleU.begin());
+        recycleC.erase(recycleC.begin());
+    }
+}
+
+
+/* \implements AmgXSolver::applyOperator */
+void AmgXSolver::applyOperator(
+    int nLocalRows, const double* x, double* y, AmgXCSRMatrix& matrix)
+{
+    const double* xIn = x;
+    double* yOut = y;
+    int nRows = nLocalRows;
+
+    // The consolidated solution and RHS vectors are used as scratch space
+    if (matrix.isConsolidated())
+    {
+        xIn = matrix.getPCons();
+        yOut = matrix.getRHSCons();
+        nRows = matrix.getNConsRows();
+
+        const int* rowDispls = matrix.getRowDispls();
+        CHECK(cudaMemcpy((void **)&matrix.getPCons()[rowDispls[myDevWorldRank]], x, sizeof(double) * nLocalRows, cudaMemcpyDefault));
+
+        CHECK(cudaDeviceSynchronize());
+        AmgXProfiler::barrier(devWorld, "applyOperator:barrier devWorld");
+    }
+
+    if (gpuWorld != MPI_COMM_NULL)
+    {
+        AMGX_vector_upload(AmgXP, nRows, 1, xIn);
+        AMGX_matrix_vector_multiply(AmgXA, AmgXP, AmgXRHS);
+        AMGX_vector_download(AmgXRHS, yOut);
+
+        if (matrix.isConsolidated())
+        {
+            CHECK(cudaDeviceSynchronize());
+        }
+    }
+
+    if (matrix.isConsolidated())
+    {
+        AmgXProfiler::barrier(devWorld, "applyOperator:barrier devWorld");
+
+        const int* rowDispls = matrix.getRowDispls();
+        CHECK(cudaMemcpy((void **)y, &yOut[rowDispls[myDevWorldRank]], sizeof(double) * nLocalRows, cudaMemcpyDefault));
+        CHECK(cudaDeviceSynchronize());
+    }
+}
+
+
+/* \implements AmgXSolver::orthogonaliseRecycled */
+bool AmgXSolver::orthogonaliseRecycled(int nLocalRows, double* u, double* c)
+{
+    const int nVecs = recycleC.size();
+    std::vector<double> h(nVecs + 1);
+
+    // the norm before orthogonalisation, to detect a vector already in the subspace
+    double norm0 = 0.0;
+    for (int i = 0; i < nLocalRows; ++i) norm0 += c[i] * c[i];
+    MPI_Allreduce(MPI_IN_PLACE, &norm0, 1, MPI_DOUBLE, MPI_SUM, globalCpuWorld);
+
+    // classical Gram-Schmidt, applied twice for stability, one reduction per pass
+    for (int pass = 0; pass < 2 && nVecs > 0; ++pass)
+    {
+        for (int j = 0; j < nVecs; ++j)
+        {
+            const double* cj = recycleC[j].data();
+            double hj = 0.0;
+            for (int i = 0; i < nLocalRows; ++i) hj += cj[i] * c[i];
+            h[j] = hj;
+        }
+
+        MPI_Allreduce(MPI_IN_PLACE, h.data(), nVecs, MPI_DOUBLE, MPI_SUM, globalCpuWorld);
+
+        for (int j = 0; j < nVecs; ++j)
+        {
+            const double* uj = recycleU[j].data();
+            const double* cj = recycleC[j].data();
+            for (int i = 0; i < nLocalRows; ++i)
+            {
+                u[i] -= h[j] * uj[i];
+                c[i] -= h[j] * cj[i];
+            }
+        }
+    }
+
+    double norm = 0.0;
+    for (int i = 0; i < nLocalRows; ++i) norm += c[i] * c[i];
+    MPI_Allreduce(MPI_IN_PLACE, &norm, 1, MPI_DOUBLE, MPI_SUM, globalCpuWorld);
+
+    norm = std::sqrt(norm);
+    if (norm <= 1e-10 * std::sqrt(norm0)) return false;
+
+    for (int i = 0; i < nLocalRows; ++i)
+    {
+        u[i] /= norm;
+        c[i] /= norm;
+    }
+
+    return true;
+}
+
+
+/* \implements AmgXSolver::clearResizedRecycled */
+bool AmgXSolver::clearResizedRecycled(int nLocalRows)
+{
+    // a change of size (e.g. a topology change) invalidates the subspace; the
+    // ranks agree on it, as the ones whose size did not change would
+    // otherwise go on to the reductions of the projection alone
+    int resized = (int)recycleU[0].size() != nLocalRows;
+    MPI_Allreduce(MPI_IN_PLACE, &resized, 1, MPI_INT, MPI_LOR, globalCpuWorld);
+
+    if (resized)
+    {
+        recycleU.clear();
+        recycleC.clear();
+    }
+
+    return resized;
+}
+
+
+/* \implements AmgXSolver::projectRecycled */
+void AmgXSolver::projectRecycled(
+    int nLocalRows, double* pscalar, const double* bscalar, AmgXCSRMatrix& matrix)
+{
+    if (!recycleU.empty() && !clearResizedRecycled(nLocalRows))
+    {
+        // r = b - A x
+        std::vector<double> r(nLocalRows);
+        applyOperator(nLocalRows, pscalar, r.data(), matrix);
+        for (int i = 0; i < nLocalRows; ++i) r[i] = bscalar[i] - r[i];
+
+        // minimise the residual over the subspace: x += U C^T r, with C = A U orthonormal
+        const int nVecs = recycleC.size();
+        std::vector<double> h(nVecs);
+        for (int j = 0; j < nVecs; ++j)
+        {
+            const double* cj = recycleC[j].data();
+            double hj = 0.0;
+            for (int i = 0; i < nLocalRows; ++i) hj += cj[i] * r[i];
+            h[j] = hj;
+        }
+
+        MPI_Allreduce(MPI_IN_PLACE, h.data(), nVecs, MPI_DOUBLE, MPI_SUM, globalCpuWorld);
+
+        for (int j = 0; j < nVecs; ++j)
+        {
+            const double* uj = recycleU[j].data();
+            for (int i = 0; i < nLocalRows; ++i) pscalar[i] += h[j] * uj[i];
+        }
+    }
+
+    // keep the initial guess, the correction of this solve extends the subspace
+    recycleGuess.assign(pscalar, pscalar + nLocalRows);
+}
+
+
+/* \implements AmgXSolver::updateRecycled */
+void AmgXSolver::updateRecycled(
+    int nLocalRows, const double* pscalar, AmgXCSRMatrix& matrix)
+{
+    // u = x - x0, the correction made by the solve; c = A u
+    std::vector<double> u(nLocalRows);
+    std::vector<double> c(nLocalRows);
+    for (int i = 0; i < nLocalRows; ++i) u[i] = pscalar[i] - recycleGuess[i];
+
+    applyOperator(nLocalRows, u.data(), c.data(), matrix);
+
+    if (!orthogonaliseRecycled(nLocalRows, u.data(), c.data())) return;
+
+    // the oldest vector is replaced once the subspace is full
+    if ((int)recycleU.size() >= recycleMax)
+    {
+        recycleU.erase(recycleU.begin());
+        recycleC.erase(recycleC.begin());
+    }
+
+    recycleU.push_back(std::move(u));
+    recycleC.push_back(std::move(c));
+}
+
+
+/* \implements AmgXSolver::refreshRecycled */
+void AmgXSolver::refreshRecycled(int nLocalRows, AmgXCSRMatrix& matrix)
+{
+    if (recycleU.empty()) return;
+
+    if (clearResizedRecycled(nLocalRows)) return;
+
+    std::vector<std::vector<double>> oldU;
+    oldU.swap(recycleU);
+    recycleC.clear();
+
+    // recompute C = A U for the new coefficients and re-orthonormalise it
+    for (std::vector<double>& u : oldU)
+    {
+        std::vector<double> c(nLocalRows);
+        applyOperator(nLocalRows, u.data(), c.data(), matrix);
+
+        if (orthogonaliseRecycled(nLocalRows, u.data(), c.data()))
+        {
+            recycleU.push_back(std::move(u));
+            recycleC.push_back(std::move(c));
+        }
+    }
+}
@@ -0,0 +1,111 @@
+/**
+ * \file AmgXSolverRegistry.cu
+ * \brief Definition of member functions of the class AmgXSolverRegistry.
+ * \author Pi-Yueh Chuang (pychuang@gwu.edu)
+ * \author Matt Martineau (mmartineau@nvidia.com)
+ * \date 2015-09-01
+ * \copyright Copyright (c) 2015-2019 Pi-Yueh Chuang, Lorena A. Barba.
+ * \copyright Copyright (c) 2019-2021, NVIDIA CORPORATION. All rights reserved.
+ *            This project is released under MIT License.
+ */
+
+// AmgXWrapper
+# include "AmgXSolverRegistry.H"
+
+
+/* \implements AmgXSolverRegistry::AmgXSolverRegistry */
+AmgXSolverRegistry::AmgXSolverRegistry(
+    const MPI_Comm &comm, const std::string &modeStr)
+:
+    modeStr(modeStr)
+{
+    MPI_Comm_dup(comm, &this->comm);
+}
+
+
+/* \implements AmgXSolverRegistry::~AmgXSolverRegistry */
+AmgXSolverRegistry::~AmgXSolverRegistry()
+{
+    finalize();
+}
+
+
+/* \implements AmgXSolverRegistry::getSolver */
+AmgXSolver& AmgXSolverRegistry::getSolver(
+    const std::string &name, const std::string &cfgFile)
+{
+    auto found = solvers.find(name);
+    if (found != solvers.end()) return *found->second;
+
+    std::unique_ptr<AmgXSolver> solver;
+
+    // only the first solver splits the communicators and queries the devices
+    if (solverOrder.empty())
+    {
+        solver.reset(new AmgXSolver(comm, modeStr, cfgFile));
+    }
+    else
+    {
+        solver.reset(new AmgXSolver(*solvers[solverOrder.front()], cfgFile));
+    }
+
+    solverOrder.push_back(name);
+
+    return *(solvers[name] = std::move(solver));
+}
+
+
+/* \implements AmgXSolverRegistry::getMatrix */
+AmgXCSRMatrix& AmgXSolverRegistry::getMatrix(
+    const std::string &key, const std::string &name)
+{
+    auto found = matrices.find(key);
+    if (found != matrices.end()) return *found->second;
+
+    auto solver = solvers.find(name);
+    if (solver == solvers.end())
+    {
+        fprintf(stderr,
+                "The solver of %s must be created before its matrix %s.\n",
+                name.c_str(), key.c_str());
+        exit(0);
+    }
+
+    std::unique_ptr<AmgXCSRMatrix> matrix(new AmgXCSRMatrix);
+
+    // the matrix duplicates the device communicator of the requesting solver,
+    // after its enqueued solves, rather than sharing that of another solver
+    solver->second->initialiseMatrixComms(*matrix);
+
+    return *(matrices[key] = std::move(matrix));
+}
+
+
+/* \implements AmgXSolverRegistry::hasSolver */
+bool AmgXSolverRegistry::hasSolver(const std::string &name) const
+{
+    return solvers.find(name) != solvers.end();
+}
+
+
+/* \implements AmgXSolverRegistry::finalize */
+void AmgXSolverRegistry::finalize()
+{
+    for (auto& entry : matrices)
+    {
+        entry.second->finalise();
+    }
+
+    matrices.clear();
+
+    // the first solver owns the AmgX resources used by the others
+    for (auto name = solverOrder.rbegin(); name != solverOrder.rend(); ++name)
+    {
+        solvers[*name]->finalize();
+    }
+
+    solvers.clear();
+    solverOrder.clear();
+
+    if (comm != MPI_COMM_NULL) MPI_Comm_free(&comm);
+}
@@ -0,0 +1,153 @@
+/**
+ * \file AmgXSolverResidual.cu
+ * \brief Definition of the residual computations of the class AmgXSolver.
+ * \author Pi-Yueh Chuang (pychuang@gwu.edu)
+ * \author Matt Martineau (mmartineau@nvidia.com)
+ * \date 2015-09-01
+ * \copyright Copyright (c) 2015-2019 Pi-Yueh Chuang, Lorena A. Barba.
+ * \copyright Copyright (c) 2019-2021, NVIDIA CORPORATION. All rights reserved.
+ *            This project is released under MIT License.
+ */
+
+// AmgXWrapper
+# include "AmgXSolver.H"
+
+# include <cmath>
+
+
+/* \implements AmgXSolver::setSkipTolerance */
+void AmgXSolver::setSkipTolerance(double tolerance)
+{
+    // enqueued solves still use the current tolerance
+    waitAsync();
+
+    skipTolerance = tolerance;
+}
+
+
+/* \implements AmgXSolver::setNormalisedResiduals */
+void AmgXSolver::setNormalisedResiduals(bool enable)
+{
+    // enqueued solves still use the current setting
+    waitAsync();
+
+    normaliseResiduals = enable;
+}
+
+
+/* \implements AmgXSolver::getNormalisedResiduals */
+void AmgXSolver::getNormalisedResiduals(double &initial, double &final)
+{
+    // the residuals of an enqueued solve are not known before it completes
+    waitAsync();
+
+    initial = lastInitialResidual;
+    final = lastFinalResidual;
+}
+
+
+/* \implements AmgXSolver::multiplySolution */
+void AmgXSolver::multiplySolution(int nLocalRows, AmgXCSRMatrix& matrix)
+{
+    residualAx.resize(nLocalRows);
+
+    if (gpuWorld != MPI_COMM_NULL)
+    {
+        AMGX_matrix_vector_multiply(AmgXA, AmgXP, AmgXAx);
+
+        // In the host modes the product reads the CSR arrays, gathers the solution and writes A x,
+        // a multiply and an add per non-zero; its download copies A x
+        if (matrix.isOnHost())
+        {
+            const double nNz = matrix.getRowOffsets()[nLocalRows];
+            AMGX_PROFILE_TRAFFIC(Host, 4.0 * (nLocalRows + 1) + 20.0 * nNz + 8.0 * nLocalRows,
+                                 16.0 * nLocalRows, 2.0 * nNz);
+        }
+
+        if (matrix.isConsolidated())
+        {
+            residualAxCons.resize(matrix.getNConsRows());
+            AMGX_vector_download(AmgXAx, residualAxCons.data());
+        }
+        else
+        {
+            AMGX_vector_download(AmgXAx, residualAx.data());
+        }
+    }
+
+    // If the matrix is consolidated, each rank receives the rows it owns
+    if (matrix.isConsolidated())
+    {
+        const int* rowDispls = matrix.getRowDispls();
+
+        std::vector<int> rowCounts(devWorldSize);
+        for (int i = 0; i < devWorldSize; ++i)
+        {
+            rowCounts[i] = rowDispls[i + 1] - rowDispls[i];
+        }
+
+        MPI_Scatterv(residualAxCons.data(), rowCounts.data(), rowDispls, MPI_DOUBLE,
+            residualAx.data(), nLocalRows, MPI_DOUBLE, 0, devWorld);
+    }
+}
+
+
+/* \implements AmgXSolver::computeInitialResidual */
+double AmgXSolver::computeInitialResidual(
+    int nLocalRows, const double* pscalar, const double* bscalar, AmgXCSRMatrix& matrix)
+{
+    // the average of the initial guess, reduced while AmgX computes A x
+    double sums[2] = {0.0, (double)nLocalRows};
+    for (int i = 0; i < nLocalRows; ++i)
+    {
+        sums[0] += pscalar[i];
+    }
+
+    MPI_Request request;
+    MPI_Iallreduce(MPI_IN_PLACE, sums, 2, MPI_DOUBLE, MPI_SUM, globalCpuWorld, &request);
+
+    multiplySolution(nLocalRows, matrix);
+
+    MPI_Wait(&request, MPI_STATUS_IGNORE);
+    const double xRef = sums[0] / sums[1];
+
+    // A single sweep for the residual, its L2 norm and OpenFOAM's normFactor, then one reduction
+    AMGX_PROFILE_TRAFFIC(Host, 32.0 * nLocalRows, 0.0, 11.0 * nLocalRows);
+    const double* sumA = matrix.getSumA();
+    double res[3] = {0.0, 0.0, 0.0};
+    for (int i = 0; i < nLocalRows; ++i)
+    {
+        const double pA = sumA[i] * xRef;
+        const double r = bscalar[i] - residualAx[i];
+        res[0] += std::abs(r);
+        res[1] += std::abs(residualAx[i] - pA) + std::abs(bscalar[i] - pA);
+        res[2] += r * r;
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, res, 3, MPI_DOUBLE, MPI_SUM, globalCpuWorld);
+
+    // OpenFOAM adds a small value to avoid dividing by zero
+    lastNormFactor = res[1] + 1e-20;
+    lastInitialNorm = std::sqrt(res[2]);
+
+    return res[0] / lastNormFactor;
+}
+
+
+/* \implements AmgXSolver::computeFinalResidual */
+double AmgXSolver::computeFinalResidual(
+    int nLocalRows, const double* bscalar, AmgXCSRMatrix& matrix)
+{
+    multiplySolution(nLocalRows, matrix);
+
+    AMGX_PROFILE_TRAFFIC(Host, 16.0 * nLocalRows, 0.0, 2.0 * nLocalRows);
+    double res = 0.0;
+    for (int i = 0; i < nLocalRows; ++i)
+    {
+        res += std::abs(bscalar[i] - residualAx[i]);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &res, 1, MPI_DOUBLE, MPI_SUM, globalCpuWorld);
+
+    return res / lastNormFactor;
+}
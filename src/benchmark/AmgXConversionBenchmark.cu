@@ -0,0 +1,445 @@
+/*
+ * Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+// Benchmark of the LDU to CSR conversion of AmgXCSRMatrix
+//
+// Measures setValuesLDU and updateValues, in double and float, on the device
+// and host engines, with and without consolidation, over generated meshes.
+// The host memory of a measurement is the growth of the peak resident set
+// of the ranks during it, restarted through /proc/self/clear_refs (Linux).
+//
+// Usage: mpirun -np <n> foam_csr_benchmark [options]
+//   --cells 1e5,1e6,1e7     global numbers of cells
+//   --mesh hex,tet,poly     connectivities of the generated meshes
+//   --threads 0             threads generating the meshes, 0 for all
+//   --location device,host  engines of the conversion
+//   --precision double,float
+//   --ranks-per-device 1,2  ranks sharing a device, above 1 the matrix is consolidated
+//   --repeat 5              repetitions of each measurement
+//   --json <file>           write the results as JSON
+
+#include <AmgXSolver.H>
+#include <generator/AmgXMeshGenerator.H>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+// The coefficients of a generated mesh in the precision of the benchmark
+template<typename T>
+struct BenchmarkValues
+{
+    std::vector<T> diag;
+    std::vector<T> upper;
+    std::vector<T> lower;
+    std::vector<T> ext;
+};
+
+template<typename T>
+BenchmarkValues<T> convertValues(AmgXGeneratedMesh &mesh)
+{
+    BenchmarkValues<T> values;
+    values.diag.assign(mesh.diag.begin(), mesh.diag.end());
+    values.upper.assign(mesh.upper.begin(), mesh.upper.end());
+    values.lower.assign(mesh.lower.begin(), mesh.lower.end());
+    values.ext.assign(mesh.ext.begin(), mesh.ext.end());
+
+    // Only one copy of the coefficients is kept
+    std::vector<double>().swap(mesh.diag);
+    std::vector<double>().swap(mesh.upper);
+    std::vector<double>().swap(mesh.lower);
+    std::vector<double>().swap(mesh.ext);
+
+    return values;
+}
+
+// One measurement of the benchmark
+struct BenchmarkResult
+{
+    std::string operation;
+    std::string precision;
+    std::string location;
+    std::string mesh;
+    int ranksPerDevice;
+    bool consolidated;
+    long nCells;
+    long nNz;
+    double minTime;
+    double meanTime;
+    double bytes;
+    long hostPeakDeltaBytes;
+    long deviceBytes;
+};
+
+// The time of the slowest rank
+double elapsed(double tStart, MPI_Comm comm)
+{
+    double local = MPI_Wtime() - tStart;
+    double time;
+    MPI_Allreduce(&local, &time, 1, MPI_DOUBLE, MPI_MAX, comm);
+    return time;
+}
+
+// A field of /proc/self/status in bytes, -1 if unavailable
+long statusBytes(const char *field)
+{
+    FILE *status = fopen("/proc/self/status", "r");
+    if (status == nullptr) return -1;
+
+    const size_t length = strlen(field);
+    long kB = -1;
+    char line[256];
+
+    while (fgets(line, sizeof(line), status) != nullptr)
+    {
+        if (strncmp(line, field, length) == 0 && line[length] == ':')
+        {
+            kB = atol(line + length + 1);
+            break;
+        }
+    }
+
+    fclose(status);
+    return kB < 0 ? -1 : kB * 1024L;
+}
+
+// Restart the peak resident set of this process from the current one, and
+// return the current one, -1 if the peak cannot be restarted (before Linux 4.0)
+long startHostPeak()
+{
+    FILE *clearRefs = fopen("/proc/self/clear_refs", "w");
+    if (clearRefs == nullptr) return -1;
+
+    const bool reset = fputs("5", clearRefs) >= 0;
+    if (fclose(clearRefs) != 0 || !reset) return -1;
+
+    return statusBytes("VmRSS");
+}
+
+// The growth of the peak resident set since startHostPeak, the maximum of all
+// ranks, -1 if it could not be measured on a rank. ru_maxrss is not used, it
+// is the peak of the whole run rather than of one measurement
+long hostPeakDeltaBytes(long start, MPI_Comm comm)
+{
+    const long peak = start < 0 ? -1 : statusBytes("VmHWM");
+    long local[2] = {peak < 0 ? 0 : peak - start, peak < 0 ? 1 : 0};
+    long global[2];
+    MPI_Allreduce(local, global, 2, MPI_LONG, MPI_MAX, comm);
+    return global[1] ? -1 : global[0];
+}
+
+// The memory in use on the devices, summed over the roots of the devices
+long deviceUsedBytes(bool root, bool onDevice, MPI_Comm comm)
+{
+    long local = 0;
+
+    if (root && onDevice)
+    {
+        size_t freeBytes, totalBytes;
+        cudaMemGetInfo(&freeBytes, &totalBytes);
+        local = totalBytes - freeBytes;
+    }
+
+    long used;
+    MPI_Allreduce(&local, &used, 1, MPI_LONG, MPI_SUM, comm);
+    return used;
+}
+
+std::vector<std::string> split(const std::string &list)
+{
+    std::vector<std::string> items;
+
+    size_t start = 0;
+    while (start <= list.size())
+    {
+        size_t stop = list.find(',', start);
+        if (stop == std::string::npos) stop = list.size();
+        if (stop > start) items.push_back(list.substr(start, stop - start));
+        start = stop + 1;
+    }
+
+    return items;
+}
+
+template<typename T>
+void benchmark(const AmgXMeshGenerator &generator, const std::string &meshName,
+               MatrixLocation location, int ranksPerDevice, int nRepeat,
+               MPI_Comm comm, std::vector<BenchmarkResult> &results)
+{
+    const bool onDevice = location == MatrixLocation::Device;
+
+    int localRank;
+    MPI_Comm localWorld, devWorld;
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &localWorld);
+    MPI_Comm_rank(localWorld, &localRank);
+
+    // Ranks share a device in consecutive groups, the host engine does not consolidate
+    int group = onDevice ? localRank / ranksPerDevice : localRank;
+    MPI_Comm_split(localWorld, group, 0, &devWorld);
+
+    int devRank;
+    MPI_Comm_rank(devWorld, &devRank);
+
+    if (onDevice)
+    {
+        int nDevs;
+        CHECK(cudaGetDeviceCount(&nDevs));
+        CHECK(cudaSetDevice(group % nDevs));
+    }
+
+    const int gpuProc = (devRank == 0) ? 0 : MPI_UNDEFINED;
+
+    AmgXGeneratedMesh mesh = generator.generate(comm);
+    BenchmarkValues<T> values = convertValues<T>(mesh);
+    const int nExt = mesh.nExt;
+
+    const double nLocalNz = mesh.nCells + 2.0 * mesh.nFaces + nExt;
+
+    double nGlobalNz = nLocalNz;
+    MPI_Allreduce(MPI_IN_PLACE, &nGlobalNz, 1, MPI_DOUBLE, MPI_SUM, comm);
+    const long deviceBase = deviceUsedBytes(gpuProc == 0, onDevice, comm);
+
+    BenchmarkResult result;
+    result.precision = sizeof(T) == sizeof(double) ? "double" : "float";
+    result.location = onDevice ? "device" : "host";
+    result.mesh = meshName;
+    result.ranksPerDevice = onDevice ? ranksPerDevice : 1;
+    result.nCells = mesh.nGlobalCells;
+    result.nNz = nGlobalNz;
+
+    // The conversion of the structure and values, from a new matrix each time
+    long hostStart = startHostPeak();
+    std::unique_ptr<AmgXCSRMatrix> matrix;
+    double minTime = 1e300, sumTime = 0.0;
+    for (int r = 0; r < nRepeat; ++r)
+    {
+        if (matrix) matrix->finalise();
+        matrix.reset(new AmgXCSRMatrix);
+        matrix->initialiseComms(devWorld, gpuProc, location);
+
+        MPI_Barrier(comm);
+        const double tStart = MPI_Wtime();
+
+        matrix->setValuesLDU(mesh.nCells, mesh.nFaces, mesh.diagIndexGlobal, mesh.lowOffGlobal,
+                             mesh.uppOffGlobal, mesh.upperAddr.data(), mesh.lowerAddr.data(), nExt,
+                             mesh.extRow.data(), mesh.extCol.data(), values.diag.data(),
+                             values.upper.data(), values.lower.data(), values.ext.data());
+
+        if (onDevice) CHECK(cudaDeviceSynchronize());
+
+        const double time = elapsed(tStart, comm);
+        minTime = std::min(minTime, time);
+        sumTime += time;
+    }
+
+    int consolidated = matrix->isConsolidated();
+    MPI_Allreduce(MPI_IN_PLACE, &consolidated, 1, MPI_INT, MPI_MAX, comm);
+    result.consolidated = consolidated;
+
+    // Read the addressing and values, write the row offsets, columns and values
+    result.operation = "setValuesLDU";
+    result.minTime = minTime;
+    result.meanTime = sumTime / nRepeat;
+    result.bytes = sizeof(int) * (2.0 * mesh.nFaces + 2.0 * nExt) + sizeof(T) * nLocalNz
+                 + sizeof(int) * (mesh.nCells + 1.0) + (sizeof(int) + sizeof(double)) * nLocalNz;
+    MPI_Allreduce(MPI_IN_PLACE, &result.bytes, 1, MPI_DOUBLE, MPI_SUM, comm);
+    result.hostPeakDeltaBytes = hostPeakDeltaBytes(hostStart, comm);
+    result.deviceBytes = deviceUsedBytes(gpuProc == 0, onDevice, comm) - deviceBase;
+    results.push_back(result);
+
+    // The update of the values with the stored permutation
+    hostStart = startHostPeak();
+    minTime = 1e300;
+    sumTime = 0.0;
+    for (int r = 0; r < nRepeat; ++r)
+    {
+        MPI_Barrier(comm);
+        const double tStart = MPI_Wtime();
+
+        matrix->updateValues(mesh.nCells, mesh.nFaces, nExt, values.diag.data(),
+                             values.upper.data(), values.lower.data(), values.ext.data());
+
+        if (onDevice) CHECK(cudaDeviceSynchronize());
+
+        const double time = elapsed(tStart, comm);
+        minTime = std::min(minTime, time);
+        sumTime += time;
+    }
+
+    // Read the values and permutation, write the values
+    result.operation = "updateValues";
+    result.minTime = minTime;
+    result.meanTime = sumTime / nRepeat;
+    result.bytes = (sizeof(T) + sizeof(int) + sizeof(double)) * nGlobalNz;
+    result.hostPeakDeltaBytes = hostPeakDeltaBytes(hostStart, comm);
+    results.push_back(result);
+
+    matrix->finalise();
+
+    MPI_Comm_free(&devWorld);
+    MPI_Comm_free(&localWorld);
+}
+
+void writeJSON(const std::string &fileName, int nRanks, const std::vector<BenchmarkResult> &results)
+{
+    FILE *json = fopen(fileName.c_str(), "w");
+    if (json == nullptr)
+    {
+        fprintf(stderr, "Cannot open the benchmark output %s.\n", fileName.c_str());
+        return;
+    }
+
+    fprintf(json, "{\n  \"ranks\": %d,\n  \"results\": [", nRanks);
+
+    const char *separator = "\n";
+    for (const BenchmarkResult &r : results)
+    {
+        fprintf(json, "%s    {\"operation\": \"%s\", \"precision\": \"%s\", \"location\": \"%s\", \"mesh\": \"%s\", "
+                "\"ranksPerDevice\": %d, \"consolidated\": %s, \"cells\": %ld, \"nonZeros\": %ld, "
+                "\"minSeconds\": %.6e, \"meanSeconds\": %.6e, \"cellsPerSecond\": %.6e, "
+                "\"effectiveGBs\": %.6e, \"hostPeakDeltaBytes\": %ld, \"deviceBytes\": %ld}",
+                separator, r.operation.c_str(), r.precision.c_str(), r.location.c_str(), r.mesh.c_str(),
+                r.ranksPerDevice, r.consolidated ? "true" : "false", r.nCells, r.nNz,
+                r.minTime, r.meanTime, r.nCells / r.minTime, r.bytes / r.minTime * 1e-9,
+                r.hostPeakDeltaBytes, r.deviceBytes);
+        separator = ",\n";
+    }
+
+    fprintf(json, "\n  ]\n}\n");
+    fclose(json);
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    MPI_Init(&argc, &argv);
+
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    std::string cells = "1e5,1e6,1e7";
+    std::string meshes = "hex";
+    std::string locations = "device,host";
+    std::string precisions = "double,float";
+    std::string ranksPerDevice = "1";
+    std::string jsonFile;
+    int nRepeat = 5;
+    int nThreads = 0;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        const char *value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+        if (value == nullptr)
+        {
+            if (rank == 0) fprintf(stderr, "Missing value of %s.\n", arg.c_str());
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+
+        if (arg == "--cells") cells = value;
+        else if (arg == "--mesh") meshes = value;
+        else if (arg == "--threads") nThreads = atoi(value);
+        else if (arg == "--location") locations = value;
+        else if (arg == "--precision") precisions = value;
+        else if (arg == "--ranks-per-device") ranksPerDevice = value;
+        else if (arg == "--repeat") nRepeat = std::max(1, atoi(value));
+        else if (arg == "--json") jsonFile = value;
+        else
+        {
+            if (rank == 0) fprintf(stderr, "Unknown option %s.\n", arg.c_str());
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+
+        ++i;
+    }
+
+    std::vector<BenchmarkResult> results;
+
+    for (const std::string &location : split(locations))
+    {
+        const MatrixLocation matrixLocation =
+            (location == "host") ? MatrixLocation::Host : MatrixLocation::Device;
+
+        for (const std::string &group : split(ranksPerDevice))
+        {
+            // Groups of ranks only change the device engine
+            if (matrixLocation == MatrixLocation::Host && group != split(ranksPerDevice).front()) continue;
+
+            for (const std::string &precision : split(precisions))
+            {
+                for (const std::string &meshName : split(meshes))
+                {
+                    for (const std::string &n : split(cells))
+                    {
+                        const AmgXMeshGenerator generator(atof(n.c_str()),
+                            AmgXMeshGenerator::connectivityFromString(meshName), nThreads);
+
+                        if (precision == "float")
+                        {
+                            benchmark<float>(generator, meshName, matrixLocation, atoi(group.c_str()),
+                                             nRepeat, MPI_COMM_WORLD, results);
+                        }
+                        else
+                        {
+                            benchmark<double>(generator, meshName, matrixLocation, atoi(group.c_str()),
+                                              nRepeat, MPI_COMM_WORLD, results);
+                        }
+
+                        if (rank == 0)
+                        {
+                            for (size_t r = results.size() - 2; r < results.size(); ++r)
+                            {
+                                const BenchmarkResult &result = results[r];
+                                printf("%-13s %-6s %-6s %-4s ranks/dev %d cons %d cells %10ld  %10.4f s  %10.3e cells/s  %8.2f GB/s  host +%8.1f MB  dev %8.1f MB\n",
+                                       result.operation.c_str(), result.precision.c_str(), result.location.c_str(),
+                                       result.mesh.c_str(), result.ranksPerDevice, (int)result.consolidated,
+                                       result.nCells, result.minTime, result.nCells / result.minTime,
+                                       result.bytes / result.minTime * 1e-9, result.hostPeakDeltaBytes / 1048576.0,
+                                       result.deviceBytes / 1048576.0);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    if (rank == 0 && !jsonFile.empty())
+    {
+        writeJSON(jsonFile, size, results);
+    }
+
+    MPI_Finalize();
+
+    return 0;
+}
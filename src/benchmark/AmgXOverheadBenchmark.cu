@@ -0,0 +1,285 @@
+/*
+ * Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+// Benchmark of the overhead of the wrapper, linked with the AmgX stand-in
+//
+// Times setOperator, updateOperator and solve of AmgXSolver over generated
+// meshes, and subtracts the time spent in the stand-in, whose costs are set
+// by the AMGX_STANDIN_* environment variables. What remains is the time of
+// the copies, barriers and communications of the wrapper. The host modes run
+// on nodes without devices.
+//
+// Usage: mpirun -np <n> foam_csr_overhead [options]
+//   --cells 1e3,1e4,1e5     global numbers of cells
+//   --mesh hex              connectivity of the generated meshes
+//   --mode hDDI             AmgX mode, the device modes consolidate as usual
+//   --solves 20             timed solves of each size
+//   --json <file>           write the results as JSON
+
+#include <AmgXSolver.H>
+#include <generator/AmgXMeshGenerator.H>
+#include <standin/AmgXStandIn.H>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+// One measurement of the benchmark, in seconds per call
+struct OverheadResult
+{
+    std::string operation;
+    long nCells;
+    long nNz;
+    long nCalls;
+
+    // The mean and maximum over ranks of the time of a call
+    double meanTime;
+    double maxTime;
+
+    // The same, for the time spent in the stand-in
+    double meanStandIn;
+    double maxStandIn;
+
+    // The maximum over ranks of the time outside of the stand-in
+    double maxOverhead;
+};
+
+std::vector<std::string> split(const std::string &list)
+{
+    std::vector<std::string> items;
+
+    size_t start = 0;
+    while (start <= list.size())
+    {
+        size_t stop = list.find(',', start);
+        if (stop == std::string::npos) stop = list.size();
+        if (stop > start) items.push_back(list.substr(start, stop - start));
+        start = stop + 1;
+    }
+
+    return items;
+}
+
+double standInTime(const AmgXStandInTimes &t)
+{
+    return t.upload + t.setup + t.solve + t.download;
+}
+
+// Reduces the times of nCalls calls of this rank
+OverheadResult reduceTimes(const std::string &operation, double time, double standIn,
+                           long nCalls, MPI_Comm comm)
+{
+    int size;
+    MPI_Comm_size(comm, &size);
+
+    OverheadResult result;
+    result.operation = operation;
+    result.nCalls = nCalls;
+
+    double local[3] = {time / nCalls, standIn / nCalls, (time - standIn) / nCalls};
+    double sum[3], max[3];
+    MPI_Allreduce(local, sum, 3, MPI_DOUBLE, MPI_SUM, comm);
+    MPI_Allreduce(local, max, 3, MPI_DOUBLE, MPI_MAX, comm);
+
+    result.meanTime = sum[0] / size;
+    result.maxTime = max[0];
+    result.meanStandIn = sum[1] / size;
+    result.maxStandIn = max[1];
+    result.maxOverhead = max[2];
+
+    return result;
+}
+
+void benchmark(const AmgXMeshGenerator &generator, const std::string &mode, int nSolves,
+               MPI_Comm comm, std::vector<OverheadResult> &results)
+{
+    AmgXGeneratedMesh mesh = generator.generate(comm);
+    const int nLocalNz = mesh.nCells + 2 * mesh.nFaces + mesh.nExt;
+
+    long nGlobalNz = nLocalNz;
+    MPI_Allreduce(MPI_IN_PLACE, &nGlobalNz, 1, MPI_LONG, MPI_SUM, comm);
+
+    // The stand-in ignores the configuration, but the file is read at initialisation
+    AmgXSolver solver(comm, mode, "/dev/null");
+
+    AmgXCSRMatrix matrix;
+    solver.initialiseMatrixComms(matrix);
+    matrix.setValuesLDU(mesh.nCells, mesh.nFaces, mesh.diagIndexGlobal, mesh.lowOffGlobal,
+                        mesh.uppOffGlobal, mesh.upperAddr.data(), mesh.lowerAddr.data(), mesh.nExt,
+                        mesh.extRow.data(), mesh.extCol.data(), mesh.diag.data(), mesh.upper.data(),
+                        mesh.lower.data(), mesh.ext.data());
+
+    std::vector<double> x(mesh.nCells, 0.0), b(mesh.nCells, 1.0);
+    const size_t first = results.size();
+
+    // The upload of the structure and values, and the setup
+    MPI_Barrier(comm);
+    resetAmgXStandInTimes();
+    double tStart = MPI_Wtime();
+
+    solver.setOperator(mesh.nCells, mesh.nGlobalCells, nLocalNz, matrix);
+
+    double time = MPI_Wtime() - tStart;
+    results.push_back(reduceTimes("setOperator", time, standInTime(getAmgXStandInTimes()), 1, comm));
+
+    // The replacement of the values, and the setup
+    MPI_Barrier(comm);
+    resetAmgXStandInTimes();
+    tStart = MPI_Wtime();
+
+    solver.updateOperator(mesh.nCells, nLocalNz, matrix);
+
+    time = MPI_Wtime() - tStart;
+    results.push_back(reduceTimes("updateOperator", time, standInTime(getAmgXStandInTimes()), 1, comm));
+
+    // A first solve allocates the buffers of the wrapper
+    solver.solve(mesh.nCells, x.data(), b.data(), matrix);
+
+    // The solves follow each other as in a time loop, without barriers in between
+    MPI_Barrier(comm);
+    resetAmgXStandInTimes();
+    tStart = MPI_Wtime();
+
+    for (int s = 0; s < nSolves; ++s)
+    {
+        solver.solve(mesh.nCells, x.data(), b.data(), matrix);
+    }
+
+    time = MPI_Wtime() - tStart;
+    results.push_back(reduceTimes("solve", time, standInTime(getAmgXStandInTimes()), nSolves, comm));
+
+    for (size_t r = first; r < results.size(); ++r)
+    {
+        results[r].nCells = mesh.nGlobalCells;
+        results[r].nNz = nGlobalNz;
+    }
+
+    matrix.finalise();
+    solver.finalize();
+}
+
+void writeJSON(const std::string &fileName, int nRanks, const std::string &mode,
+               const std::vector<OverheadResult> &results)
+{
+    FILE *json = fopen(fileName.c_str(), "w");
+    if (json == nullptr)
+    {
+        fprintf(stderr, "Cannot open the benchmark output %s.\n", fileName.c_str());
+        return;
+    }
+
+    fprintf(json, "{\n  \"ranks\": %d,\n  \"mode\": \"%s\",\n  \"results\": [", nRanks, mode.c_str());
+
+    const char *separator = "\n";
+    for (const OverheadResult &r : results)
+    {
+        fprintf(json, "%s    {\"operation\": \"%s\", \"cells\": %ld, \"nonZeros\": %ld, \"calls\": %ld, "
+                "\"meanSeconds\": %.6e, \"maxSeconds\": %.6e, \"meanStandInSeconds\": %.6e, "
+                "\"maxStandInSeconds\": %.6e, \"maxOverheadSeconds\": %.6e}",
+                separator, r.operation.c_str(), r.nCells, r.nNz, r.nCalls, r.meanTime, r.maxTime,
+                r.meanStandIn, r.maxStandIn, r.maxOverhead);
+        separator = ",\n";
+    }
+
+    fprintf(json, "\n  ]\n}\n");
+    fclose(json);
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided);
+
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    std::string cells = "1e3,1e4,1e5";
+    std::string meshName = "hex";
+    std::string mode = "hDDI";
+    std::string jsonFile;
+    int nSolves = 20;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        const char *value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+        if (value == nullptr)
+        {
+            if (rank == 0) fprintf(stderr, "Missing value of %s.\n", arg.c_str());
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+
+        if (arg == "--cells") cells = value;
+        else if (arg == "--mesh") meshName = value;
+        else if (arg == "--mode") mode = value;
+        else if (arg == "--solves") nSolves = std::max(1, atoi(value));
+        else if (arg == "--json") jsonFile = value;
+        else
+        {
+            if (rank == 0) fprintf(stderr, "Unknown option %s.\n", arg.c_str());
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+
+        ++i;
+    }
+
+    std::vector<OverheadResult> results;
+
+    for (const std::string &n : split(cells))
+    {
+        const AmgXMeshGenerator generator(atof(n.c_str()),
+            AmgXMeshGenerator::connectivityFromString(meshName));
+
+        benchmark(generator, mode, nSolves, MPI_COMM_WORLD, results);
+
+        if (rank == 0)
+        {
+            for (size_t r = results.size() - 3; r < results.size(); ++r)
+            {
+                const OverheadResult &result = results[r];
+                printf("%-15s cells %10ld  call %10.3e s (max %10.3e)  stand-in %10.3e s (max %10.3e)  "
+                       "overhead max %10.3e s  %5.1f %%\n",
+                       result.operation.c_str(), result.nCells, result.meanTime, result.maxTime,
+                       result.meanStandIn, result.maxStandIn, result.maxOverhead,
+                       100.0 * result.maxOverhead / std::max(result.maxTime, 1e-300));
+            }
+        }
+    }
+
+    if (rank == 0 && !jsonFile.empty())
+    {
+        writeJSON(jsonFile, size, mode, results);
+    }
+
+    MPI_Finalize();
+
+    return 0;
+}
@@ -0,0 +1,330 @@
+/*
+ * Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "AmgXMeshGenerator.H"
+
+#include <AmgXParallel.H>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <thread>
+
+namespace
+{
+
+// The largest number of neighbours of a cell with a higher index
+constexpr int maxUpperOffsets = 7;
+
+}
+
+AmgXMeshGenerator::AmgXMeshGenerator
+(
+    long nGlobalCells,
+    MeshConnectivity connectivity,
+    int nThreads
+)
+:
+    nGlobalCells(nGlobalCells),
+    connectivity(connectivity),
+    nThreads(defaultThreads(nThreads))
+{
+    if (nGlobalCells <= 0 || nGlobalCells > std::numeric_limits<int>::max())
+    {
+        fprintf(stderr, "The number of cells of a generated mesh must be positive and fit in 32 bits.\n");
+        exit(0);
+    }
+
+    // A lattice of about cubic shape, the last xy-plane may be partial
+    nx = std::max(1L, (long)std::cbrt((double)nGlobalCells));
+    ny = nx;
+    nz = (nGlobalCells + nx * ny - 1) / (nx * ny);
+}
+
+void AmgXMeshGenerator::setCoefficients(double asymmetry, double diagShift)
+{
+    this->asymmetry = asymmetry;
+    this->diagShift = diagShift;
+}
+
+MeshConnectivity AmgXMeshGenerator::connectivityFromString(const std::string &name)
+{
+    if (name == "hex") return MeshConnectivity::Hex;
+    if (name == "tet") return MeshConnectivity::TetLike;
+    if (name == "poly") return MeshConnectivity::PolyLike;
+
+    fprintf(stderr, "%s is not an available connectivity! Available connectivities are: "
+                    "hex, tet, poly.\n", name.c_str());
+    exit(0);
+}
+
+bool AmgXMeshGenerator::exists(long i, long j, long k) const
+{
+    return i >= 0 && i < nx && j >= 0 && j < ny && k >= 0 && k < nz
+        && (k * ny + j) * nx + i < nGlobalCells;
+}
+
+int AmgXMeshGenerator::upperOffsets(long i, long j, long k, int offsets[][3]) const
+{
+    int n = 0;
+
+    auto add = [&](int di, int dj, int dk)
+    {
+        if (exists(i + di, j + dj, k + dk))
+        {
+            offsets[n][0] = di;
+            offsets[n][1] = dj;
+            offsets[n][2] = dk;
+            ++n;
+        }
+    };
+
+    // In increasing index, x varies fastest
+    switch (connectivity)
+    {
+    case MeshConnectivity::Hex:
+    {
+        add(1, 0, 0);
+        add(0, 1, 0);
+        add(0, 0, 1);
+        break;
+    }
+    case MeshConnectivity::TetLike:
+    {
+        add(1, 0, 0);
+        if ((i + j + k) % 2 == 0) add(0, 1, 0);
+        else add(0, 0, 1);
+        break;
+    }
+    case MeshConnectivity::PolyLike:
+    {
+        add(1, 0, 0);
+        add(0, 1, 0);
+        add(1, 1, 0);
+        add(0, 0, 1);
+        add(1, 0, 1);
+        add(0, 1, 1);
+        add(1, 1, 1);
+        break;
+    }
+    }
+
+    return n;
+}
+
+int AmgXMeshGenerator::lowerOffsets(long i, long j, long k, int offsets[][3]) const
+{
+    int n = 0;
+
+    auto add = [&](int di, int dj, int dk)
+    {
+        if (exists(i + di, j + dj, k + dk))
+        {
+            offsets[n][0] = di;
+            offsets[n][1] = dj;
+            offsets[n][2] = dk;
+            ++n;
+        }
+    };
+
+    // The cells having this one among their upper offsets
+    switch (connectivity)
+    {
+    case MeshConnectivity::Hex:
+    {
+        add(-1, 0, 0);
+        add(0, -1, 0);
+        add(0, 0, -1);
+        break;
+    }
+    case MeshConnectivity::TetLike:
+    {
+        add(-1, 0, 0);
+        if ((i + j + k) % 2 == 1) add(0, -1, 0);
+        if ((i + j + k) % 2 == 0) add(0, 0, -1);
+        break;
+    }
+    case MeshConnectivity::PolyLike:
+    {
+        add(-1, 0, 0);
+        add(0, -1, 0);
+        add(-1, -1, 0);
+        add(0, 0, -1);
+        add(-1, 0, -1);
+        add(0, -1, -1);
+        add(-1, -1, -1);
+        break;
+    }
+    }
+
+    return n;
+}
+
+AmgXGeneratedMesh AmgXMeshGenerator::generate(MPI_Comm comm) const
+{
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    return generate(rank, size);
+}
+
+AmgXGeneratedMesh AmgXMeshGenerator::generate(int rank, int nRanks) const
+{
+    const long begin = nGlobalCells * rank / nRanks;
+    const long end = nGlobalCells * (rank + 1) / nRanks;
+    const long nxy = nx * ny;
+
+    AmgXGeneratedMesh mesh;
+    mesh.nCells = end - begin;
+    mesh.nGlobalCells = nGlobalCells;
+    mesh.diagIndexGlobal = begin;
+    mesh.lowOffGlobal = begin;
+    mesh.uppOffGlobal = begin;
+
+    const double upperCoeff = -1.0;
+    const double lowerCoeff = -(1.0 + asymmetry);
+
+    // The internal faces of each chunk, counted first to place them
+    std::vector<long> chunkFaces(nThreads + 1, 0);
+
+    parallelChunks(nThreads, mesh.nCells,
+        [&](int t, long first, long last)
+        {
+            int offsets[maxUpperOffsets][3];
+            long nFaces = 0;
+
+            for (long c = begin + first; c < begin + last; ++c)
+            {
+                const long i = c % nx, j = (c / nx) % ny, k = c / nxy;
+                const int n = upperOffsets(i, j, k, offsets);
+
+                for (int o = 0; o < n; ++o)
+                {
+                    nFaces += c + offsets[o][0] + offsets[o][1] * nx + offsets[o][2] * nxy < end;
+                }
+            }
+
+            chunkFaces[t + 1] = nFaces;
+        });
+
+    for (int t = 0; t < nThreads; ++t)
+    {
+        chunkFaces[t + 1] += chunkFaces[t];
+    }
+
+    if (chunkFaces[nThreads] > std::numeric_limits<int>::max())
+    {
+        fprintf(stderr, "The number of faces of a generated part must fit in 32 bits.\n");
+        exit(0);
+    }
+
+    mesh.nFaces = chunkFaces[nThreads];
+    mesh.lowerAddr.resize(mesh.nFaces);
+    mesh.upperAddr.resize(mesh.nFaces);
+    mesh.upper.assign(mesh.nFaces, upperCoeff);
+    mesh.lower.assign(mesh.nFaces, lowerCoeff);
+    mesh.diag.resize(mesh.nCells);
+
+    // The faces in upper-triangular order, and the diagonal of each row
+    parallelChunks(nThreads, mesh.nCells,
+        [&](int t, long first, long last)
+        {
+            int offsets[maxUpperOffsets][3];
+            long face = chunkFaces[t];
+
+            for (long c = begin + first; c < begin + last; ++c)
+            {
+                const long i = c % nx, j = (c / nx) % ny, k = c / nxy;
+                const int n = upperOffsets(i, j, k, offsets);
+
+                for (int o = 0; o < n; ++o)
+                {
+                    const long neighbour = c + offsets[o][0] + offsets[o][1] * nx + offsets[o][2] * nxy;
+
+                    if (neighbour < end)
+                    {
+                        mesh.lowerAddr[face] = c - begin;
+                        mesh.upperAddr[face] = neighbour - begin;
+                        ++face;
+                    }
+                }
+
+                const int nLower = lowerOffsets(i, j, k, offsets);
+
+                mesh.diag[c - begin] = n * std::fabs(upperCoeff) + nLower * std::fabs(lowerCoeff) + diagShift;
+            }
+        });
+
+    // The faces with the other ranks, only cells within a plane of the ends of the range have them
+    const long reach = nxy + nx + 1;
+
+    auto addExt = [&](long c)
+    {
+        const long i = c % nx, j = (c / nx) % ny, k = c / nxy;
+
+        int offsets[maxUpperOffsets][3];
+        const int n = upperOffsets(i, j, k, offsets);
+
+        for (int o = 0; o < n; ++o)
+        {
+            const long neighbour = c + offsets[o][0] + offsets[o][1] * nx + offsets[o][2] * nxy;
+
+            if (neighbour >= end)
+            {
+                mesh.extRow.push_back(c - begin);
+                mesh.extCol.push_back(neighbour);
+                mesh.ext.push_back(upperCoeff);
+            }
+        }
+
+        const int m = lowerOffsets(i, j, k, offsets);
+
+        for (int o = 0; o < m; ++o)
+        {
+            const long other = c + offsets[o][0] + offsets[o][1] * nx + offsets[o][2] * nxy;
+
+            if (other < begin)
+            {
+                mesh.extRow.push_back(c - begin);
+                mesh.extCol.push_back(other);
+                mesh.ext.push_back(lowerCoeff);
+            }
+        }
+    };
+
+    for (long c = begin; c < std::min(end, begin + reach); ++c)
+    {
+        addExt(c);
+    }
+
+    for (long c = std::max(begin + reach, end - reach); c < end; ++c)
+    {
+        addExt(c);
+    }
+
+    mesh.nExt = mesh.extRow.size();
+
+    return mesh;
+}
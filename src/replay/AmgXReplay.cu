@@ -0,0 +1,365 @@
+/*
+ * Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+// Replay of the calls recorded by AmgXRecorder (AMGX_WRAPPER_RECORD=<prefix>)
+//
+// Usage: mpirun -np <recorded ranks> foam_csr_replay <prefix> [options]
+//   --config <file>   use this AmgX configuration instead of the recorded ones
+//   --mode <mode>     use this AmgX mode instead of the recorded ones
+//   --quiet           only print the summary
+//
+// Each call is timed on each rank; the summary gives the time of the slowest
+// rank. AMGX_WRAPPER_PROFILE can be set as for any run of the wrapper.
+
+#include <AmgXSolver.H>
+#include <AmgXRecorder.H>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+const char* typeName(AmgXRecordType type)
+{
+    switch (type)
+    {
+        case AmgXRecordType::Initialize: return "initialize";
+        case AmgXRecordType::InitialiseMatrix: return "initialiseMatrixComms";
+        case AmgXRecordType::SetValuesLDU: return "setValuesLDU";
+        case AmgXRecordType::UpdateValues: return "updateValues";
+        case AmgXRecordType::SetOperator: return "setOperator";
+        case AmgXRecordType::UpdateOperator: return "updateOperator";
+        case AmgXRecordType::Solve: return "solve";
+        case AmgXRecordType::FinaliseMatrix: return "finaliseMatrix";
+        case AmgXRecordType::Finalize: return "finalize";
+        case AmgXRecordType::LoadSnapshot: return "loadSnapshot";
+        default: return "unknown";
+    }
+}
+
+// Writes the embedded configuration of a solver to a temporary file
+std::string writeConfig(const std::string &contents)
+{
+    char fileName[] = "/tmp/amgxreplayXXXXXX";
+    int fd = mkstemp(fileName);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Cannot create a temporary configuration file.\n");
+        exit(0);
+    }
+
+    if (write(fd, contents.data(), contents.size()) != (ssize_t)contents.size())
+    {
+        fprintf(stderr, "Cannot write the temporary configuration file %s.\n", fileName);
+        exit(0);
+    }
+
+    close(fd);
+    return fileName;
+}
+
+// Writes the embedded snapshot of this rank to a temporary directory, and returns its prefix
+std::string writeSnapshot(const std::string &contents, int rank)
+{
+    char directory[] = "/tmp/amgxreplayXXXXXX";
+    if (mkdtemp(directory) == nullptr)
+    {
+        fprintf(stderr, "Cannot create a temporary snapshot directory.\n");
+        exit(0);
+    }
+
+    const std::string prefix = std::string(directory) + "/snapshot";
+    const std::string fileName = prefix + "." + std::to_string(rank) + ".amgxcsr";
+
+    FILE *file = fopen(fileName.c_str(), "wb");
+    if (file == nullptr || fwrite(contents.data(), 1, contents.size(), file) != contents.size())
+    {
+        fprintf(stderr, "Cannot write the temporary snapshot %s.\n", fileName.c_str());
+        exit(0);
+    }
+
+    fclose(file);
+    return prefix;
+}
+
+// The time of each type of call on this rank
+struct CallTimes
+{
+    long count = 0;
+    double total = 0.0;
+    double max = 0.0;
+};
+
+}
+
+int main(int argc, char **argv)
+{
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided);
+
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    std::string prefix, config, mode;
+    bool quiet = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+
+        if (arg == "--config" && i + 1 < argc) config = argv[++i];
+        else if (arg == "--mode" && i + 1 < argc) mode = argv[++i];
+        else if (arg == "--quiet") quiet = true;
+        else if (prefix.empty() && arg[0] != '-') prefix = arg;
+        else
+        {
+            if (rank == 0) fprintf(stderr, "Unknown option %s.\n", arg.c_str());
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+
+    if (prefix.empty())
+    {
+        if (rank == 0) fprintf(stderr, "Usage: foam_csr_replay <prefix> [--config file] [--mode mode] [--quiet]\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    AmgXRecordReader reader(prefix + "." + std::to_string(rank) + ".amgxrec");
+
+    if (reader.getNRanks() != size)
+    {
+        if (rank == 0)
+        {
+            fprintf(stderr, "The recording was made with %d ranks, replay it with as many.\n",
+                    reader.getNRanks());
+        }
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    std::map<int, std::unique_ptr<AmgXSolver>> solvers;
+    std::map<int, std::unique_ptr<AmgXCSRMatrix>> matrices;
+    std::map<AmgXRecordType, CallTimes> times;
+
+    AmgXRecordEvent event;
+    long nSolves = 0;
+
+    while (reader.next(event))
+    {
+        AmgXSolver *solver = solvers.count(event.solver) ? solvers[event.solver].get() : nullptr;
+        AmgXCSRMatrix *matrix = matrices.count(event.matrix) ? matrices[event.matrix].get() : nullptr;
+
+        // A call on a solver or matrix the recording has not created, or has finalised,
+        // cannot be replayed, and skipping it would leave the ranks on different calls
+        const AmgXRecordType type = event.type;
+        const bool needsSolver = type == AmgXRecordType::InitialiseMatrix || type == AmgXRecordType::SetOperator
+            || type == AmgXRecordType::UpdateOperator || type == AmgXRecordType::Solve;
+        const bool needsMatrix = type == AmgXRecordType::SetValuesLDU || type == AmgXRecordType::UpdateValues
+            || type == AmgXRecordType::LoadSnapshot
+            || type == AmgXRecordType::SetOperator || type == AmgXRecordType::UpdateOperator
+            || type == AmgXRecordType::Solve;
+
+        if ((needsSolver && solver == nullptr) || (needsMatrix && matrix == nullptr))
+        {
+            fprintf(stderr, "The recorded call %s uses the unknown %s %d.\n", typeName(type),
+                    (needsSolver && solver == nullptr) ? "solver" : "matrix",
+                    (needsSolver && solver == nullptr) ? event.solver : event.matrix);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+
+        const double tStart = MPI_Wtime();
+        int iterations = -1;
+
+        switch (event.type)
+        {
+        case AmgXRecordType::Initialize:
+        {
+            const std::string cfgFile = config.empty() ? writeConfig(event.strings[2]) : config;
+
+            solvers[event.solver].reset(new AmgXSolver(MPI_COMM_WORLD,
+                mode.empty() ? event.strings[0] : mode, cfgFile));
+
+            if (config.empty()) unlink(cfgFile.c_str());
+            break;
+        }
+        case AmgXRecordType::InitialiseMatrix:
+        {
+            if (matrix == nullptr)
+            {
+                matrices[event.matrix].reset(new AmgXCSRMatrix);
+                matrix = matrices[event.matrix].get();
+            }
+
+            solver->initialiseMatrixComms(*matrix);
+            break;
+        }
+        case AmgXRecordType::SetValuesLDU:
+        {
+            const std::vector<long> &s = event.scalars;
+            const std::vector<std::vector<int>> &a = event.indices;
+
+            if (!event.floats.empty())
+            {
+                const std::vector<std::vector<float>> &v = event.floats;
+                matrix->setValuesLDU(s[0], s[1], s[2], s[3], s[4], a[0].data(), a[1].data(), s[5],
+                                     a[2].data(), a[3].data(), v[0].data(), v[1].data(),
+                                     v[2].data(), v[3].data());
+            }
+            else
+            {
+                const std::vector<std::vector<double>> &v = event.doubles;
+                matrix->setValuesLDU(s[0], s[1], s[2], s[3], s[4], a[0].data(), a[1].data(), s[5],
+                                     a[2].data(), a[3].data(), v[0].data(), v[1].data(),
+                                     v[2].data(), v[3].data());
+            }
+            break;
+        }
+        case AmgXRecordType::UpdateValues:
+        {
+            const std::vector<long> &s = event.scalars;
+
+            if (!event.floats.empty())
+            {
+                const std::vector<std::vector<float>> &v = event.floats;
+                matrix->updateValues(s[0], s[1], s[2], v[0].data(), v[1].data(), v[2].data(), v[3].data());
+            }
+            else
+            {
+                const std::vector<std::vector<double>> &v = event.doubles;
+                matrix->updateValues(s[0], s[1], s[2], v[0].data(), v[1].data(), v[2].data(), v[3].data());
+            }
+            break;
+        }
+        case AmgXRecordType::LoadSnapshot:
+        {
+            // A host matrix maps the snapshot, which stays mapped once its file is removed
+            const std::string snapshotPrefix = writeSnapshot(event.strings[1], rank);
+            const std::string fileName = snapshotPrefix + "." + std::to_string(rank) + ".amgxcsr";
+
+            if (!matrix->loadSnapshot(snapshotPrefix))
+            {
+                fprintf(stderr, "Cannot load the recorded snapshot %s.\n", event.strings[0].c_str());
+            }
+
+            unlink(fileName.c_str());
+            rmdir(fileName.substr(0, fileName.rfind('/')).c_str());
+            break;
+        }
+        case AmgXRecordType::SetOperator:
+        {
+            solver->setOperator(event.scalars[0], event.scalars[1], event.scalars[2], *matrix);
+            break;
+        }
+        case AmgXRecordType::UpdateOperator:
+        {
+            solver->updateOperator(event.scalars[0], event.scalars[1], *matrix);
+            break;
+        }
+        case AmgXRecordType::Solve:
+        {
+            solver->solve(event.scalars[0], event.doubles[0].data(), event.doubles[1].data(), *matrix);
+            solver->getIters(iterations);
+            ++nSolves;
+            break;
+        }
+        case AmgXRecordType::FinaliseMatrix:
+        {
+            if (matrix != nullptr) matrix->finalise();
+            matrices.erase(event.matrix);
+            break;
+        }
+        case AmgXRecordType::Finalize:
+        {
+            if (solver != nullptr) solver->finalize();
+            solvers.erase(event.solver);
+            break;
+        }
+        default:
+        {
+            fprintf(stderr, "Unknown call %d in the recording.\n", (int)event.type);
+            break;
+        }
+        }
+
+        const double time = MPI_Wtime() - tStart;
+
+        CallTimes &callTimes = times[event.type];
+        ++callTimes.count;
+        callTimes.total += time;
+        callTimes.max = std::max(callTimes.max, time);
+
+        if (!quiet && event.type == AmgXRecordType::Solve)
+        {
+            double maxTime;
+            MPI_Reduce(&time, &maxTime, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
+            if (rank == 0)
+            {
+                printf("solve %ld: solver %d, %d iterations, %.4f s\n",
+                       nSolves, event.solver, iterations, maxTime);
+            }
+        }
+    }
+
+    // The objects still alive at the end of the recording, solvers after their matrices
+    for (auto &entry : matrices)
+    {
+        entry.second->finalise();
+    }
+    matrices.clear();
+
+    for (auto entry = solvers.rbegin(); entry != solvers.rend(); ++entry)
+    {
+        entry->second->finalize();
+    }
+    solvers.clear();
+
+    // All ranks replay the same sequence of calls
+    if (rank == 0)
+    {
+        printf("%-24s %8s %14s %14s\n", "call", "count", "total [s]", "max [s]");
+    }
+
+    for (auto &entry : times)
+    {
+        double total, max;
+        MPI_Reduce(&entry.second.total, &total, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+        MPI_Reduce(&entry.second.max, &max, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
+        if (rank == 0)
+        {
+            printf("%-24s %8ld %14.4f %14.4f\n", typeName(entry.first), entry.second.count, total, max);
+        }
+    }
+
+    MPI_Finalize();
+
+    return 0;
+}
@@ -0,0 +1,609 @@
+/*
+ * Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "AmgXStandIn.H"
+
+#include <amgx_c.h>
+#include <cuda_runtime.h>
+#include <mpi.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+
+// The fake costs, from the environment
+struct StandInCosts
+{
+    int iterations = 10;
+    double setupNsPerNz = 0.0;
+    double solveNsPerNz = 0.0;
+    int reductions = 2;
+    int arithmetic = 0;
+};
+
+StandInCosts costs;
+
+AmgXStandInTimes times;
+std::mutex timesMutex;
+
+double now()
+{
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Accumulates the time since tStart into one of the times
+void addTime(double AmgXStandInTimes::*time, double tStart)
+{
+    std::lock_guard<std::mutex> lock(timesMutex);
+    times.*time += now() - tStart;
+}
+
+// Waits actively, as a host thread blocked on a synchronous call
+void spin(double seconds)
+{
+    const double tEnd = now() + seconds;
+    while (now() < tEnd) {}
+}
+
+bool isHost(AMGX_Mode mode)
+{
+    return mode == AMGX_mode_hDDI || mode == AMGX_mode_hDFI || mode == AMGX_mode_hFFI;
+}
+
+// An array in host or device memory, depending on the mode
+struct StandInArray
+{
+    bool host = true;
+    void *data = nullptr;
+    size_t bytes = 0;
+
+    void assign(const void *source, size_t n)
+    {
+        if (n > bytes)
+        {
+            release();
+            if (host) data = malloc(n);
+            else cudaMalloc(&data, n);
+            bytes = n;
+        }
+
+        if (n == 0) return;
+
+        if (host) memcpy(data, source, n);
+        else cudaMemcpy(data, source, n, cudaMemcpyDefault);
+    }
+
+    void copyTo(void *target, size_t n) const
+    {
+        if (n == 0) return;
+
+        if (host) memcpy(target, data, n);
+        else cudaMemcpy(target, data, n, cudaMemcpyDefault);
+    }
+
+    void release()
+    {
+        if (data == nullptr) return;
+
+        if (host) free(data);
+        else cudaFree(data);
+
+        data = nullptr;
+        bytes = 0;
+    }
+};
+
+struct StandInResources
+{
+    MPI_Comm comm;
+};
+
+struct StandInMatrix
+{
+    StandInResources *resources;
+    AMGX_Mode mode;
+    int n = 0;
+    int nnz = 0;
+
+    StandInArray rowOffsets;
+    StandInArray colIndices;
+    StandInArray values;
+};
+
+struct StandInVector
+{
+    AMGX_Mode mode;
+    int n = 0;
+
+    StandInArray data;
+};
+
+struct StandInSolver
+{
+    StandInMatrix *matrix = nullptr;
+    std::vector<double> residuals;
+};
+
+size_t valueBytes(AMGX_Mode mode)
+{
+    // The modes with a single precision matrix
+    return (mode == AMGX_mode_dFFI || mode == AMGX_mode_hFFI
+         || mode == AMGX_mode_dDFI || mode == AMGX_mode_hDFI) ? sizeof(float) : sizeof(double);
+}
+
+size_t vectorBytes(AMGX_Mode mode)
+{
+    return (mode == AMGX_mode_dFFI || mode == AMGX_mode_hFFI) ? sizeof(float) : sizeof(double);
+}
+
+template<typename T>
+void readCost(const char *name, T &value)
+{
+    const char *setting = std::getenv(name);
+    if (setting != nullptr) value = atof(setting);
+}
+
+// The values of a host vector, in double precision
+std::vector<double> readVector(const StandInVector *vector)
+{
+    std::vector<double> values(vector->n);
+    for (int i = 0; i < vector->n; ++i)
+    {
+        values[i] = vectorBytes(vector->mode) == sizeof(float)
+                  ? static_cast<const float*>(vector->data.data)[i]
+                  : static_cast<const double*>(vector->data.data)[i];
+    }
+
+    return values;
+}
+
+void writeVector(StandInVector *vector, const std::vector<double> &values)
+{
+    if (vectorBytes(vector->mode) == sizeof(float))
+    {
+        std::vector<float> converted(values.begin(), values.end());
+        vector->data.assign(converted.data(), values.size() * sizeof(float));
+    }
+    else
+    {
+        vector->data.assign(values.data(), values.size() * sizeof(double));
+    }
+
+    vector->n = values.size();
+}
+
+double matrixValue(const StandInMatrix *matrix, int k)
+{
+    return valueBytes(matrix->mode) == sizeof(float)
+         ? static_cast<const float*>(matrix->values.data)[k]
+         : static_cast<const double*>(matrix->values.data)[k];
+}
+
+// The product A x of a host matrix, x gathered over the ranks of the resources,
+// whose rows are numbered in rank order
+std::vector<double> multiply(const StandInMatrix *matrix, const std::vector<double> &x)
+{
+    MPI_Comm comm = matrix->resources->comm;
+
+    int size;
+    MPI_Comm_size(comm, &size);
+
+    std::vector<int> counts(size), displs(size + 1, 0);
+    MPI_Allgather(&matrix->n, 1, MPI_INT, counts.data(), 1, MPI_INT, comm);
+    for (int r = 0; r < size; ++r) displs[r + 1] = displs[r] + counts[r];
+
+    std::vector<double> xGlobal(displs[size]);
+    MPI_Allgatherv(x.data(), matrix->n, MPI_DOUBLE, xGlobal.data(), counts.data(),
+                   displs.data(), MPI_DOUBLE, comm);
+
+    const int *rowOffsets = static_cast<const int*>(matrix->rowOffsets.data);
+    const int *colIndices = static_cast<const int*>(matrix->colIndices.data);
+
+    std::vector<double> y(matrix->n, 0.0);
+    for (int i = 0; i < matrix->n; ++i)
+    {
+        for (int k = rowOffsets[i]; k < rowOffsets[i + 1]; ++k)
+        {
+            y[i] += matrixValue(matrix, k) * xGlobal[colIndices[k]];
+        }
+    }
+
+    return y;
+}
+
+// The L2 norm of the residual b - A x over the ranks of the resources
+double residualNorm(const StandInMatrix *matrix, const std::vector<double> &b,
+                    const std::vector<double> &Ax, std::vector<double> &r)
+{
+    double norm = 0.0;
+    for (int i = 0; i < matrix->n; ++i)
+    {
+        r[i] = b[i] - Ax[i];
+        norm += r[i] * r[i];
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, &norm, 1, MPI_DOUBLE, MPI_SUM, matrix->resources->comm);
+
+    return std::sqrt(norm);
+}
+
+// A solve of Jacobi sweeps from the uploaded solution, in a host mode
+void jacobiSolve(StandInSolver *solver, const StandInVector *rhs, StandInVector *sol)
+{
+    const StandInMatrix *matrix = solver->matrix;
+    const std::vector<double> b = readVector(rhs);
+    std::vector<double> x = readVector(sol);
+
+    int firstRow = 0;
+    MPI_Exscan(&matrix->n, &firstRow, 1, MPI_INT, MPI_SUM, matrix->resources->comm);
+
+    int rank;
+    MPI_Comm_rank(matrix->resources->comm, &rank);
+    if (rank == 0) firstRow = 0;
+
+    const int *rowOffsets = static_cast<const int*>(matrix->rowOffsets.data);
+    const int *colIndices = static_cast<const int*>(matrix->colIndices.data);
+
+    std::vector<double> diag(matrix->n, 1.0);
+    for (int i = 0; i < matrix->n; ++i)
+    {
+        for (int k = rowOffsets[i]; k < rowOffsets[i + 1]; ++k)
+        {
+            if (colIndices[k] == firstRow + i) diag[i] = matrixValue(matrix, k);
+        }
+    }
+
+    std::vector<double> r(matrix->n);
+    solver->residuals.assign(1, residualNorm(matrix, b, multiply(matrix, x), r));
+
+    for (int it = 0; it < costs.iterations; ++it)
+    {
+        for (int i = 0; i < matrix->n; ++i) x[i] += r[i] / diag[i];
+
+        solver->residuals.push_back(residualNorm(matrix, b, multiply(matrix, x), r));
+    }
+
+    writeVector(sol, x);
+}
+
+// A solve with the costs of the matrix of the solver
+void fakeSolve(StandInSolver *solver)
+{
+    StandInMatrix *matrix = solver->matrix;
+    const double iterationTime = costs.solveNsPerNz * 1e-9 * (matrix ? matrix->nnz : 0);
+
+    // The residual decreases tenfold an iteration
+    solver->residuals.assign(1, 1.0);
+
+    for (int it = 0; it < costs.iterations; ++it)
+    {
+        spin(iterationTime);
+
+        for (int r = 0; matrix != nullptr && r < costs.reductions; ++r)
+        {
+            double local = 1.0, global;
+            MPI_Allreduce(&local, &global, 1, MPI_DOUBLE, MPI_SUM, matrix->resources->comm);
+        }
+
+        solver->residuals.push_back(solver->residuals.back() * 0.1);
+    }
+}
+
+}
+
+AmgXStandInTimes getAmgXStandInTimes()
+{
+    std::lock_guard<std::mutex> lock(timesMutex);
+    return times;
+}
+
+void resetAmgXStandInTimes()
+{
+    std::lock_guard<std::mutex> lock(timesMutex);
+    times = AmgXStandInTimes();
+}
+
+extern "C"
+{
+
+AMGX_RC AMGX_initialize()
+{
+    costs = StandInCosts();
+    readCost("AMGX_STANDIN_ITERATIONS", costs.iterations);
+    readCost("AMGX_STANDIN_SETUP_NS_PER_NZ", costs.setupNsPerNz);
+    readCost("AMGX_STANDIN_SOLVE_NS_PER_NZ", costs.solveNsPerNz);
+    readCost("AMGX_STANDIN_REDUCTIONS", costs.reductions);
+    readCost("AMGX_STANDIN_ARITHMETIC", costs.arithmetic);
+    return AMGX_RC_OK;
+}
+
+AMGX_RC AMGX_initialize_plugins() { return AMGX_RC_OK; }
+AMGX_RC AMGX_finalize() { return AMGX_RC_OK; }
+AMGX_RC AMGX_finalize_plugins() { return AMGX_RC_OK; }
+AMGX_RC AMGX_install_signal_handler() { return AMGX_RC_OK; }
+AMGX_RC AMGX_register_print_callback(AMGX_print_callback) { return AMGX_RC_OK; }
+
+AMGX_RC AMGX_get_error_string(AMGX_RC err, char *buf, int buf_len)
+{
+    snprintf(buf, buf_len, "AmgX stand-in error %d", (int)err);
+    return AMGX_RC_OK;
+}
+
+void AMGX_abort(AMGX_resources_handle, int err)
+{
+    MPI_Abort(MPI_COMM_WORLD, err);
+}
+
+// The configuration is not read, only the costs of the environment apply
+AMGX_RC AMGX_config_create(AMGX_config_handle *cfg, const char *)
+{
+    *cfg = reinterpret_cast<AMGX_config_handle>(new char);
+    return AMGX_RC_OK;
+}
+
+AMGX_RC AMGX_config_create_from_file(AMGX_config_handle *cfg, const char *)
+{
+    return AMGX_config_create(cfg, nullptr);
+}
+
+AMGX_RC AMGX_config_create_from_file_and_string(AMGX_config_handle *cfg, const char *param_file, const char *)
+{
+    return AMGX_config_create_from_file(cfg, param_file);
+}
+
+AMGX_RC AMGX_config_add_parameters(AMGX_config_handle *, const char *) { return AMGX_RC_OK; }
+
+AMGX_RC AMGX_config_get_default_number_of_rings(AMGX_config_handle, int *num_import_rings)
+{
+    *num_import_rings = 1;
+    return AMGX_RC_OK;
+}
+
+AMGX_RC AMGX_config_destroy(AMGX_config_handle cfg)
+{
+    delete reinterpret_cast<char*>(cfg);
+    return AMGX_RC_OK;
+}
+
+AMGX_RC AMGX_resources_create(AMGX_resources_handle *rsc, AMGX_config_handle, void *comm, int, const int *)
+{
+    StandInResources *resources = new StandInResources;
+    MPI_Comm_dup(*static_cast<MPI_Comm*>(comm), &resources->comm);
+    *rsc = reinterpret_cast<AMGX_resources_handle>(resources);
+    return AMGX_RC_OK;
+}
+
+AMGX_RC AMGX_resources_destroy(AMGX_resources_handle rsc)
+{
+    StandInResources *resources = reinterpret_cast<StandInResources*>(rsc);
+    MPI_Comm_free(&resources->comm);
+    delete resources;
+    return AMGX_RC_OK;
+}
+
+AMGX_RC AMGX_distribution_create(AMGX_distribution_handle *dist, AMGX_config_handle)
+{
+    *dist = reinterpret_cast<AMGX_distribution_handle>(new char);
+    return AMGX_RC_OK;
+}
+
+AMGX_RC AMGX_distribution_destroy(AMGX_distribution_handle dist)
+{
+    delete reinterpret_cast<char*>(dist);
+    return AMGX_RC_OK;
+}
+
+AMGX_RC AMGX_distribution_set_partition_data(AMGX_distribution_handle, AMGX_DIST_PARTITION_INFO, const void *)
+{
+    return AMGX_RC_OK;
+}
+
+AMGX_RC AMGX_distribution_set_32bit_colindices(AMGX_distribution_handle, int) { return AMGX_RC_OK; }
+
+AMGX_RC AMGX_matrix_create(AMGX_matrix_handle *mtx, AMGX_resources_handle rsc, AMGX_Mode mode)
+{
+    StandInMatrix *matrix = new StandInMatrix;
+    matrix->resources = reinterpret_cast<StandInResources*>(rsc);
+    matrix->mode = mode;
+    matrix->rowOffsets.host = matrix->colIndices.host = matrix->values.host = isHost(mode);
+    *mtx = reinterpret_cast<AMGX_matrix_handle>(matrix);
+    return AMGX_RC_OK;
+}
+
+AMGX_RC AMGX_matrix_destroy(AMGX_matrix_handle mtx)
+{
+    StandInMatrix *matrix = reinterpret_cast<StandInMatrix*>(mtx);
+    matrix->rowOffsets.release();
+    matrix->colIndices.release();
+    matrix->values.release();
+    delete matrix;
+    return AMGX_RC_OK;
+}
+
+AMGX_RC AMGX_matrix_upload_distributed(AMGX_matrix_handle mtx, int, int n, int nnz, int, int,
+                                       const int *row_ptrs, const void *col_indices_global,
+                                       const void *data, const void *, AMGX_distribution_handle)
+{
+    const double tStart = now();
+
+    StandInMatrix *matrix = reinterpret_cast<StandInMatrix*>(mtx);
+    matrix->n = n;
+    matrix->nnz = nnz;
+    matrix->rowOffsets.assign(row_ptrs, (n + 1) * sizeof(int));
+    matrix->colIndices.assign(col_indices_global, nnz * sizeof(int));
+    matrix->values.assign(data, nnz * valueBytes(matrix->mode));
+
+    addTime(&AmgXStandInTimes::upload, tStart);
+    return AMGX_RC_OK;
+}
+
+AMGX_RC AMGX_matrix_replace_coefficients(AMGX_matrix_handle mtx, int, int nnz, const void *data, const void *)
+{
+    const double tStart = now();
+
+    StandInMatrix *matrix = reinterpret_cast<StandInMatrix*>(mtx);
+    matrix->values.assign(data, nnz * valueBytes(matrix->mode));
+
+    addTime(&AmgXStandInTimes::upload, tStart);
+    return AMGX_RC_OK;
+}
+
+// The identity, at the cost of an iteration, or the product with arithmetic in a host mode
+AMGX_RC AMGX_matrix_vector_multiply(AMGX_matrix_handle mtx, AMGX_vector_handle x, AMGX_vector_handle y)
+{
+    StandInMatrix *matrix = reinterpret_cast<StandInMatrix*>(mtx);
+    StandInVector *in = reinterpret_cast<StandInVector*>(x);
+    StandInVector *out = reinterpret_cast<StandInVector*>(y);
+
+    if (costs.arithmetic && isHost(matrix->mode))
+    {
+        writeVector(out, multiply(matrix, readVector(in)));
+        return AMGX_RC_OK;
+    }
+
+    spin(costs.solveNsPerNz * 1e-9 * matrix->nnz);
+
+    out->n = in->n;
+    out->data.assign(in->data.data, in->n * vectorBytes(in->mode));
+    return AMGX_RC_OK;
+}
+
+AMGX_RC AMGX_vector_create(AMGX_vector_handle *vec, AMGX_resources_handle, AMGX_Mode mode)
+{
+    StandInVector *vector = new StandInVector;
+    vector->mode = mode;
+    vector->data.host = isHost(mode);
+    *vec = reinterpret_cast<AMGX_vector_handle>(vector);
+    return AMGX_RC_OK;
+}
+
+AMGX_RC AMGX_vector_destroy(AMGX_vector_handle vec)
+{
+    StandInVector *vector = reinterpret_cast<StandInVector*>(vec);
+    vector->data.release();
+    delete vector;
+    return AMGX_RC_OK;
+}
+
+AMGX_RC AMGX_vector_upload(AMGX_vector_handle vec, int n, int, const void *data)
+{
+    const double tStart = now();
+
+    StandInVector *vector = reinterpret_cast<StandInVector*>(vec);
+    vector->n = n;
+    vector->data.assign(data, n * vectorBytes(vector->mode));
+
+    addTime(&AmgXStandInTimes::upload, tStart);
+    return AMGX_RC_OK;
+}
+
+AMGX_RC AMGX_vector_download(const AMGX_vector_handle vec, void *data)
+{
+    const double tStart = now();
+
+    const StandInVector *vector = reinterpret_cast<const StandInVector*>(vec);
+    vector->data.copyTo(data, vector->n * vectorBytes(vector->mode));
+
+    addTime(&AmgXStandInTimes::download, tStart);
+    return AMGX_RC_OK;
+}
+
+AMGX_RC AMGX_vector_bind(AMGX_vector_handle, const AMGX_matrix_handle) { return AMGX_RC_OK; }
+
+AMGX_RC AMGX_solver_create(AMGX_solver_handle *slv, AMGX_resources_handle, AMGX_Mode, const AMGX_config_handle)
+{
+    *slv = reinterpret_cast<AMGX_solver_handle>(new StandInSolver);
+    return AMGX_RC_OK;
+}
+
+AMGX_RC AMGX_solver_destroy(AMGX_solver_handle slv)
+{
+    delete reinterpret_cast<StandInSolver*>(slv);
+    return AMGX_RC_OK;
+}
+
+AMGX_RC AMGX_solver_setup(AMGX_solver_handle slv, AMGX_matrix_handle mtx)
+{
+    const double tStart = now();
+
+    StandInSolver *solver = reinterpret_cast<StandInSolver*>(slv);
+    solver->matrix = reinterpret_cast<StandInMatrix*>(mtx);
+    spin(costs.setupNsPerNz * 1e-9 * solver->matrix->nnz);
+
+    addTime(&AmgXStandInTimes::setup, tStart);
+    return AMGX_RC_OK;
+}
+
+AMGX_RC AMGX_solver_resetup(AMGX_solver_handle slv, AMGX_matrix_handle mtx)
+{
+    return AMGX_solver_setup(slv, mtx);
+}
+
+AMGX_RC AMGX_solver_solve(AMGX_solver_handle slv, AMGX_vector_handle rhs, AMGX_vector_handle sol)
+{
+    const double tStart = now();
+
+    StandInSolver *solver = reinterpret_cast<StandInSolver*>(slv);
+    if (costs.arithmetic && solver->matrix != nullptr && isHost(solver->matrix->mode))
+    {
+        jacobiSolve(solver, reinterpret_cast<StandInVector*>(rhs), reinterpret_cast<StandInVector*>(sol));
+    }
+    else
+    {
+        fakeSolve(solver);
+    }
+
+    addTime(&AmgXStandInTimes::solve, tStart);
+
+    std::lock_guard<std::mutex> lock(timesMutex);
+    ++times.nSolves;
+    return AMGX_RC_OK;
+}
+
+AMGX_RC AMGX_solver_get_iterations_number(AMGX_solver_handle slv, int *n)
+{
+    *n = reinterpret_cast<StandInSolver*>(slv)->residuals.size() - 1;
+    return AMGX_RC_OK;
+}
+
+AMGX_RC AMGX_solver_get_iteration_residual(AMGX_solver_handle slv, int it, int, double *res)
+{
+    const std::vector<double> &residuals = reinterpret_cast<StandInSolver*>(slv)->residuals;
+    *res = (it >= 0 && it < (int)residuals.size()) ? residuals[it] : 0.0;
+    return AMGX_RC_OK;
+}
+
+AMGX_RC AMGX_solver_get_status(AMGX_solver_handle, AMGX_SOLVE_STATUS *st)
+{
+    *st = AMGX_SOLVE_SUCCESS;
+    return AMGX_RC_OK;
+}
+
+}
@@ -0,0 +1,283 @@
+/*
+ * Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+// CPU-only test of the LDU to CSR conversion of the host modes
+//
+// Converts generated meshes and compares the CSR rows with those assembled
+// from the LDU coefficients: after setValuesLDU and updateValues, in double
+// and float, after patchValuesLDU for a change of topology, and with a drop
+// tolerance, whose dropped coefficients stay dropped in the updates.
+//
+// Usage: mpirun -np <n> foam_csr_conversion_test
+
+#include <AmgXSolver.H>
+#include <tests/AmgXTestUtils.H>
+
+namespace
+{
+
+void testConversion(const AmgXGeneratedMesh &mesh, const std::string &name,
+                    AmgXSolver &solver, AmgXTestReport &report)
+{
+    AmgXCSRMatrix matrix;
+    solver.initialiseMatrixComms(matrix);
+
+    setValues(matrix, mesh);
+    report.check(maxDifference(csrEntries(matrix), lduEntries(mesh)) == 0.0, name + " setValuesLDU");
+
+    // New values, the lower triangle no longer the transpose of the upper
+    std::vector<double> diag(mesh.diag), upper(mesh.upper), lower(mesh.lower), ext(mesh.ext);
+    for (double &v : diag) v *= 2.0;
+    for (size_t f = 0; f < upper.size(); ++f) upper[f] *= 1.0 + 0.1 * (f % 3);
+    for (double &v : ext) v *= 0.5;
+
+    matrix.updateValues(mesh.nCells, mesh.nFaces, mesh.nExt, diag.data(), upper.data(),
+                        lower.data(), ext.data());
+    report.check(maxDifference(csrEntries(matrix), lduEntries(mesh, diag, upper, lower, ext)) == 0.0,
+                 name + " updateValues");
+
+    // The float values are converted exactly to the double values of the CSR matrix
+    std::vector<float> fdiag(diag.begin(), diag.end()), fupper(upper.begin(), upper.end());
+    std::vector<float> flower(lower.begin(), lower.end()), fext(ext.begin(), ext.end());
+
+    matrix.updateValues(mesh.nCells, mesh.nFaces, mesh.nExt, fdiag.data(), fupper.data(),
+                        flower.data(), fext.data());
+    report.check(maxDifference(csrEntries(matrix), lduEntries(mesh, fdiag, fupper, flower, fext)) == 0.0,
+                 name + " updateValues float");
+
+    AmgXCSRMatrix floatMatrix;
+    solver.initialiseMatrixComms(floatMatrix);
+
+    setValues(floatMatrix, mesh, fdiag, fupper, flower, fext);
+    report.check(maxDifference(csrEntries(floatMatrix), lduEntries(mesh, fdiag, fupper, flower, fext)) == 0.0,
+                 name + " setValuesLDU float");
+
+    floatMatrix.finalise();
+    matrix.finalise();
+}
+
+void testPatch(const AmgXGeneratedMesh &mesh, AmgXSolver &solver, AmgXTestReport &report)
+{
+    AmgXCSRMatrix matrix;
+    solver.initialiseMatrixComms(matrix);
+    setValues(matrix, mesh);
+
+    // Every fifth face is removed, and the first and last cells are joined by a new face;
+    // the cells and external coefficients are kept
+    AmgXGeneratedMesh patched = mesh;
+    patched.lowerAddr.clear();
+    patched.upperAddr.clear();
+    patched.upper.clear();
+    patched.lower.clear();
+
+    std::vector<int> faceMap;
+    for (int f = 0; f < mesh.nFaces; ++f)
+    {
+        if (f % 5 == 0) continue;
+
+        patched.lowerAddr.push_back(mesh.lowerAddr[f]);
+        patched.upperAddr.push_back(mesh.upperAddr[f]);
+        patched.upper.push_back(mesh.upper[f]);
+        patched.lower.push_back(mesh.lower[f]);
+        faceMap.push_back(f);
+    }
+
+    patched.lowerAddr.push_back(0);
+    patched.upperAddr.push_back(mesh.nCells - 1);
+    patched.upper.push_back(-0.5);
+    patched.lower.push_back(-0.25);
+    faceMap.push_back(-1);
+    patched.nFaces = faceMap.size();
+
+    std::vector<int> cellMap(mesh.nCells), extMap(mesh.nExt);
+    for (int i = 0; i < mesh.nCells; ++i) cellMap[i] = i;
+    for (int e = 0; e < mesh.nExt; ++e) extMap[e] = e;
+
+    matrix.patchValuesLDU(patched.nCells, patched.nFaces, patched.diagIndexGlobal, patched.lowOffGlobal,
+                          patched.uppOffGlobal, patched.upperAddr.data(), patched.lowerAddr.data(),
+                          patched.nExt, patched.extRow.data(), patched.extCol.data(), cellMap.data(),
+                          faceMap.data(), extMap.data(), patched.diag.data(), patched.upper.data(),
+                          patched.lower.data(), patched.ext.data());
+
+    AmgXCSRMatrix fresh;
+    solver.initialiseMatrixComms(fresh);
+    setValues(fresh, patched);
+
+    report.check(maxDifference(csrEntries(matrix), csrEntries(fresh)) == 0.0
+                 && maxDifference(csrEntries(fresh), lduEntries(patched)) == 0.0,
+                 "patchValuesLDU equals a fresh conversion");
+
+    fresh.finalise();
+    matrix.finalise();
+}
+
+void testDrop(const AmgXGeneratedMesh &generated, AmgXSolver &solver, AmgXTestReport &report)
+{
+    const double tolerance = 1e-4;
+    const double small = 1e-8;
+
+    // Some faces are small on both sides and dropped, some on one side only and kept
+    AmgXGeneratedMesh mesh = generated;
+    for (int f = 0; f < mesh.nFaces; f += 3)
+    {
+        mesh.upper[f] *= small;
+        mesh.lower[f] *= small;
+    }
+
+    for (int f = 1; f < mesh.nFaces; f += 7)
+    {
+        mesh.upper[f] *= small;
+    }
+
+    // The coefficients coupling two ranks are chosen by their pair of rows, so both
+    // ranks agree: small in both directions (dropped), in one direction (kept) or not
+    std::vector<char> extKept(mesh.nExt, 1);
+    for (int e = 0; e < mesh.nExt; ++e)
+    {
+        const long row = mesh.diagIndexGlobal + mesh.extRow[e];
+        const long col = mesh.extCol[e];
+
+        switch ((row + col) % 3)
+        {
+            case 0:
+                mesh.ext[e] *= small;
+                extKept[e] = 0;
+                break;
+            case 1:
+                if (row < col) mesh.ext[e] *= small;
+                break;
+            default:
+                break;
+        }
+    }
+
+    // The reference keeps the faces with a coefficient above the tolerance
+    std::vector<char> faceKept(mesh.nFaces);
+    for (int f = 0; f < mesh.nFaces; ++f)
+    {
+        const double scale = tolerance
+            * std::sqrt(std::abs(mesh.diag[mesh.lowerAddr[f]] * mesh.diag[mesh.upperAddr[f]]));
+        faceKept[f] = std::abs(mesh.upper[f]) >= scale || std::abs(mesh.lower[f]) >= scale;
+    }
+
+    AmgXGeneratedMesh compacted = mesh;
+    auto compact = [&](const std::vector<double> &upper, const std::vector<double> &lower,
+                       const std::vector<double> &ext)
+    {
+        compacted.lowerAddr.clear();
+        compacted.upperAddr.clear();
+        compacted.upper.clear();
+        compacted.lower.clear();
+        compacted.extRow.clear();
+        compacted.extCol.clear();
+        compacted.ext.clear();
+
+        for (int f = 0; f < mesh.nFaces; ++f)
+        {
+            if (!faceKept[f]) continue;
+
+            compacted.lowerAddr.push_back(mesh.lowerAddr[f]);
+            compacted.upperAddr.push_back(mesh.upperAddr[f]);
+            compacted.upper.push_back(upper[f]);
+            compacted.lower.push_back(lower[f]);
+        }
+
+        for (int e = 0; e < mesh.nExt; ++e)
+        {
+            if (!extKept[e]) continue;
+
+            compacted.extRow.push_back(mesh.extRow[e]);
+            compacted.extCol.push_back(mesh.extCol[e]);
+            compacted.ext.push_back(ext[e]);
+        }
+
+        compacted.nFaces = compacted.upper.size();
+        compacted.nExt = compacted.ext.size();
+    };
+
+    AmgXCSRMatrix matrix;
+    solver.initialiseMatrixComms(matrix);
+    matrix.setDropTolerance(tolerance, MPI_COMM_WORLD);
+    setValues(matrix, mesh);
+
+    compact(mesh.upper, mesh.lower, mesh.ext);
+    report.check(maxDifference(csrEntries(matrix), lduEntries(compacted)) == 0.0,
+                 "setValuesLDU with a drop tolerance");
+
+    // The dropped coefficients stay dropped, even once grown above the tolerance
+    std::vector<double> diag(mesh.diag), upper(mesh.upper), lower(mesh.lower), ext(mesh.ext);
+    for (double &v : diag) v *= 2.0;
+    for (double &v : upper) v *= 1.5;
+    for (int f = 0; f < mesh.nFaces; f += 3) upper[f] = -1.0;
+    for (int e = 0; e < mesh.nExt; ++e) if (!extKept[e]) ext[e] = -1.0;
+
+    matrix.updateValues(mesh.nCells, mesh.nFaces, mesh.nExt, diag.data(), upper.data(),
+                        lower.data(), ext.data());
+
+    compact(upper, lower, ext);
+    report.check(maxDifference(csrEntries(matrix), lduEntries(compacted, diag, compacted.upper,
+                                                              compacted.lower, compacted.ext)) == 0.0,
+                 "updateValues with a drop tolerance");
+
+    matrix.finalise();
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided);
+
+    AmgXTestReport report(MPI_COMM_WORLD);
+
+    {
+        // The stand-in ignores the configuration
+        AmgXSolver solver(MPI_COMM_WORLD, "hDDI", "/dev/null");
+
+        const MeshConnectivity connectivities[] =
+            {MeshConnectivity::Hex, MeshConnectivity::TetLike, MeshConnectivity::PolyLike};
+        const char *names[] = {"hex", "tet", "poly"};
+
+        for (int c = 0; c < 3; ++c)
+        {
+            AmgXMeshGenerator generator(3000, connectivities[c]);
+            generator.setCoefficients(0.3, 0.1);
+
+            testConversion(generator.generate(MPI_COMM_WORLD), names[c], solver, report);
+        }
+
+        AmgXMeshGenerator generator(3000, MeshConnectivity::PolyLike);
+        const AmgXGeneratedMesh mesh = generator.generate(MPI_COMM_WORLD);
+
+        testPatch(mesh, solver, report);
+        testDrop(mesh, solver, report);
+
+        solver.finalize();
+    }
+
+    const int status = report.status();
+    MPI_Finalize();
+
+    return status;
+}
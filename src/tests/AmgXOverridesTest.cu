@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+// CPU-only test of the convergence overrides of a solver
+//
+// Writes config files with and without scopes, in both the text and JSON
+// formats, and checks that the overrides of tolerance, max_iters and
+// convergence are given the scope of the top-level solver, since a scoped
+// value of the config file (e.g. main:tolerance) would take precedence over
+// an unscoped override, and that a scope the config file does not declare
+// leaves the overrides unchanged.
+//
+// Usage: mpirun -np <n> foam_csr_overrides_test
+
+#include <AmgXSolver.H>
+#include <tests/AmgXTestUtils.H>
+
+#include <fstream>
+
+namespace
+{
+
+// Writes a config file on the first rank, for all ranks. Collective over MPI_COMM_WORLD
+std::string writeConfig(const std::string &directory, const std::string &name,
+                        const std::string &contents)
+{
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    const std::string fileName = directory + "/" + name;
+    if (rank == 0) std::ofstream(fileName) << contents;
+
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    return fileName;
+}
+
+// The overrides of a solver of a config file, set by setParameterOverrides
+std::string overridesOf(const std::string &cfgFile, const std::string &scope)
+{
+    AmgXSolver solver(MPI_COMM_WORLD, "hDDI", cfgFile);
+    solver.setParameterOverrides(0.125, 20, "RELATIVE_INI_CORE", scope);
+
+    const std::string overrides = solver.getParameterOverrides();
+    solver.finalize();
+
+    return overrides;
+}
+
+// The overrides expected of overridesOf, with their scope prefix
+std::string expectedOverrides(const std::string &prefix)
+{
+    return prefix + "tolerance=0.125, " + prefix + "max_iters=20, "
+         + prefix + "convergence=RELATIVE_INI_CORE";
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided);
+
+    AmgXTestReport report(MPI_COMM_WORLD);
+    const std::string directory = makeTestDirectory(MPI_COMM_WORLD);
+
+    const std::string unscoped = writeConfig(directory, "unscoped.txt",
+        "solver=PCG\n"
+        "tolerance=1e-12\n");
+
+    const std::string scoped = writeConfig(directory, "scoped.txt",
+        "config_version=2\n"
+        "solver(main)=PCG  # the top-level solver\n"
+        "main:preconditioner(amg)=AMG\n"
+        "main:tolerance=1e-12\n"
+        "amg:max_iters=1\n");
+
+    const std::string json = writeConfig(directory, "scoped.json",
+        "{\n"
+        "    \"config_version\": 2,\n"
+        "    \"solver\": {\n"
+        "        \"preconditioner\": {\n"
+        "            \"solver\": \"AMG\",\n"
+        "            \"max_iters\": 1,\n"
+        "            \"scope\": \"amg\"\n"
+        "        },\n"
+        "        \"solver\": \"PCG\",\n"
+        "        \"tolerance\": 1e-12,\n"
+        "        \"scope\": \"main\"\n"
+        "    }\n"
+        "}\n");
+
+    report.check(overridesOf(unscoped, "") == expectedOverrides(""), "overrides of an unscoped config");
+    report.check(overridesOf(scoped, "") == expectedOverrides("main:"), "overrides of the top-level scope");
+    report.check(overridesOf(json, "") == expectedOverrides("main:"), "overrides of the top-level JSON scope");
+    report.check(overridesOf(scoped, "amg") == expectedOverrides("amg:"), "overrides of a declared scope");
+
+    {
+        // an undeclared scope is reported, and the previous overrides are kept
+        AmgXSolver solver(MPI_COMM_WORLD, "hDDI", scoped);
+        solver.setParameterOverrides("main:max_iters=5");
+        solver.setParameterOverrides(0.125, 20, "", "preconditioner");
+        report.check(solver.getParameterOverrides() == "main:max_iters=5", "overrides of an undeclared scope");
+        solver.finalize();
+    }
+
+    removeTestDirectory(directory, MPI_COMM_WORLD);
+
+    const int status = report.status();
+    MPI_Finalize();
+
+    return status;
+}
@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+// CPU-only test of the files written and read by the conversion
+//
+// Converts a generated mesh in a host mode, then checks that the CSR rows
+// come back unchanged from a snapshot, from the structure cache, and from a
+// MatrixMarket file read back by rows, and that snapshots and cached
+// structures take updates of the values.
+//
+// Usage: mpirun -np <n> foam_csr_persistence_test
+
+#include <AmgXSolver.H>
+#include <AmgXMatrixMarket.H>
+#include <tests/AmgXTestUtils.H>
+
+namespace
+{
+
+// Scales the values of a mesh, as a new time step would
+void scaleValues(AmgXGeneratedMesh &mesh, double factor)
+{
+    for (double &v : mesh.diag) v *= factor;
+    for (double &v : mesh.upper) v *= factor;
+    for (double &v : mesh.lower) v *= 2.0 * factor;
+    for (double &v : mesh.ext) v *= factor;
+}
+
+void updateValues(AmgXCSRMatrix &matrix, const AmgXGeneratedMesh &mesh)
+{
+    matrix.updateValues(mesh.nCells, mesh.nFaces, mesh.nExt, mesh.diag.data(), mesh.upper.data(),
+                        mesh.lower.data(), mesh.ext.data());
+}
+
+void testSnapshot(const AmgXGeneratedMesh &generated, const std::string &directory,
+                  AmgXSolver &solver, AmgXTestReport &report)
+{
+    AmgXGeneratedMesh mesh = generated;
+    const std::string prefix = directory + "/snapshot";
+
+    AmgXCSRMatrix saved;
+    solver.initialiseMatrixComms(saved);
+    setValues(saved, mesh);
+    report.check(saved.saveSnapshot(prefix), "saveSnapshot");
+
+    AmgXCSRMatrix loaded;
+    solver.initialiseMatrixComms(loaded);
+    report.check(loaded.loadSnapshot(prefix), "loadSnapshot");
+    report.check(maxDifference(csrEntries(loaded), lduEntries(mesh)) == 0.0, "snapshot round trip");
+
+    scaleValues(mesh, 3.0);
+    updateValues(loaded, mesh);
+    report.check(maxDifference(csrEntries(loaded), lduEntries(mesh)) == 0.0, "updateValues of a snapshot");
+
+    loaded.finalise();
+    saved.finalise();
+}
+
+void testStructureCache(const AmgXGeneratedMesh &generated, const std::string &directory,
+                        AmgXSolver &solver, AmgXTestReport &report)
+{
+    const int nFiles = countTestFiles(directory);
+
+    // The first conversion stores the structure, the second maps it
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        AmgXGeneratedMesh mesh = generated;
+        scaleValues(mesh, 1.0 + pass);
+
+        AmgXCSRMatrix matrix;
+        solver.initialiseMatrixComms(matrix);
+        matrix.setStructureCache(directory);
+        setValues(matrix, mesh);
+
+        const std::string name = pass == 0 ? "structure cache store" : "structure cache load";
+        report.check(maxDifference(csrEntries(matrix), lduEntries(mesh)) == 0.0, name);
+
+        // Each rank stores its structure in one file
+        if (pass == 0)
+        {
+            MPI_Barrier(MPI_COMM_WORLD);
+            report.check(countTestFiles(directory) > nFiles, "structure cache file");
+        }
+
+        scaleValues(mesh, 0.5);
+        updateValues(matrix, mesh);
+        report.check(maxDifference(csrEntries(matrix), lduEntries(mesh)) == 0.0, name + " updateValues");
+
+        matrix.finalise();
+    }
+}
+
+void testMatrixMarket(const AmgXMeshGenerator &generator, const std::string &directory,
+                      AmgXSolver &solver, AmgXTestReport &report)
+{
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    const std::string prefix = directory + "/matrix";
+
+    AmgXCSRMatrix matrix;
+    solver.initialiseMatrixComms(matrix);
+    setValues(matrix, generator.generate(MPI_COMM_WORLD));
+    report.check(matrix.writeMatrixMarket(prefix, MPI_COMM_WORLD), "writeMatrixMarket");
+    matrix.finalise();
+
+    // The file is read back by another decomposition, with several threads on each rank
+    const AmgXCSRRows rows = AmgXMatrixMarketReader(2).read(prefix + ".mtx", size - 1 - rank, size);
+
+    AmgXTestEntries read;
+    bool sorted = true;
+    for (int i = 0; i < rows.nRows; ++i)
+    {
+        for (int k = rows.rowOffsets[i]; k < rows.rowOffsets[i + 1]; ++k)
+        {
+            sorted = sorted && (k == rows.rowOffsets[i] || rows.colIndices[k - 1] < rows.colIndices[k]);
+            read[std::make_pair(rows.rowBegin + i, (long)rows.colIndices[k])] += rows.values[k];
+        }
+    }
+
+    // The reference rows are those of all ranks in the range read
+    AmgXTestEntries reference;
+    for (int r = 0; r < size; ++r)
+    {
+        for (const auto &entry : lduEntries(generator.generate(r, size)))
+        {
+            const long row = entry.first.first;
+            if (row >= rows.rowBegin && row < rows.rowBegin + rows.nRows) reference.insert(entry);
+        }
+    }
+
+    // The values are written with enough digits to be read back exactly
+    report.check(sorted && maxDifference(read, reference) == 0.0, "MatrixMarket round trip");
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided);
+
+    AmgXTestReport report(MPI_COMM_WORLD);
+    const std::string directory = makeTestDirectory(MPI_COMM_WORLD);
+
+    {
+        // The stand-in ignores the configuration
+        AmgXSolver solver(MPI_COMM_WORLD, "hDDI", "/dev/null");
+
+        AmgXMeshGenerator generator(4000, MeshConnectivity::PolyLike);
+        generator.setCoefficients(0.3, 0.1);
+        const AmgXGeneratedMesh mesh = generator.generate(MPI_COMM_WORLD);
+
+        testSnapshot(mesh, directory, solver, report);
+        testStructureCache(mesh, directory, solver, report);
+        testMatrixMarket(generator, directory, solver, report);
+
+        solver.finalize();
+    }
+
+    removeTestDirectory(directory, MPI_COMM_WORLD);
+
+    const int status = report.status();
+    MPI_Finalize();
+
+    return status;
+}
@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+// CPU-only test of the recycling of solution corrections
+//
+// Solves the LDU matrix of a generated mesh with the stand-in computing its
+// products and Jacobi sweeps, which leave a correction in the recycled
+// subspace. A RHS in the image of that subspace, b = A (a x1), is then solved
+// exactly by the projection of the initial guess, before AmgX is called, and
+// the residual of any other RHS is never increased by it. The same holds
+// after the coefficients are replaced, once the images of the subspace are
+// recomputed, and disabling the recycling leaves the guess as it is.
+//
+// Usage: mpirun -np <n> foam_csr_recycling_test
+
+#include <AmgXSolver.H>
+#include <tests/AmgXTestUtils.H>
+
+#include <stdlib.h>
+
+namespace
+{
+
+// A vector varying smoothly over the global rows
+std::vector<double> globalWave(const AmgXGeneratedMesh &mesh, double frequency, double offset)
+{
+    std::vector<double> x(mesh.nCells);
+    for (int i = 0; i < mesh.nCells; ++i)
+    {
+        x[i] = offset + std::sin(frequency * (mesh.diagIndexGlobal + i));
+    }
+
+    return x;
+}
+
+// The initial residual norm of a solve from a zero guess, that of the projected guess
+double projectedResidual(const AmgXGeneratedMesh &mesh, AmgXSolver &solver, AmgXCSRMatrix &matrix,
+                         const std::vector<double> &b)
+{
+    std::vector<double> x(mesh.nCells, 0.0);
+    solver.solve(mesh.nCells, x.data(), b.data(), matrix);
+
+    return solver.getSolveRecord().initialResidual;
+}
+
+bool isClose(double a, double b)
+{
+    return std::abs(a - b) <= 1e-12 * std::max(std::abs(a), std::abs(b));
+}
+
+// The RHS of a multiple of x
+std::vector<double> imageOf(const AmgXGeneratedMesh &mesh, const std::vector<double> &x, double factor)
+{
+    std::vector<double> b = multiply(mesh, x, MPI_COMM_WORLD);
+    for (double &v : b) v *= factor;
+
+    return b;
+}
+
+void testProjection(AmgXGeneratedMesh &mesh, AmgXSolver &solver, AmgXCSRMatrix &matrix,
+                    AmgXTestReport &report)
+{
+    const int nLocalNz = mesh.nCells + 2 * mesh.nFaces + mesh.nExt;
+
+    solver.setRecycling(4);
+
+    // The first correction is the solution of a zero guess
+    std::vector<double> x1(mesh.nCells, 0.0);
+    const std::vector<double> b1 = globalWave(mesh, 0.01, 0.5);
+    solver.solve(mesh.nCells, x1.data(), b1.data(), matrix);
+    report.check(isClose(solver.getSolveRecord().initialResidual, globalNorm(b1, MPI_COMM_WORLD)),
+                 "no projection of an empty subspace");
+
+    const std::vector<double> b2 = imageOf(mesh, x1, 2.5);
+    report.check(projectedResidual(mesh, solver, matrix, b2) < 1e-10 * globalNorm(b2, MPI_COMM_WORLD),
+                 "projection of a RHS in the image of the subspace");
+
+    const std::vector<double> b3 = globalWave(mesh, 0.05, -0.2);
+    report.check(projectedResidual(mesh, solver, matrix, b3) <= globalNorm(b3, MPI_COMM_WORLD),
+                 "projection of another RHS");
+
+    // New coefficients, the lower triangle scaled apart so the images change direction
+    for (double &v : mesh.diag) v *= 2.0;
+    for (double &v : mesh.upper) v *= 2.0;
+    for (double &v : mesh.lower) v *= 3.0;
+    for (double &v : mesh.ext) v *= 2.0;
+
+    matrix.updateValues(mesh.nCells, mesh.nFaces, mesh.nExt, mesh.diag.data(), mesh.upper.data(),
+                        mesh.lower.data(), mesh.ext.data());
+    solver.updateOperator(mesh.nCells, nLocalNz, matrix);
+
+    const std::vector<double> b4 = imageOf(mesh, x1, -1.5);
+    report.check(projectedResidual(mesh, solver, matrix, b4) < 1e-10 * globalNorm(b4, MPI_COMM_WORLD),
+                 "projection after updateOperator");
+
+    solver.setRecycling(0);
+    report.check(isClose(projectedResidual(mesh, solver, matrix, b4), globalNorm(b4, MPI_COMM_WORLD)),
+                 "no projection without recycling");
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided);
+
+    // The stand-in computes the products and solves, read as AmgX is initialised
+    setenv("AMGX_STANDIN_ARITHMETIC", "1", 1);
+
+    AmgXTestReport report(MPI_COMM_WORLD);
+
+    {
+        AmgXSolver solver(MPI_COMM_WORLD, "hDDI", "/dev/null");
+
+        AmgXMeshGenerator generator(4000, MeshConnectivity::PolyLike);
+        generator.setCoefficients(0.3, 0.1);
+        AmgXGeneratedMesh mesh = generator.generate(MPI_COMM_WORLD);
+
+        AmgXCSRMatrix matrix;
+        solver.initialiseMatrixComms(matrix);
+        setValues(matrix, mesh);
+        solver.setOperator(mesh.nCells, mesh.nGlobalCells, mesh.nCells + 2 * mesh.nFaces + mesh.nExt, matrix);
+
+        testProjection(mesh, solver, matrix, report);
+
+        matrix.finalise();
+        solver.finalize();
+    }
+
+    const int status = report.status();
+    MPI_Finalize();
+
+    return status;
+}
@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+// CPU-only test of the assembly of several regions in a host mode
+//
+// Assembles the LDU matrices of two generated meshes and the coefficients
+// coupling them with setRegionsLDU, and compares the CSR rows with those
+// assembled from the regions in the numbering of the monolithic matrix,
+// after the assembly and after updateRegionValues.
+//
+// Usage: mpirun -np <n> foam_csr_regions_test
+
+#include <AmgXSolver.H>
+#include <tests/AmgXTestUtils.H>
+
+namespace
+{
+
+// The decomposition of a region: the first row and rows of each rank
+struct RegionLayout
+{
+    std::vector<int> rowBegin;
+    std::vector<int> nRows;
+};
+
+RegionLayout gatherLayout(const AmgXGeneratedMesh &mesh, MPI_Comm comm)
+{
+    int size;
+    MPI_Comm_size(comm, &size);
+
+    RegionLayout layout;
+    layout.rowBegin.resize(size);
+    layout.nRows.resize(size);
+
+    MPI_Allgather(&mesh.diagIndexGlobal, 1, MPI_INT, layout.rowBegin.data(), 1, MPI_INT, comm);
+    MPI_Allgather(&mesh.nCells, 1, MPI_INT, layout.nRows.data(), 1, MPI_INT, comm);
+
+    return layout;
+}
+
+AmgXLduRegion<double> lduRegion(const AmgXGeneratedMesh &mesh)
+{
+    AmgXLduRegion<double> region;
+    region.nRows = mesh.nCells;
+    region.nInternalFaces = mesh.nFaces;
+    region.diagIndexGlobal = mesh.diagIndexGlobal;
+    region.upperAddr = mesh.upperAddr.data();
+    region.lowerAddr = mesh.lowerAddr.data();
+    region.extNnz = mesh.nExt;
+    region.extRow = mesh.extRow.data();
+    region.extCol = mesh.extCol.data();
+    region.diagVals = mesh.diag.data();
+    region.upperVals = mesh.upper.data();
+    region.lowerVals = mesh.lower.data();
+    region.extVals = mesh.ext.data();
+
+    return region;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided);
+
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    AmgXTestReport report(MPI_COMM_WORLD);
+
+    {
+        // The stand-in ignores the configuration
+        AmgXSolver solver(MPI_COMM_WORLD, "hDDI", "/dev/null");
+
+        AmgXGeneratedMesh meshes[2] =
+        {
+            AmgXMeshGenerator(3000, MeshConnectivity::PolyLike).generate(MPI_COMM_WORLD),
+            AmgXMeshGenerator(2000, MeshConnectivity::Hex).generate(MPI_COMM_WORLD)
+        };
+
+        const RegionLayout layouts[2] =
+            {gatherLayout(meshes[0], MPI_COMM_WORLD), gatherLayout(meshes[1], MPI_COMM_WORLD)};
+
+        // The first rows of region 1 are coupled to rows of region 0 on the next rank,
+        // and the first rows of region 0 to rows of region 1 on the previous rank
+        const int nInterface = 100;
+        const double h = 0.05;
+        const int next = (rank + 1) % size;
+        const int previous = (rank + size - 1) % size;
+
+        std::vector<int> rows(nInterface), cols10(nInterface), cols01(nInterface);
+        std::vector<double> values10(nInterface, -h), values01(nInterface, -h);
+        for (int i = 0; i < nInterface; ++i)
+        {
+            rows[i] = i;
+            cols10[i] = layouts[0].rowBegin[next] + i;
+            cols01[i] = layouts[1].rowBegin[previous] + i;
+            meshes[0].diag[i] += h;
+            meshes[1].diag[i] += h;
+        }
+
+        const AmgXLduRegion<double> regions[2] = {lduRegion(meshes[0]), lduRegion(meshes[1])};
+
+        AmgXRegionCoupling<double> couplings[2];
+        couplings[0].rowRegion = 1;
+        couplings[0].colRegion = 0;
+        couplings[0].nNz = nInterface;
+        couplings[0].row = rows.data();
+        couplings[0].col = cols10.data();
+        couplings[0].values = values10.data();
+        couplings[1].rowRegion = 0;
+        couplings[1].colRegion = 1;
+        couplings[1].nNz = nInterface;
+        couplings[1].row = rows.data();
+        couplings[1].col = cols01.data();
+        couplings[1].values = values01.data();
+
+        // The rows of each rank are those of region 0, then of region 1
+        std::vector<long> rankBegin(size + 1, 0);
+        for (int r = 0; r < size; ++r)
+        {
+            rankBegin[r + 1] = rankBegin[r] + layouts[0].nRows[r] + layouts[1].nRows[r];
+        }
+
+        auto monolithicRow = [&](int region, long row)
+        {
+            const RegionLayout &layout = layouts[region];
+            for (int r = 0; r < size; ++r)
+            {
+                if (row >= layout.rowBegin[r] && row < layout.rowBegin[r] + layout.nRows[r])
+                {
+                    return rankBegin[r] + (region == 1 ? layouts[0].nRows[r] : 0) + row - layout.rowBegin[r];
+                }
+            }
+            return -1L;
+        };
+
+        auto reference = [&]()
+        {
+            AmgXTestEntries entries;
+            for (int region = 0; region < 2; ++region)
+            {
+                for (const auto &entry : lduEntries(meshes[region]))
+                {
+                    entries[std::make_pair(monolithicRow(region, entry.first.first),
+                                           monolithicRow(region, entry.first.second))] += entry.second;
+                }
+            }
+
+            for (const AmgXRegionCoupling<double> &coupling : couplings)
+            {
+                const long first = monolithicRow(coupling.rowRegion, meshes[coupling.rowRegion].diagIndexGlobal);
+                for (int k = 0; k < coupling.nNz; ++k)
+                {
+                    entries[std::make_pair(first + coupling.row[k],
+                                           monolithicRow(coupling.colRegion, coupling.col[k]))] += coupling.values[k];
+                }
+            }
+
+            return entries;
+        };
+
+        AmgXCSRMatrix matrix;
+        solver.initialiseMatrixComms(matrix);
+        matrix.setRegionsLDU(2, regions, 2, couplings, MPI_COMM_WORLD);
+
+        report.check(matrix.getNGlobalRegionRows() == rankBegin[size], "regions global rows");
+        report.check(maxDifference(csrEntries(matrix), reference()) == 0.0, "setRegionsLDU");
+
+        // The values change in place, the addressing stays
+        for (double &v : meshes[0].diag) v *= 1.5;
+        for (double &v : meshes[1].upper) v *= 0.5;
+        for (double &v : values10) v *= 2.0;
+        for (int i = 0; i < nInterface; ++i) meshes[1].diag[i] += h;
+
+        matrix.updateRegionValues(2, regions, 2, couplings);
+        report.check(maxDifference(csrEntries(matrix), reference()) == 0.0, "updateRegionValues");
+
+        matrix.finalise();
+        solver.finalize();
+    }
+
+    const int status = report.status();
+    MPI_Finalize();
+
+    return status;
+}
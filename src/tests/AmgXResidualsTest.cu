@@ -0,0 +1,236 @@
+/*
+ * Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+// CPU-only test of the residual checks of the solves and of their records
+//
+// Solves the LDU matrix of a generated mesh with the stand-in computing its
+// products and Jacobi sweeps, and checks the normalised residuals against
+// OpenFOAM's definition, sum(|b - A x|) / normFactor with
+// normFactor = sum(|A x - A xRef| + |b - A xRef|) + 1e-20, computed here from
+// the LDU coefficients. Then checks that a converged initial guess skips the
+// solve, and that the records of skipped and full solves hold the residual
+// norms of the solve and are the same on all ranks. In the host modes each
+// rank has a device of its own, so the records are not broadcast.
+//
+// Usage: mpirun -np <n> foam_csr_residuals_test
+
+#include <AmgXSolver.H>
+#include <tests/AmgXTestUtils.H>
+
+#include <stdlib.h>
+
+namespace
+{
+
+// A vector varying smoothly over the global rows
+std::vector<double> globalWave(const AmgXGeneratedMesh &mesh, double frequency, double offset)
+{
+    std::vector<double> x(mesh.nCells);
+    for (int i = 0; i < mesh.nCells; ++i)
+    {
+        x[i] = offset + std::sin(frequency * (mesh.diagIndexGlobal + i));
+    }
+
+    return x;
+}
+
+// The normalised residual of OpenFOAM for the initial guess x0, and its normFactor
+double referenceResidual(const AmgXGeneratedMesh &mesh, const std::vector<double> &x0,
+                         const std::vector<double> &x, const std::vector<double> &b,
+                         double *normFactor)
+{
+    const std::vector<double> Ax0 = multiply(mesh, x0, MPI_COMM_WORLD);
+    const std::vector<double> Ax = multiply(mesh, x, MPI_COMM_WORLD);
+
+    std::vector<double> sumA(mesh.nCells, 0.0);
+    for (const auto &entry : lduEntries(mesh))
+    {
+        sumA[entry.first.first - mesh.diagIndexGlobal] += entry.second;
+    }
+
+    double sums[3] = {0.0, 0.0, 0.0};
+    for (int i = 0; i < mesh.nCells; ++i) sums[0] += x0[i];
+    MPI_Allreduce(MPI_IN_PLACE, sums, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+
+    const double xRef = sums[0] / mesh.nGlobalCells;
+
+    sums[0] = 0.0;
+    for (int i = 0; i < mesh.nCells; ++i)
+    {
+        sums[1] += std::abs(Ax0[i] - sumA[i] * xRef) + std::abs(b[i] - sumA[i] * xRef);
+        sums[2] += std::abs(b[i] - Ax[i]);
+    }
+
+    MPI_Allreduce(MPI_IN_PLACE, sums, 3, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+
+    *normFactor = sums[1] + 1e-20;
+
+    return sums[2] / *normFactor;
+}
+
+// The global L2 norm of b - A x
+double residualNorm(const AmgXGeneratedMesh &mesh, const std::vector<double> &x,
+                    const std::vector<double> &b)
+{
+    std::vector<double> r = multiply(mesh, x, MPI_COMM_WORLD);
+    for (int i = 0; i < mesh.nCells; ++i) r[i] = b[i] - r[i];
+
+    return globalNorm(r, MPI_COMM_WORLD);
+}
+
+bool isClose(double a, double b)
+{
+    return std::abs(a - b) <= 1e-10 * std::max(std::abs(a), std::abs(b));
+}
+
+// Whether a value is the same on all ranks
+bool sameOnAllRanks(double value)
+{
+    double range[2] = {-value, value};
+    MPI_Allreduce(MPI_IN_PLACE, range, 2, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+
+    return -range[0] == range[1];
+}
+
+// Whether the record of a solve is consistent and the same on all ranks
+bool isConsistentRecord(const AmgXSolveRecord &record)
+{
+    const std::vector<double> &history = record.residualHistory;
+
+    bool ok = record.skipped
+        ? history.empty() && record.finalResidual == record.initialResidual
+        : (int)history.size() == record.iterations + 1 && history.front() == record.initialResidual
+          && history.back() == record.finalResidual;
+
+    ok = sameOnAllRanks(record.iterations) && ok;
+    ok = sameOnAllRanks(record.skipped) && ok;
+    ok = sameOnAllRanks(record.initialResidual) && ok;
+    ok = sameOnAllRanks(record.finalResidual) && ok;
+    ok = sameOnAllRanks(record.normalisedInitialResidual) && ok;
+    ok = sameOnAllRanks(record.normalisedFinalResidual) && ok;
+
+    return ok;
+}
+
+void testNormalisedResiduals(const AmgXGeneratedMesh &mesh, AmgXSolver &solver,
+                             AmgXCSRMatrix &matrix, AmgXTestReport &report)
+{
+    const std::vector<double> b = globalWave(mesh, 0.01, 0.5);
+    const std::vector<double> x0 = globalWave(mesh, 0.003, 2.0);
+    std::vector<double> x = x0;
+
+    solver.setNormalisedResiduals(true);
+    solver.solve(mesh.nCells, x.data(), b.data(), matrix);
+    solver.setNormalisedResiduals(false);
+
+    double initial, final;
+    solver.getNormalisedResiduals(initial, final);
+
+    double normFactor;
+    const double referenceInitial = referenceResidual(mesh, x0, x0, b, &normFactor);
+    const double referenceFinal = referenceResidual(mesh, x0, x, b, &normFactor);
+
+    report.check(isClose(initial, referenceInitial), "normalised initial residual");
+    report.check(isClose(final, referenceFinal) && final < initial, "normalised final residual");
+
+    const AmgXSolveRecord &record = solver.getSolveRecord();
+    report.check(record.normalisedInitialResidual == initial && record.normalisedFinalResidual == final,
+                 "normalised residuals of the record");
+    report.check(isClose(record.initialResidual, residualNorm(mesh, x0, b))
+                 && isClose(record.finalResidual, residualNorm(mesh, x, b)), "residual norms of the record");
+    report.check(!record.skipped && record.iterations > 0 && isConsistentRecord(record), "record of a solve");
+}
+
+void testSkip(const AmgXGeneratedMesh &mesh, AmgXSolver &solver, AmgXCSRMatrix &matrix,
+              AmgXTestReport &report)
+{
+    // b = A x for a known x, which is a converged initial guess
+    const std::vector<double> solution = globalWave(mesh, 0.02, 1.0);
+    const std::vector<double> b = multiply(mesh, solution, MPI_COMM_WORLD);
+
+    solver.setSkipTolerance(1e-8);
+
+    std::vector<double> x = solution;
+    solver.solve(mesh.nCells, x.data(), b.data(), matrix);
+
+    const AmgXSolveRecord &skipped = solver.getSolveRecord();
+    report.check(skipped.skipped && skipped.iterations == 0 && x == solution, "skip of a converged guess");
+    // the norm of a residual of round-off errors, summed in another order here
+    const double roundOff = 1e-12 * globalNorm(b, MPI_COMM_WORLD);
+    report.check(std::abs(skipped.initialResidual - residualNorm(mesh, solution, b)) < roundOff
+                 && skipped.normalisedInitialResidual < 1e-8, "residuals of a skipped solve");
+    report.check(isConsistentRecord(skipped), "record of a skipped solve");
+
+    // A guess off by a constant is not converged
+    std::vector<double> guess = solution;
+    for (double &v : guess) v += 1.0;
+
+    x = guess;
+    solver.solve(mesh.nCells, x.data(), b.data(), matrix);
+
+    double normFactor;
+    const AmgXSolveRecord &solved = solver.getSolveRecord();
+    report.check(!solved.skipped && solved.iterations > 0 && x != guess
+                 && isClose(solved.normalisedInitialResidual, referenceResidual(mesh, guess, guess, b, &normFactor)),
+                 "no skip of an unconverged guess");
+
+    solver.setSkipTolerance(0.0);
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided);
+
+    // The stand-in computes the products and solves, read as AmgX is initialised
+    setenv("AMGX_STANDIN_ARITHMETIC", "1", 1);
+
+    AmgXTestReport report(MPI_COMM_WORLD);
+
+    {
+        AmgXSolver solver(MPI_COMM_WORLD, "hDDI", "/dev/null");
+
+        AmgXMeshGenerator generator(4000, MeshConnectivity::PolyLike);
+        generator.setCoefficients(0.3, 0.1);
+        const AmgXGeneratedMesh mesh = generator.generate(MPI_COMM_WORLD);
+
+        AmgXCSRMatrix matrix;
+        solver.initialiseMatrixComms(matrix);
+        setValues(matrix, mesh);
+        solver.setOperator(mesh.nCells, mesh.nGlobalCells, mesh.nCells + 2 * mesh.nFaces + mesh.nExt, matrix);
+
+        testNormalisedResiduals(mesh, solver, matrix, report);
+        testSkip(mesh, solver, matrix, report);
+
+        matrix.finalise();
+        solver.finalize();
+    }
+
+    const int status = report.status();
+    MPI_Finalize();
+
+    return status;
+}
@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+// CPU-only test of the extrapolation of initial guesses in time
+//
+// Stores the solutions of polynomial histories, x(t) = a + b t + c t^2 per
+// row, at unevenly spaced time levels, and checks that the Lagrange
+// extrapolations and the least-squares fit reproduce the polynomials of
+// their degree exactly at a new level, and how solves of the same level,
+// restarts and resizes change the levels stored.
+//
+// Usage: mpirun -np <n> foam_csr_history_test
+
+#include <AmgXSolutionHistory.H>
+#include <tests/AmgXTestUtils.H>
+
+namespace
+{
+
+const int nRows = 50;
+
+// The solution at time t of a polynomial history of the given degree
+std::vector<double> polynomial(int degree, double t)
+{
+    std::vector<double> x(nRows);
+    for (int i = 0; i < nRows; ++i)
+    {
+        x[i] = 1.0 + 0.1 * i;
+        if (degree > 0) x[i] += (0.5 - 0.02 * i) * t;
+        if (degree > 1) x[i] += (0.3 + 0.01 * i) * t * t;
+    }
+
+    return x;
+}
+
+// A history of the solutions of a polynomial at the given times
+AmgXSolutionHistory storeLevels(int degree, const std::vector<double> &times, int nLevels)
+{
+    AmgXSolutionHistory history;
+    for (double t : times)
+    {
+        history.store(t, nRows, polynomial(degree, t).data(), nLevels);
+    }
+
+    return history;
+}
+
+// The largest relative difference of an extrapolation from the polynomial at time t,
+// infinite if the guess was not extrapolated
+double extrapolationError(const AmgXSolutionHistory &history, InitialGuessMode mode,
+                          int degree, double t)
+{
+    std::vector<double> x(nRows, 0.0);
+    if (!history.extrapolate(mode, t, nRows, x.data()))
+    {
+        return std::numeric_limits<double>::infinity();
+    }
+
+    const std::vector<double> exact = polynomial(degree, t);
+
+    double error = 0.0;
+    for (int i = 0; i < nRows; ++i)
+    {
+        error = std::max(error, std::abs(x[i] - exact[i]) / std::abs(exact[i]));
+    }
+
+    return error;
+}
+
+void testExtrapolation(AmgXTestReport &report)
+{
+    const std::vector<double> times = {0.0, 0.3, 0.5, 1.1, 1.4};
+    const double t = 1.7;
+    const double tolerance = 1e-12;
+
+    report.check(extrapolationError(storeLevels(1, times, 2), InitialGuessMode::Linear, 1, t) < tolerance,
+                 "linear extrapolation of a linear history");
+    report.check(extrapolationError(storeLevels(2, times, 3), InitialGuessMode::Quadratic, 2, t) < tolerance,
+                 "quadratic extrapolation of a quadratic history");
+    report.check(extrapolationError(storeLevels(1, times, 5), InitialGuessMode::LeastSquares, 1, t) < tolerance,
+                 "least-squares fit of a linear history");
+
+    // The linear extrapolation uses the last two levels only, the quadratic one the last three
+    report.check(extrapolationError(storeLevels(1, times, 5), InitialGuessMode::Linear, 1, t) < tolerance,
+                 "linear extrapolation from the last levels");
+    report.check(extrapolationError(storeLevels(2, times, 5), InitialGuessMode::Quadratic, 2, t) < tolerance,
+                 "quadratic extrapolation from the last levels");
+
+    // With two levels a quadratic extrapolation falls back to a linear one
+    report.check(extrapolationError(storeLevels(1, {0.2, 0.9}, 3), InitialGuessMode::Quadratic, 1, t) < tolerance,
+                 "quadratic extrapolation of two levels");
+
+    // The least-squares line of a quadratic is not the quadratic itself
+    const double fitError = extrapolationError(storeLevels(2, times, 5), InitialGuessMode::LeastSquares, 2, t);
+    report.check(fitError > tolerance && fitError < 1.0, "least-squares fit of a quadratic history");
+}
+
+void testLevels(AmgXTestReport &report)
+{
+    const double tolerance = 1e-12;
+
+    // Solves of the same level overwrite its solution, the first one with a wrong value
+    AmgXSolutionHistory history;
+    history.store(0.0, nRows, polynomial(1, 0.0).data(), 3);
+    history.store(1.0, nRows, polynomial(2, 1.0).data(), 3);
+    history.store(1.0, nRows, polynomial(1, 1.0).data(), 3);
+    report.check(extrapolationError(history, InitialGuessMode::Linear, 1, 2.0) < tolerance,
+                 "solves of one level overwrite it");
+
+    // Only the first solve of a new level is extrapolated
+    std::vector<double> x(nRows, 0.0);
+    report.check(!history.extrapolate(InitialGuessMode::Linear, 1.0, nRows, x.data()),
+                 "solves of a stored level are not extrapolated");
+    report.check(!history.extrapolate(InitialGuessMode::None, 2.0, nRows, x.data()),
+                 "no extrapolation without a mode");
+
+    // The next time is one unit after the last level
+    report.check(history.nextTime() == 2.0, "next time of a history");
+
+    // A restart from an earlier time keeps only its level
+    history.store(0.5, nRows, polynomial(1, 0.5).data(), 3);
+    report.check(!history.extrapolate(InitialGuessMode::Linear, 2.0, nRows, x.data()),
+                 "a restart discards the later levels");
+
+    // A change of size is not extrapolated, and discards the history when stored
+    history.store(1.5, nRows, polynomial(1, 1.5).data(), 3);
+    report.check(!history.extrapolate(InitialGuessMode::Linear, 2.0, nRows - 1, x.data()),
+                 "a resized solution is not extrapolated");
+
+    history.store(2.0, nRows - 1, polynomial(1, 2.0).data(), 3);
+    report.check(!history.extrapolate(InitialGuessMode::Linear, 2.5, nRows - 1, x.data()),
+                 "a resized solution discards the history");
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided);
+
+    AmgXTestReport report(MPI_COMM_WORLD);
+
+    testExtrapolation(report);
+    testLevels(report);
+
+    const int status = report.status();
+    MPI_Finalize();
+
+    return status;
+}